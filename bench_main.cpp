@@ -0,0 +1,280 @@
+﻿#define TINY_PERFORMANCE_COUNTER_IMPLEMENTATION
+#include "tiny_performance_counter.h"
+
+#include <thread>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+// 収集処理の負荷を計測するベンチマーク.
+//  結果は1行1件の JSON (JSON Lines) で標準出力に書き出す. 比較用に保存しておくこと.
+//  使い方: TinyPerformanceCounterBenchmark.exe [計測時間 (ms)]
+namespace
+{
+  using Clock = std::chrono::steady_clock;
+
+  double ToMicroSeconds(Clock::duration duration)
+  {
+    return std::chrono::duration<double, std::micro>(duration).count();
+  }
+
+  // 取得関数の遅延・スループット.
+  //  readerCount 個のスレッドが durationMilliSeconds の間 GetCPUUtilization を呼び続ける.
+  void BenchmarkGetters(tiny_perf_counter::Collector& collector, uint32_t readerCount, uint32_t durationMilliSeconds)
+  {
+    std::atomic<bool> start = false;
+    std::atomic<bool> stop = false;
+    std::vector<uint64_t> callCounts(readerCount);
+    std::vector<double> maxBatchNanoSeconds(readerCount);
+    std::vector<std::thread> readers;
+    for (uint32_t i = 0; i < readerCount; ++i)
+    {
+      readers.emplace_back([&, i]() {
+        // 1回ごとの計測は時刻取得の負荷が支配的になるため、まとめて計測する.
+        constexpr uint64_t kBatchSize = 256;
+        volatile double sink = 0;
+        while (!start.load(std::memory_order_acquire))
+        {
+          std::this_thread::yield();
+        }
+        uint64_t count = 0;
+        double maxBatch = 0;
+        while (!stop.load(std::memory_order_relaxed))
+        {
+          auto begin = Clock::now();
+          for (uint64_t j = 0; j < kBatchSize; ++j)
+          {
+            sink = collector.GetCPUUtilization();
+          }
+          maxBatch = (std::max)(maxBatch, ToMicroSeconds(Clock::now() - begin) * 1000.0 / kBatchSize);
+          count += kBatchSize;
+        }
+        // 受け取った値を一度読み出して使用する (書き込みのみの変数として警告されないように).
+        static_cast<void>(double(sink));
+        callCounts[i] = count;
+        maxBatchNanoSeconds[i] = maxBatch;
+      });
+    }
+
+    tiny_perf_counter::Snapshot before{}, after{};
+    collector.GetSnapshot(before);
+    auto begin = Clock::now();
+    start.store(true, std::memory_order_release);
+    std::this_thread::sleep_for(std::chrono::milliseconds(durationMilliSeconds));
+    stop.store(true, std::memory_order_relaxed);
+    for (auto& reader : readers)
+    {
+      reader.join();
+    }
+    auto elapsedSeconds = ToMicroSeconds(Clock::now() - begin) * 1.0e-6;
+    collector.GetSnapshot(after);
+
+    uint64_t totalCalls = 0;
+    double maxNanoSeconds = 0;
+    for (uint32_t i = 0; i < readerCount; ++i)
+    {
+      totalCalls += callCounts[i];
+      maxNanoSeconds = (std::max)(maxNanoSeconds, maxBatchNanoSeconds[i]);
+    }
+    // 各スレッドは計測時間の間ずっと呼び続けているため、1回あたりの時間は スレッド数 * 時間 / 回数.
+    auto meanNanoSeconds = totalCalls > 0 ? elapsedSeconds * 1.0e9 * readerCount / double(totalCalls) : 0.0;
+    auto retries = after.collectorStats.getterRetryCount - before.collectorStats.getterRetryCount;
+    printf("{\"benchmark\":\"getter\",\"readers\":%u,\"calls\":%llu,\"callsPerSecond\":%.0f,\"meanNanoSeconds\":%.2f,\"maxBatchMeanNanoSeconds\":%.2f,\"retries\":%llu}\n",
+      readerCount, (unsigned long long)totalCalls, double(totalCalls) / elapsedSeconds, meanNanoSeconds, maxNanoSeconds, (unsigned long long)retries);
+  }
+
+  // 採取1回あたりのワーカースレッドの負荷.
+  //  GPU のインスタンス数は環境に依存するため、計測時に走査した数も合わせて出力する.
+  void BenchmarkTick(const char* name, const tiny_perf_counter::InitParams& initParams, uint32_t durationMilliSeconds)
+  {
+    tiny_perf_counter::Collector collector;
+    if (!collector.Initialize(initParams))
+    {
+      printf("{\"benchmark\":\"tick\",\"config\":\"%s\",\"error\":\"initialize failed\"}\n", name);
+      return;
+    }
+    // 初回は前回値がなく、キャッシュの構築も含まれるため除外する.
+    collector.SampleNow(1000);
+    tiny_perf_counter::Snapshot before{}, after{};
+    collector.GetSnapshot(before);
+    std::this_thread::sleep_for(std::chrono::milliseconds(durationMilliSeconds));
+    collector.GetSnapshot(after);
+
+    auto& stats = after.collectorStats;
+    auto samples = stats.sampleCount - before.collectorStats.sampleCount;
+    auto totalMicroSeconds = stats.totalSampleMicroSeconds - before.collectorStats.totalSampleMicroSeconds;
+    auto meanMicroSeconds = samples > 0 ? totalMicroSeconds / double(samples) : 0.0;
+    printf("{\"benchmark\":\"tick\",\"config\":\"%s\",\"intervalMilliSeconds\":%u,\"samples\":%llu,\"meanMicroSeconds\":%.2f,"
+      "\"workerLoadPercent\":%.4f,\"gpuEngineInstances\":%u,\"instancesScanned\":%u,\"instancesKept\":%u,\"workBufferBytes\":%llu",
+      name, initParams.checkIntervalMilliSeconds, (unsigned long long)samples, meanMicroSeconds,
+      totalMicroSeconds * 1.0e-3 / durationMilliSeconds * 100.0, after.gpuEngineInstanceCount, stats.instancesScanned, stats.instancesKept,
+      (unsigned long long)stats.workBufferBytes);
+    // グループ (CounterGroup) ごとの直近の時間.
+    auto printGroups = [](const char* key, const double (&values)[tiny_perf_counter::kCounterGroupCount]) {
+      printf(",\"%s\":[", key);
+      for (uint32_t i = 0; i < tiny_perf_counter::kCounterGroupCount; ++i)
+      {
+        printf(i == 0 ? "%.2f" : ",%.2f", values[i]);
+      }
+      printf("]");
+    };
+    printGroups("pdhCollectMicroSeconds", stats.pdhCollectMicroSeconds);
+    printGroups("collectMicroSeconds", stats.collectMicroSeconds);
+    printf("}\n");
+  }
+
+  // Initialize / Shutdown の所要時間.
+  void BenchmarkLifetime(uint32_t repeatCount)
+  {
+    double initializeTotal = 0, initializeMax = 0;
+    double shutdownTotal = 0, shutdownMax = 0;
+    for (uint32_t i = 0; i < repeatCount; ++i)
+    {
+      tiny_perf_counter::Collector collector;
+      auto begin = Clock::now();
+      collector.Initialize(tiny_perf_counter::InitParams{});
+      auto initialized = Clock::now();
+      collector.Shutdown();
+      auto end = Clock::now();
+      auto initialize = ToMicroSeconds(initialized - begin);
+      auto shutdown = ToMicroSeconds(end - initialized);
+      initializeTotal += initialize;
+      initializeMax = (std::max)(initializeMax, initialize);
+      shutdownTotal += shutdown;
+      shutdownMax = (std::max)(shutdownMax, shutdown);
+    }
+    printf("{\"benchmark\":\"lifetime\",\"repeat\":%u,\"initializeMeanMicroSeconds\":%.1f,\"initializeMaxMicroSeconds\":%.1f,"
+      "\"shutdownMeanMicroSeconds\":%.1f,\"shutdownMaxMicroSeconds\":%.1f}\n",
+      repeatCount, initializeTotal / repeatCount, initializeMax, shutdownTotal / repeatCount, shutdownMax);
+  }
+
+  // CPU 負荷の高い処理 (全論理プロセッサで固定量の計算) にかかる時間.
+  double RunCPUBoundWorkload()
+  {
+    constexpr uint64_t kIterations = 200'000'000;
+    auto threadCount = (std::max)(1u, std::thread::hardware_concurrency());
+    std::vector<std::thread> workers;
+    std::vector<uint64_t> results(threadCount);
+    auto begin = Clock::now();
+    for (uint32_t i = 0; i < threadCount; ++i)
+    {
+      workers.emplace_back([&results, i]() {
+        uint64_t x = i + 1;
+        for (uint64_t j = 0; j < kIterations / 8; ++j)
+        {
+          x ^= x << 13;
+          x ^= x >> 7;
+          x ^= x << 17;
+        }
+        results[i] = x;
+      });
+    }
+    for (auto& worker : workers)
+    {
+      worker.join();
+    }
+    return ToMicroSeconds(Clock::now() - begin) * 1.0e-3;
+  }
+
+  // CPU 負荷の高い処理を repeatCount 回行い、最短の所要時間 (ms) を返す.
+  //  最小値を採用し、他の要因による揺らぎを除く.
+  double MeasureCPUBoundWorkload(uint32_t repeatCount)
+  {
+    double best = 1.0e30;
+    for (uint32_t i = 0; i < repeatCount; ++i)
+    {
+      best = (std::min)(best, RunCPUBoundWorkload());
+    }
+    return best;
+  }
+
+  // ワーカースレッドが CPU 負荷の高い処理を妨げる度合い.
+  //  採取なし・ありで同じ処理を続けて行い、所要時間の増加率を求める.
+  //  直前に計測した値と比べるため、温度による性能の変化や、スロットリングの監視の負荷は打ち消される.
+  void BenchmarkDisturbance(uint32_t intervalMilliSeconds, uint32_t repeatCount)
+  {
+    auto baseline = MeasureCPUBoundWorkload(repeatCount);
+
+    tiny_perf_counter::InitParams initParams{};
+    initParams.checkIntervalMilliSeconds = intervalMilliSeconds;
+    tiny_perf_counter::Collector collector;
+    collector.Initialize(initParams);
+    auto withCollector = MeasureCPUBoundWorkload(repeatCount);
+    collector.Shutdown();
+
+    printf("{\"benchmark\":\"disturbance\",\"intervalMilliSeconds\":%u,\"baselineMilliSeconds\":%.2f,\"withCollectorMilliSeconds\":%.2f,\"slowdownPercent\":%.3f}\n",
+      intervalMilliSeconds, baseline, withCollector, (withCollector / baseline - 1.0) * 100.0);
+  }
+
+  // ベンチマーク全体を通した CPU のスロットリングの有無.
+  //  スロットリングが起きていた場合、その回の結果は電力・温度の影響を受けているため比較に使わないこと.
+  void ReportThrottle(tiny_perf_counter::Collector& monitor, uint32_t elapsedMilliSeconds)
+  {
+    tiny_perf_counter::MetricStatistics throttled{}, limit{};
+    if (!monitor.GetMetricStatistics({ tiny_perf_counter::Metric::CPUThrottled }, elapsedMilliSeconds, throttled) ||
+      !monitor.GetMetricStatistics({ tiny_perf_counter::Metric::CPUPerformanceLimit }, elapsedMilliSeconds, limit))
+    {
+      printf("{\"benchmark\":\"throttle\",\"error\":\"not collected\"}\n");
+      return;
+    }
+    auto throttle = monitor.GetCPUThrottle();
+    printf("{\"benchmark\":\"throttle\",\"samples\":%u,\"throttled\":%s,\"throttledRatio\":%.3f,\"minPerformanceLimitPercent\":%.1f,"
+      "\"lastPerformancePercent\":%.1f,\"lastEffectiveFrequencyMHz\":%.0f}\n",
+      throttled.sampleCount, throttled.max > 0.0 ? "true" : "false", throttled.mean, limit.min,
+      throttle.performancePercent, throttle.effectiveFrequencyMHz);
+  }
+}
+
+int main(int argc, char** argv)
+{
+  uint32_t durationMilliSeconds = 3000;
+  if (argc > 1)
+  {
+    durationMilliSeconds = uint32_t((std::max)(1, atoi(argv[1])));
+  }
+
+  // スロットリングの監視. 計測への影響を抑えるため、性能・周波数のみを長い間隔で採取する.
+  tiny_perf_counter::Collector monitor;
+  {
+    tiny_perf_counter::InitParams initParams{};
+    initParams.subsystems = tiny_perf_counter::SubsystemCPUFrequency;
+    initParams.checkIntervalMilliSeconds = 500;
+    initParams.historyCapacity = tiny_perf_counter::kMaxHistoryCapacity;
+    initParams.workerEcoQoS = true;
+    monitor.Initialize(initParams);
+  }
+  auto benchmarkBegin = Clock::now();
+
+  // 取得関数.
+  {
+    tiny_perf_counter::InitParams initParams{};
+    tiny_perf_counter::Collector collector;
+    collector.Initialize(initParams);
+    collector.SampleNow(1000);
+    for (uint32_t readerCount : { 1u, 8u, 64u })
+    {
+      BenchmarkGetters(collector, readerCount, durationMilliSeconds);
+    }
+  }
+
+  // 採取1回あたりの負荷. 採取間隔と GPU 関連の項目の有無を変える.
+  for (uint32_t interval : { 10u, 100u, 1000u })
+  {
+    tiny_perf_counter::InitParams initParams{};
+    initParams.checkIntervalMilliSeconds = interval;
+    BenchmarkTick("default", initParams, (std::max)(durationMilliSeconds, interval * 4));
+
+    initParams.subsystems = tiny_perf_counter::SubsystemDefault & ~(tiny_perf_counter::SubsystemGPUEngine | tiny_perf_counter::SubsystemGPUMemory);
+    BenchmarkTick("cpu-only", initParams, (std::max)(durationMilliSeconds, interval * 4));
+  }
+
+  BenchmarkLifetime(10);
+
+  for (uint32_t interval : { 10u, 100u })
+  {
+    BenchmarkDisturbance(interval, 5);
+  }
+
+  ReportThrottle(monitor, uint32_t(ToMicroSeconds(Clock::now() - benchmarkBegin) * 1.0e-3) + 1000);
+  return 0;
+}
@@ -0,0 +1,147 @@
+﻿#define TINY_PERFORMANCE_COUNTER_IMPLEMENTATION
+#include "tiny_performance_counter.h"
+
+#include <thread>
+#include <chrono>
+#include <cstdio>
+#include <cmath>
+#include <cstdlib>
+#include <filesystem>
+#include <vector>
+
+// 採取器の動作の確認.
+//  確認ごとに1行の結果を出力し、1つでも失敗した場合は 1 を返す.
+//  この環境で対象の機能を使用できない確認は SKIP とし、失敗に数えない.
+//  使い方: TinyPerformanceCounterTest.exe
+namespace
+{
+  uint32_t gFailureCount = 0;
+
+  void Report(const char* name, bool passed, const char* detail)
+  {
+    printf("[%s] %s: %s\n", passed ? "PASS" : "FAIL", name, detail);
+    if (!passed)
+    {
+      gFailureCount++;
+    }
+  }
+  void Skip(const char* name, const char* detail)
+  {
+    printf("[SKIP] %s: %s\n", name, detail);
+  }
+
+  // 採取対象の項目を持たないコレクタに AddCounter で登録すると、そのグループの採取が始まり値を取得できるか.
+  void TestCustomCounterOnIdleCollector(const char* name, tiny_perf_counter::CollectionMode collectionMode)
+  {
+    tiny_perf_counter::InitParams initParams{};
+    initParams.subsystems = 0;
+    initParams.collectionMode = collectionMode;
+    tiny_perf_counter::Collector collector;
+    char detail[256];
+    if (!collector.Initialize(initParams))
+    {
+      snprintf(detail, sizeof(detail), "mode=%s initialize failed", name);
+      Report("CustomCounterOnIdleCollector", false, detail);
+      return;
+    }
+    auto handle = collector.AddCounter(LR"(\Processor(_Total)\% Processor Time)", tiny_perf_counter::CounterFormatDefault, L"_Total");
+    if (!handle.IsValid())
+    {
+      snprintf(detail, sizeof(detail), "mode=%s AddCounter is not supported", name);
+      Skip("CustomCounterOnIdleCollector", detail);
+      return;
+    }
+    // 率のカウンタは2回目の採取から値を持つ.
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(3000);
+    bool collected = false;
+    while (!collected && std::chrono::steady_clock::now() < deadline)
+    {
+      if (collectionMode == tiny_perf_counter::CollectionMode::External)
+      {
+        collector.ProcessSampleEvent();
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      collected = !std::isnan(collector.GetCounterValue(handle));
+    }
+    snprintf(detail, sizeof(detail), "mode=%s collected=%s", name, collected ? "true" : "false");
+    Report("CustomCounterOnIdleCollector", collected, detail);
+  }
+
+  // 採取間隔 intervalSeconds の記録を書き込み、RecordingReader で時刻と値が復元できるか.
+  //  長時間の試験を想定した長い採取間隔でも、欠番にならずに読み取れることを確認する.
+  //  実際に長い間隔で採取すると時間がかかるため、記録器に時刻を直接与える.
+  void TestRecordingRoundTrip(uint32_t intervalSeconds)
+  {
+    constexpr uint32_t kRecordCount = 200;
+    const wchar_t* path = L"tiny_perf_counter_recording_test.bin";
+    tiny_perf_counter::impl::ChannelLayout layout;
+    layout.Initialize(1);
+    std::vector<double> values(layout.GetChannelCount());
+    auto frequency = tiny_perf_counter::impl::GetTimestampFrequency();
+    auto baseTimestamp = tiny_perf_counter::impl::GetTimestamp();
+    auto timestampOf = [&](uint32_t index) { return baseTimestamp + int64_t(index) * intervalSeconds * frequency; };
+    auto valueOf = [](uint32_t index, size_t channel) { return double(channel) + index * 0.5; };
+    char detail[256];
+    {
+      tiny_perf_counter::impl::MetricRecorder recorder;
+      if (!recorder.Open(path, layout, frequency, 64))
+      {
+        snprintf(detail, sizeof(detail), "intervalSeconds=%u open failed", intervalSeconds);
+        Report("RecordingRoundTrip", false, detail);
+        return;
+      }
+      for (uint32_t i = 0; i < kRecordCount; ++i)
+      {
+        for (size_t j = 0; j < values.size(); ++j)
+        {
+          values[j] = valueOf(i, j);
+        }
+        recorder.Push(timestampOf(i), values.data());
+      }
+    }
+
+    // 時刻は µs 単位で丸めて記録されるため、1 µs 未満の誤差を許す.
+    uint32_t readCount = 0, mismatchCount = 0;
+    uint64_t recordCount = 0;
+    {
+      tiny_perf_counter::RecordingReader reader;
+      if (reader.Open(path))
+      {
+        recordCount = reader.GetRecordCount();
+        for (uint32_t i = 0; i < recordCount; ++i)
+        {
+          int64_t timestamp = 0;
+          if (!reader.ReadRecord(i, timestamp, values))
+          {
+            continue;
+          }
+          readCount++;
+          bool matched = std::abs(timestamp - timestampOf(i)) <= frequency / 1000000 + 1 && reader.FindRecord(timestampOf(i)) == i;
+          for (size_t j = 0; j < values.size() && matched; ++j)
+          {
+            matched = std::abs(values[j] - valueOf(i, j)) <= 1.0e-3;
+          }
+          mismatchCount += matched ? 0 : 1;
+        }
+      }
+    }
+    std::error_code error;
+    std::filesystem::remove(std::filesystem::path(path), error);
+    snprintf(detail, sizeof(detail), "intervalSeconds=%u written=%u records=%llu readable=%u mismatches=%u",
+      intervalSeconds, kRecordCount, (unsigned long long)recordCount, readCount, mismatchCount);
+    Report("RecordingRoundTrip", recordCount == kRecordCount && readCount == kRecordCount && mismatchCount == 0, detail);
+  }
+}
+
+int main()
+{
+  for (uint32_t interval : { 1u, 10u, 600u })
+  {
+    TestRecordingRoundTrip(interval);
+  }
+  TestCustomCounterOnIdleCollector("worker", tiny_perf_counter::CollectionMode::WorkerThread);
+  TestCustomCounterOnIdleCollector("external", tiny_perf_counter::CollectionMode::External);
+
+  printf("%u failure(s)\n", gFailureCount);
+  return gFailureCount == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
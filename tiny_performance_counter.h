@@ -27,563 +27,9021 @@
 #include <cstdint>
 #include <vector>
 #include <string>
+#include <span>
+#include <limits>
+#include <functional>
+#include <memory>
+#include <coroutine>
 
 namespace tiny_perf_counter
 {
-  struct InitParams
+  // スナップショットに格納できる最大数.
+  constexpr uint32_t kMaxCPUCores = 512;
+  constexpr uint32_t kMaxCPUNumaNodes = 64;
+  constexpr uint32_t kMaxCPUPackages = 16;
+  constexpr uint32_t kMaxGPUEngines = 32;
+  constexpr uint32_t kMaxGPUEngineNameLength = 32;
+  constexpr uint32_t kMaxGPUAdapters = 8;
+  constexpr uint32_t kMaxGPUAdapterNameLength = 128;
+  constexpr uint32_t kMaxGPUEngineInstances = 64;
+  constexpr uint32_t kMaxThreads = 128;
+  constexpr uint32_t kMaxProcesses = 32;
+  constexpr uint32_t kMaxThreadNameLength = 32;
+  constexpr uint32_t kMaxHistoryCapacity = 4096;
+  constexpr uint32_t kMaxDisks = 16;
+  constexpr uint32_t kMaxNetworkInterfaces = 16;
+  constexpr uint32_t kMaxIOInstanceNameLength = 128;
+  constexpr uint32_t kMaxFilteredMetrics = 256;
+  constexpr uint32_t kMaxMedianWindow = 31;
+  constexpr uint32_t kMaxCustomCounters = 16;
+  constexpr uint32_t kMaxCustomCounterInstances = 64;
+  constexpr uint32_t kMaxWorkerCpuSets = 64;
+
+  // 採取対象外 (InitParams::subsystems で無効) の値.
+  constexpr double kNotCollected = std::numeric_limits<double>::quiet_NaN();
+  constexpr uint64_t kNotCollectedBytes = 0xFFFFFFFFFFFFFFFFull;
+
+  // 無効な GPU エンジン ID.
+  constexpr uint32_t kInvalidGPUEngineId = 0xFFFFFFFFu;
+  // 無効な GPU アダプタのインデックス.
+  constexpr uint32_t kInvalidGPUAdapterIndex = 0xFFFFFFFFu;
+
+  // 論理プロセッサの構成情報.
+  //  CPU コアごとの使用率の配列と同じ順序 (プロセッサグループ順) で並ぶ.
+  struct LogicalProcessorInfo
   {
-    // パフォーマンスカウンタ情報の読み取り頻度. (単位はms)
-    uint32_t checkIntervalMilliSeconds = 100;
+    uint16_t group;           // プロセッサグループ.
+    uint8_t number;           // グループ内の番号.
+    uint8_t efficiencyClass;  // 大きいほど高性能なコア.
+    uint32_t coreId;          // 物理コアの番号. 同じ値のものは SMT の兄弟となる.
+    uint32_t numaNode;        // NUMA ノード番号.
+    uint32_t package;         // ソケット (パッケージ) の番号.
+  };
 
-    // CPU使用率情報について、プロセス単位がグローバル単位かを選択.
-    // true :システム全体の使用率となり、タスクマネージャーの値と合致.
-    bool useGlobalCPUUtilization = true;      
+  // 論理プロセッサごとの性能・周波数 ("\Processor Information(*)").
+  struct CPUFrequencySample
+  {
+    // 定格に対する実効性能 (% Processor Performance). ターボ時は 100% を超える.
+    double performancePercent;
+    // 定格周波数 (Processor Frequency, MHz).
+    double nominalFrequencyMHz;
+    // 実効周波数 (nominalFrequencyMHz * performancePercent / 100).
+    double effectiveFrequencyMHz;
+    // 電力・温度などによる性能の上限 (% Performance Limit). 100% 未満の場合は制限されている.
+    double performanceLimitPercent;
+    // 制限の要因 (Performance Limit Flags) のビットの組み合わせ.
+    uint32_t performanceLimitFlags;
   };
-  // 初期化処理.
-  bool Initialize(const InitParams& initParams);
 
-  // 終了処理.
-  void Shutdown();
+  // ソケット・システム全体の CPU 性能の集計と、スロットリングの有無.
+  struct CPUThrottleSample
+  {
+    double performancePercent;        // 論理プロセッサの平均.
+    double effectiveFrequencyMHz;     // 論理プロセッサの平均.
+    double performanceLimitPercent;   // 論理プロセッサの最小値.
+    uint32_t performanceLimitFlags;   // 論理プロセッサの論理和.
+    // 性能の上限が 100% 未満の論理プロセッサがある.
+    //  システム全体の場合は、温度ゾーンによる制限 (cpuThermal*) も含む.
+    bool throttled;
+  };
 
-  uint64_t GetUsedGPUDedicatedMemory();
-  uint64_t GetUsedGPUSharedMemory();
+  // スレッドごとの CPU 使用率.
+  //  utilization は論理プロセッサ1つを使い切った場合に 100% となる.
+  struct ThreadSample
+  {
+    uint32_t threadId;
+    wchar_t name[kMaxThreadNameLength];
+    double utilization;
+    double cyclesPerSecond;
+  };
 
-  // GPU の使用率を取得 (3D).
-  double GetGPUEngineUtilization();
+  struct GPUEngineSample
+  {
+    wchar_t name[kMaxGPUEngineNameLength];
+    double utilization;
+  };
 
-  // GPU の使用率を取得 (エンジンごとの情報取得が可能).
-  //  例: 3D, Copy, VideoEncode, VideoDecode, ... など.
-  double GetGPUEngineUtilization(const wchar_t* engineName);
+  // プロセスの I/O (GetProcessIoCounters の差分). 1秒あたりの値.
+  //  ファイルだけでなく、ソケットなどデバイスへの I/O も含む.
+  struct ProcessIOSample
+  {
+    double readBytesPerSecond;
+    double writeBytesPerSecond;
+    double readOperationsPerSecond;
+    double writeOperationsPerSecond;
+  };
 
-  // 使用可能な GPU エンジンの名前リストを取得.
-  std::vector<std::wstring> GetGPUEngineNames();
+  // 物理ディスク ("\PhysicalDisk(*)") ごとの値. インスタンス名は "0 C:" など.
+  struct DiskSample
+  {
+    wchar_t name[kMaxIOInstanceNameLength];
+    double readBytesPerSecond;
+    double writeBytesPerSecond;
+    double readsPerSecond;
+    double writesPerSecond;
+    // 採取時点で処理待ちの要求数 (Current Disk Queue Length).
+    double queueLength;
+  };
 
-  // CPU の使用率を取得.
-  //  - useGlobalCPUUtilization = true の場合、システム全体での使用率.
-  //  - useGlobalCPUUtilization = false の場合、プロセス単体での使用率.
-  double GetCPUUtilization();
+  // ネットワークインターフェース ("\Network Interface(*)") ごとの値.
+  struct NetworkInterfaceSample
+  {
+    wchar_t name[kMaxIOInstanceNameLength];
+    double receivedBytesPerSecond;
+    double sentBytesPerSecond;
+  };
 
-  // CPU コアごとの使用率を取得.
-  //  - システム全体での使用率である点に注意.
-  std::vector<double> GetCPUCoresUtilization();
+  // 監視対象のプロセスごとの値.
+  struct ProcessSample
+  {
+    uint32_t processId;
+    // 全論理プロセッサに対する使用率と、消費した CPU サイクル数 (1秒あたり).
+    double cpuUtilization;
+    double cpuCyclesPerSecond;
+    uint64_t gpuDedicatedMemory;
+    uint64_t gpuSharedMemory;
+    // GPU エンジン ID をインデックスとした、全アダプタでの使用率.
+    double gpuEnginesUtilization[kMaxGPUEngines];
+    // ワーキングセット・プライベートバイト (コミット済みのプライベートメモリ) と、ページフォールト数 (1秒あたり).
+    //  プロセス単位ではソフト・ハードのページフォールトを区別できないため、合計値となる.
+    uint64_t workingSet;
+    uint64_t privateBytes;
+    double pageFaultsPerSecond;
+    // I/O. SubsystemProcessIO が有効な場合のみ.
+    ProcessIOSample io;
+  };
 
-  // CPU使用率ピーク情報をリセット.
-  void ResetPeakCPU();
+  // プロセス・システムのメモリ使用量とページング. SubsystemMemory が有効な場合のみ.
+  struct MemorySample
+  {
+    // 監視対象のプロセスの合計 (GetProcessMemoryInfo).
+    uint64_t processWorkingSet;
+    uint64_t processPrivateBytes;
+    double processPageFaultsPerSecond;
 
-  // CPU使用率ピーク情報を取得.
-  double GetPeakCPUUtilization();
+    // システム全体のコミットチャージとその上限、物理メモリの総量と空き (GetPerformanceInfo).
+    uint64_t systemCommitCharge;
+    uint64_t systemCommitLimit;
+    uint64_t systemPhysicalTotal;
+    uint64_t systemAvailableMemory;
+    // スタンバイキャッシュ (\Memory\Standby Cache * Bytes の合計). 空きメモリに含まれる.
+    uint64_t systemStandbyCache;
+    // ハードページフォールト (\Memory\Page Reads/sec) と、それ以外のページフォールト (1秒あたり).
+    double systemHardPageFaultsPerSecond;
+    double systemSoftPageFaultsPerSecond;
+    // ハードページフォールトの解決で読み書きしたページ数 (\Memory\Pages/sec).
+    double systemPagesPerSecond;
+  };
 
-}
+  // GPU メモリのセグメントごとの予算と使用量 (IDXGIAdapter3::QueryVideoMemoryInfo).
+  //  GPUMemoryBackend::DXGI の場合のみ. それ以外では全て kNotCollectedBytes となる.
+  //  Linux では NVML のアダプタのみ、ローカルメモリの容量 (budget)・使用量・空き容量 (availableForReservation) を格納する.
+  struct GPUMemoryBudget
+  {
+    uint64_t budget;                    // OS が割り当てた予算. これを超えるとリソースが退避される.
+    uint64_t currentUsage;              // 自プロセスの使用量.
+    uint64_t availableForReservation;   // 予約可能な量.
+    uint64_t currentReservation;        // 自プロセスが予約している量.
+  };
 
-#if defined(TINY_PERFORMANCE_COUNTER_IMPLEMENTATION)
-#ifndef WIN32_LEAN_AND_MEAN
-# define WIN32_LEAN_AND_MEAN
-#endif 
-#include <windows.h>
-#include <pdh.h>
-#include <pdhmsg.h>
-#include <psapi.h>
+  // GPU アダプタ (LUID) ごとの値.
+  struct GPUAdapterSample
+  {
+    uint64_t luid;
+    // DXGI のアダプタ名. DXGI で見つからなかったアダプタは空文字列.
+    wchar_t name[kMaxGPUAdapterNameLength];
+    uint64_t dedicatedMemory;
+    uint64_t sharedMemory;
+    // ローカル (VRAM) と非ローカル (システムメモリ) の予算.
+    GPUMemoryBudget localMemory;
+    GPUMemoryBudget nonLocalMemory;
+    // いずれかのセグメントで使用量が予算を超えている.
+    bool overBudget;
+    // GPU エンジン ID をインデックスとした、このアダプタ内での使用率.
+    //  同じ種類のエンジンが複数ある場合 (Copy, Compute など) は合計値となる.
+    double enginesUtilization[kMaxGPUEngines];
+  };
 
-#include <unordered_map>
-#include <sstream>
-#include <memory>
-#include <thread>
-#include <mutex>
-#include <format>
-#include <chrono>
+  // GPU エンジンのインスタンス ("eng_N") ごとの使用率.
+  struct GPUEngineInstanceSample
+  {
+    uint32_t adapterIndex;    // Snapshot::gpuAdapters のインデックス.
+    uint32_t physIndex;       // リンクされたアダプタ内の物理 GPU 番号.
+    uint32_t engineIndex;     // "eng_N" の N.
+    uint32_t engineId;        // GPU エンジン ID (エンジンの種類).
+    double utilization;
+  };
 
-#pragma comment(lib, "pdh.lib")
+  // GPU メモリ使用量の採取方法.
+  enum class GPUMemoryBackend
+  {
+    // IDXGIAdapter3::QueryVideoMemoryInfo でアダプタごとに取得する.
+    //  自プロセスの値のみを直接取得でき、予算の情報も得られる.
+    //  IDXGIAdapter3 が使用できない場合は PDH となる.
+    DXGI,
+    // "\GPU Process Memory(*)" カウンタを使用する.
+    //  Linux では常にこちらとなり、DRM fdinfo・NVML のプロセスごとの使用量を集計する.
+    PDH,
+  };
 
-namespace tiny_perf_counter
-{
-  namespace impl
+  // 採取を駆動する方法.
+  enum class CollectionMode
   {
-    using namespace std::chrono_literals;
+    // ライブラリが作成するワーカースレッドで定期的に採取する.
+    WorkerThread,
+    // ワーカースレッドを作成しない. GetSampleEvent() のハンドル (周期的な待機可能タイマー) が
+    //  シグナル状態になったら、利用側のスレッドで ProcessSampleEvent() を呼び出す.
+    External,
+  };
 
-    class SimplePerfCounter
-    {
-    public:
-      SimplePerfCounter() = default;
-      ~SimplePerfCounter()
-      {
-        if (m_workerThread.joinable())
-        {
-          // スレッド側の終了処理をトリガー.
-          std::unique_lock lock(m_mutex);
-          m_exit = true;
-          lock.unlock();
+  // 採取間隔を個別に設定できる、カウンタのグループ.
+  enum class CounterGroup : uint32_t
+  {
+    CPU,          // SubsystemCPUGlobal / SubsystemCPUProcess / SubsystemCPUCores
+    GPUEngine,    // SubsystemGPUEngine
+    GPUMemory,    // SubsystemGPUMemory
+    CPUThreads,   // SubsystemCPUThreads
+    Memory,       // SubsystemMemory
+    IO,           // SubsystemProcessIO / SubsystemDisk / SubsystemNetwork
+    Count,
+  };
+  constexpr uint32_t kCounterGroupCount = uint32_t(CounterGroup::Count);
 
-          m_condVar.notify_all();
-          m_workerThread.join();
-        }
-        if (m_pdhQuery)
-        {
-          PdhCloseQuery(m_pdhQuery);
-          m_pdhQuery = { };
-        }
-        if (m_pdhProcessCounterPathQuery)
-        {
-          PdhCloseQuery(m_pdhProcessCounterPathQuery);
-          m_pdhProcessCounterPathQuery = {};
-        }
-      }
+  // 履歴の参照などで値を指定するための、指標の種類.
+  enum class Metric : uint32_t
+  {
+    CPUUtilization,         // GetCPUUtilization() と同じ値.
+    CPUGlobalUtilization,
+    CPUProcessUtilization,
+    CPUCoreUtilization,     // index は論理プロセッサの番号.
+    CPUCorePerformance,     // index は論理プロセッサの番号. 定格に対する実効性能 (%).
+    CPUCoreFrequency,       // index は論理プロセッサの番号. 実効周波数 (MHz).
+    CPUPerformanceLimit,    // 論理プロセッサの性能の上限の最小値 (%).
+    CPUThermalPassiveLimit, // 温度ゾーンによる制限の最小値 (%).
+    CPUThrottled,           // スロットリング中は 1.
+    GPUEngineUtilization,   // index は GPU エンジン ID.
+    GPUDedicatedMemory,
+    GPUSharedMemory,
+    GPULocalMemoryBudgetUtilization,  // index は GPU アダプタのインデックス. ローカルメモリの予算に対する使用量 (%).
+    ProcessWorkingSet,
+    ProcessPrivateBytes,
+    ProcessPageFaults,        // 1秒あたり.
+    SystemCommitCharge,
+    SystemAvailableMemory,
+    SystemStandbyCache,
+    SystemHardPageFaults,     // 1秒あたり.
+    SystemSoftPageFaults,     // 1秒あたり.
+    SystemPages,              // 1秒あたり.
+    ProcessIOReadBytes,       // 1秒あたり.
+    ProcessIOWriteBytes,      // 1秒あたり.
+    ProcessIOReadOperations,  // 1秒あたり.
+    ProcessIOWriteOperations, // 1秒あたり.
+    DiskReadBytes,            // index は Snapshot::disks のインデックス. 1秒あたり.
+    DiskWriteBytes,           // index は Snapshot::disks のインデックス. 1秒あたり.
+    DiskQueueLength,          // index は Snapshot::disks のインデックス.
+    NetworkReceivedBytes,     // index は Snapshot::networkInterfaces のインデックス. 1秒あたり.
+    NetworkSentBytes,         // index は Snapshot::networkInterfaces のインデックス. 1秒あたり.
+    Count,
+  };
 
-      bool Initialize(const InitParams& initParams)
-      {
-        m_useCpuUtilizationGlobal = initParams.useGlobalCPUUtilization;
-        m_intervalPeriod = std::chrono::milliseconds(initParams.checkIntervalMilliSeconds);
+  struct MetricId
+  {
+    Metric metric;
+    uint32_t index = 0;
+  };
 
-        m_pid = GetCurrentProcessId();
-        m_selfPidString = std::format(L"pid_{}", m_pid);
+  // AddCounter で登録したカウンタの値.
+  //  values の並びはインスタンスが最初に現れた順で、Shutdown まで変わらない (GetCounterInstanceName で名前を取得できる).
+  //  消えたインスタンスの値は 0 のまま残る.
+  struct CustomCounterSample
+  {
+    uint32_t instanceCount;
+    double values[kMaxCustomCounterInstances];
+  };
 
-        auto status = PdhOpenQueryW(NULL, 0, &m_pdhQuery);
-        if (status != ERROR_SUCCESS)
-        {
-          return false;
-        }
-        status = PdhOpenQueryW(NULL, 0, &m_pdhProcessCounterPathQuery);
-        if (status != ERROR_SUCCESS)
-        {
-          return false;
-        }
+  // 平滑化フィルタを適用した指標の値.
+  struct FilteredMetricSample
+  {
+    MetricId id;
+    double raw;       // フィルタ適用前の値.
+    double filtered;  // フィルタ適用後の値. Snapshot の該当する項目にも格納される.
+  };
 
-        SetupCounterGpuUsage();
-        SetupCounterGpuDedicatedMemory();
-        SetupCounterCpuUsage();
+  // 収集処理自体の負荷の計測値. 時間の単位は µs.
+  //  "直近" の値は、そのグループ・処理が最後に実行された回のもの.
+  struct CollectorStats
+  {
+    // 公開した採取の回数と、採取処理の累計時間.
+    uint64_t sampleCount;
+    double totalSampleMicroSeconds;
+    // 直近の採取処理 (PdhCollectQueryData から公開直前まで) の時間.
+    double sampleMicroSeconds;
+    // 直近の公開後の処理 (公開・履歴・記録・トリガー判定) の時間. 前回の採取のものとなる.
+    double postSampleMicroSeconds;
+    // グループ (CounterGroup) ごとの、直近の PdhCollectQueryData と値の集計 (Collect*) の時間.
+    double pdhCollectMicroSeconds[kCounterGroupCount];
+    double collectMicroSeconds[kCounterGroupCount];
+    // 直近の監視対象プロセスの構成の更新の時間.
+    double processRefreshMicroSeconds;
+    // ProcessCPUBackend::PDH の場合の、直近のプロセスのカウンタパスの検索の時間と、パスを再登録した回数.
+    double processPathLookupMicroSeconds;
+    uint64_t processPathResolveCount;
+    // 直近の採取でカウンタ配列から走査したインスタンス数と、集計対象としたインスタンス数.
+    uint32_t instancesScanned;
+    uint32_t instancesKept;
+    // インスタンス名キャッシュを再構築した回数.
+    uint64_t instanceCacheRebuildCount;
+    // カウンタ配列の作業バッファを拡張した回数と、現在の大きさ (byte).
+    uint64_t workBufferResizeCount;
+    uint64_t workBufferBytes;
+    // 取得関数 (GetSnapshot を含む) の呼び出し回数と、採取の公開と重なって読み直した回数.
+    //  呼び出し回数は InitParams::countGetterCalls が true の場合のみ数え、それ以外は 0.
+    uint64_t getterCallCount;
+    uint64_t getterRetryCount;
+    // ワーカースレッドと SampleNow / WaitForNextSample の間で、ロックの取得を待った回数.
+    uint64_t lockContentionCount;
+    // 記録ファイル (InitParams::recordingFilePath) を拡張できず、書き込めなかったサンプル数.
+    //  ディスクの空きが足りない場合など. 記録は続け、次のサンプルで再び拡張を試みる.
+    uint64_t recordingDroppedCount;
+  };
 
-        SYSTEM_INFO sysInfo;
-        GetSystemInfo(&sysInfo);
-        m_logicalProcessorCount = sysInfo.dwNumberOfProcessors;
-        m_cpuCoresUsage.resize(sysInfo.dwNumberOfProcessors);
+  // ワーカースレッドが1回の採取で得た値一式.
+  //  全ての値は同じタイミングで採取されたものとなる.
+  struct Snapshot
+  {
+    // 採取ごとに増加する番号. 0 の場合はまだ採取されていない.
+    uint64_t sequence;
+    // 採取時刻 (QueryPerformanceCounter の値、Linux では CLOCK_MONOTONIC の ns) とその周波数.
+    int64_t timestamp;
+    int64_t timestampFrequency;
 
-        m_workBuffer.resize(4096);
-        m_exit = false;
-        m_workerThread = std::thread([this] { this->WorkerThread(); });
-        return true;
-      }
+    // 採取された項目 (SubsystemFlags の組み合わせ). 含まれない項目の値は kNotCollected となる.
+    uint32_t collectedSubsystems;
 
-      double GetGPUEngineUtilization(const std::wstring& engineName)
-      {
-        if (auto itr = m_gpuEngineUtilization.find(engineName); itr != m_gpuEngineUtilization.end())
-        {
-          return itr->second;
-        }
-        return 0.0;
-      }
-      void GetGPUEngineUtilization(std::vector<std::wstring>& nameList)
-      {
-        nameList.clear();
-        for (auto& itr : m_gpuEngineUtilization)
-        {
-          nameList.push_back(itr.first);
-        }
-      }
-      uint64_t GetUsedGPUDedicatedMemory()
-      {
-        std::unique_lock lock(m_mutex);
-        return m_gpuMemory.dedicated;
-      }
-      uint64_t GetUsedGPUSharedMemory()
-      {
-        std::unique_lock lock(m_mutex);
-        return m_gpuMemory.shared;
-      }
-      double GetCPUUtilization()
-      {
-        std::unique_lock lock(m_mutex);
-        if (m_useCpuUtilizationGlobal)
-        {
-          return m_cpuUsageGlobal;
-        }
-        return m_cpuUsage;
-      }
-      std::vector<double> GetCPUCoresUtilization()
-      {
-        std::unique_lock lock(m_mutex);
-        return m_cpuCoresUsage;
-      }
-      void ResetPeakCPU()
-      {
-        std::unique_lock lock(m_mutex);
-        m_cpuUsagePeak = 0.0f;
-      }
-      double GetPeakCPUUtilization()
-      {
-        std::unique_lock lock(m_mutex);
-        return m_cpuUsagePeak;
-      }
-    private:
-      std::thread m_workerThread;
-      std::wstring m_selfPidString;
-      std::atomic<bool> m_exit;
-      std::mutex m_mutex;
-      std::condition_variable m_condVar;
-      DWORD m_pid = 0xFFFFFFFFu;
-      DWORD m_logicalProcessorCount = 0;
+    // グループ (CounterGroup) ごとの最終採取時刻. 0 の場合はまだ採取されていない.
+    //  グループごとに採取間隔が異なる場合、timestamp より古い値を含むことがある.
+    int64_t groupTimestamps[kCounterGroupCount];
 
-      std::chrono::milliseconds m_intervalPeriod;
-      PDH_HQUERY m_pdhQuery;
-      PDH_HCOUNTER m_hGpuDedicateMem, m_hGpuSharedMem;
-      PDH_HCOUNTER m_hGpuUsage;
-      PDH_HCOUNTER m_hCpuUsage;
-      PDH_HCOUNTER m_hCpuUsageGlobal;
+    // GetCPUUtilization() と同じ値.
+    double cpuUtilization;
+    double cpuUtilizationGlobal;
+    double cpuUtilizationProcess;
+    double cpuPeakUtilization;
+    // プロセスが消費した CPU サイクル数 (1秒あたり). ProcessCPUBackend::ProcessTimes の場合のみ.
+    double cpuProcessCyclesPerSecond;
 
-      PDH_HQUERY m_pdhProcessCounterPathQuery;
-      std::vector<uint8_t> m_workBuffer;
+    // 論理プロセッサごとの使用率. 並びは GetCPUTopology() と同じ.
+    uint32_t cpuCoreCount;
+    double cpuCoresUtilization[kMaxCPUCores];
 
-      bool m_useCpuUtilizationGlobal = true;
+    // NUMA ノード・ソケットごとの平均使用率.
+    uint32_t cpuNumaNodeCount;
+    double cpuNumaNodesUtilization[kMaxCPUNumaNodes];
+    uint32_t cpuPackageCount;
+    double cpuPackagesUtilization[kMaxCPUPackages];
 
-      // ---- 以下メンバは、ロック取得して短時間で反映する変数群.
-      std::unordered_map<std::wstring, double> m_gpuEngineUtilization;
-      struct GPUMemory
-      {
-        uint64_t dedicated;
-        uint64_t shared;
-      } m_gpuMemory;
-      double m_cpuUsage = 0;
-      double m_cpuUsageGlobal = 0;
-      std::vector<double> m_cpuCoresUsage;
-      double m_cpuUsagePeak = 0;
-      // ------------------
-    private:
+    // 論理プロセッサ・ソケット・システム全体の性能・周波数とスロットリング. SubsystemCPUFrequency が有効な場合のみ.
+    //  並びと数は cpuCoresUtilization / cpuPackagesUtilization と同じ.
+    CPUFrequencySample cpuCoresFrequency[kMaxCPUCores];
+    CPUThrottleSample cpuPackagesThrottle[kMaxCPUPackages];
+    CPUThrottleSample cpuThrottle;
+    // 温度ゾーン ("\Thermal Zone Information(*)") による制限.
+    //  % Passive Limit の最小値 (温度ゾーンがない場合は 100) と、Throttle Reasons の論理和.
+    //  SubsystemCPUFrequency が無効な場合は、制限は kNotCollected、Throttle Reasons は 0 となる.
+    double cpuThermalPassiveLimitPercent;
+    uint32_t cpuThermalThrottleReasons;
 
-      void SetupCounterGpuDedicatedMemory()
-      {
-        auto status = PdhAddCounterW(m_pdhQuery, LR"(\GPU Process Memory(*)\Dedicated Usage)", 0, &m_hGpuDedicateMem);
-        if (status != ERROR_SUCCESS)
-        {
-          m_hGpuDedicateMem = {};
-        }
-        status = PdhAddCounterW(m_pdhQuery, LR"(\GPU Process Memory(*)\Shared Usage)", 0, &m_hGpuSharedMem);
-        if (status != ERROR_SUCCESS)
-        {
-          m_hGpuSharedMem = {};
-        }
-      }
-      void SetupCounterGpuUsage()
-      {
-        auto status = PdhAddCounterW(m_pdhQuery, LR"(\GPU Engine(*)\Utilization Percentage)", 0, &m_hGpuUsage);
-        if (status != ERROR_SUCCESS)
-        {
-          m_hGpuUsage = {};
-        }
-      }
-      void SetupCounterCpuUsage()
-      {
-        // Windows11 タスクマネージャーの値と合う値を得るには、"(\Processor Information(_Total)\% Processor Utility)" を使う.
-        //  こちらのカウンタは、クロック周波数が状況に応じて変化する CPU に対応したものとなっている.
-        //  100% を超える値が取得できることもあるが、タスクマネージャーでは100%にクリップしているそう.
-        auto status = PdhAddCounterW(m_pdhQuery, LR"(\Processor Information(*)\% Processor Utility)", 0, &m_hCpuUsageGlobal);
-        if (status != ERROR_SUCCESS)
-        {
-          m_hCpuUsageGlobal = { };
-        }
+    uint64_t gpuDedicatedMemory;
+    uint64_t gpuSharedMemory;
+    // 実際に使用されている GPU メモリの採取方法.
+    GPUMemoryBackend gpuMemoryBackend;
 
-        auto counterPath = GetPathMatched(GetProcessPathList());
-        if (counterPath.empty())
-        {
-          return;
-        }
-        status = PdhAddCounterW(m_pdhQuery, counterPath.c_str(), 0, &m_hCpuUsage);
-        if (status != ERROR_SUCCESS)
-        {
-          m_hCpuUsage = { };
-        }
-      }
+    // GPU エンジン ID をインデックスとした配列. 全アダプタの合計値.
+    uint32_t gpuEngineCount;
+    GPUEngineSample gpuEngines[kMaxGPUEngines];
 
-      std::unordered_map<std::wstring, double> CollectGPUUtilization()
-      {
-        std::unordered_map<std::wstring, double> gpuEngineUtilization;
-        DWORD bufferSize = 0;
-        DWORD itemCount = 0;
-        PdhGetFormattedCounterArrayW(m_hGpuUsage, PDH_FMT_DOUBLE, &bufferSize, &itemCount, nullptr);
+    // アダプタごとの値. 一度現れたアダプタのインデックスは Shutdown まで変わらない.
+    uint32_t gpuAdapterCount;
+    GPUAdapterSample gpuAdapters[kMaxGPUAdapters];
 
-        if (m_workBuffer.size() < bufferSize)
-        {
-          m_workBuffer.resize(bufferSize);
-        }
+    // エンジンのインスタンスごとの使用率. 並びは最初に現れた順で、Shutdown まで変わらない.
+    uint32_t gpuEngineInstanceCount;
+    GPUEngineInstanceSample gpuEngineInstances[kMaxGPUEngineInstances];
 
-        auto pdhItems = reinterpret_cast<PDH_FMT_COUNTERVALUE_ITEM*>(m_workBuffer.data());
-        auto pdhStatus = PdhGetFormattedCounterArrayW(m_hGpuUsage, PDH_FMT_DOUBLE, &bufferSize, &itemCount, pdhItems);
-        if (pdhStatus == ERROR_SUCCESS)
-        {
-          for (DWORD i = 0; i < itemCount; ++i)
-          {
-            auto name = std::wstring(pdhItems[i].szName);
-            // 目的のPIDをフィルタリング.
-            if (name.find(m_selfPidString) == name.npos)
-            {
-              continue;
-            }
+    // 監視対象のプロセスごとの値. プロセス単位の値 (cpuUtilizationProcess, GPU 関連) はこれらの合計となる.
+    //  子孫プロセスやジョブを監視する場合、構成はプロセスの増減に合わせて変化する.
+    uint32_t processCount;
+    ProcessSample processes[kMaxProcesses];
 
-            // エンジンタイプ部の抽出. "_engtype_" の後ろを取得
-            auto keywordEngType = std::wstring(L"_engtype_");
-            size_t pos = name.find(keywordEngType);
-            auto engineType = std::wstring(name.begin() + pos + keywordEngType.length(), name.end());
-            if (!engineType.empty())
-            {
-              gpuEngineUtilization[engineType] += pdhItems[i].FmtValue.doubleValue;
-            }
-          }
-        }
-        return std::move(gpuEngineUtilization);
-      }
+    // スレッドごとの CPU 使用率 (使用率の高い順). SubsystemCPUThreads が有効な場合のみ.
+    //  プロセスのスレッド数が kMaxThreads を超える場合は上位のみ格納される.
+    uint32_t processThreadCount;
+    uint32_t threadCount;
+    ThreadSample threads[kMaxThreads];
 
-      uint64_t CollectGPUMemoryDedicated()
-      {
-        DWORD bufferSize = 0;
-        DWORD itemCount = 0;
-        uint64_t dedicatedMemAmount = 0;
-        PdhGetFormattedCounterArrayW(m_hGpuDedicateMem, PDH_FMT_LARGE, &bufferSize, &itemCount, nullptr);
-        if (m_workBuffer.size() < bufferSize)
-        {
-          m_workBuffer.resize(bufferSize);
-        }
+    // プロセス・システムのメモリ使用量とページング.
+    MemorySample memory;
 
-        auto pdhItems = reinterpret_cast<PDH_FMT_COUNTERVALUE_ITEM*>(m_workBuffer.data());
-        auto pdhStatus = PdhGetFormattedCounterArrayW(m_hGpuDedicateMem, PDH_FMT_LARGE, &bufferSize, &itemCount, pdhItems);
-        if (pdhStatus == ERROR_SUCCESS)
-        {
-          for (DWORD i = 0; i < itemCount; ++i)
-          {
-            auto name = std::wstring(pdhItems[i].szName);
-            if (name.find(m_selfPidString) == name.npos)
-            {
-              continue;
-            }
+    // 監視対象のプロセスの I/O の合計. SubsystemProcessIO が有効な場合のみ.
+    ProcessIOSample processIO;
 
-            auto value = pdhItems[i].FmtValue.largeValue;
-            dedicatedMemAmount += value;
-          }
-        }
-        return dedicatedMemAmount;
-      }
-      uint64_t CollectGPUMemoryShared()
-      {
-        DWORD bufferSize = 0;
-        DWORD itemCount = 0;
-        uint64_t sharedMemAmount = 0;
-        PdhGetFormattedCounterArrayW(m_hGpuSharedMem, PDH_FMT_LARGE, &bufferSize, &itemCount, nullptr);
-        if (m_workBuffer.size() < bufferSize)
-        {
-          m_workBuffer.resize(bufferSize);
-        }
+    // 物理ディスク・ネットワークインターフェースごとの値 (_Total を除く). 並びは最初に現れた順で、Shutdown まで変わらない.
+    //  取り外されたものは値が 0 のまま残る. それぞれ SubsystemDisk / SubsystemNetwork が有効な場合のみ.
+    uint32_t diskCount;
+    DiskSample disks[kMaxDisks];
+    uint32_t networkInterfaceCount;
+    NetworkInterfaceSample networkInterfaces[kMaxNetworkInterfaces];
 
-        auto pdhItems = reinterpret_cast<PDH_FMT_COUNTERVALUE_ITEM*>(m_workBuffer.data());
-        auto pdhStatus = PdhGetFormattedCounterArrayW(m_hGpuSharedMem, PDH_FMT_LARGE, &bufferSize, &itemCount, pdhItems);
-        if (pdhStatus == ERROR_SUCCESS)
-        {
-          for (DWORD i = 0; i < itemCount; ++i)
-          {
-            auto name = std::wstring(pdhItems[i].szName);
-            if (name.find(m_selfPidString) == name.npos)
-            {
-              continue;
-            }
+    // AddCounter で登録したカウンタごとの値. インデックスは CounterHandle::index.
+    uint32_t customCounterCount;
+    CustomCounterSample customCounters[kMaxCustomCounters];
 
-            auto value = pdhItems[i].FmtValue.largeValue;
-            sharedMemAmount += value;
-          }
-        }
-        return sharedMemAmount;
-      }
+    // 平滑化フィルタ (InitParams::metricFilters) を適用したチャンネルごとの適用前後の値 (Raw 以外).
+    //  並びはチャンネル順で、Shutdown まで変わらない. 未採取のグループの値は前回のまま.
+    uint32_t filteredMetricCount;
+    FilteredMetricSample filteredMetrics[kMaxFilteredMetrics];
 
-      // PIDを元に検索するためのパスを作成.
-      std::vector<std::wstring> GetProcessPathList()
-      {
-        std::vector<std::wstring> counterPathList;
-        HANDLE hProcess = OpenProcess(PROCESS_QUERY_INFORMATION | PROCESS_VM_READ, FALSE, m_pid);
-        std::wstring targetProcessName;
-        targetProcessName.resize(MAX_PATH);
-        ::GetModuleBaseNameW(hProcess, NULL, targetProcessName.data(), DWORD(targetProcessName.size()));
-        targetProcessName = targetProcessName.substr(0, targetProcessName.find_last_of(L'.'));
-        {
-          auto queryString = std::format(L"\\Process({}*)\\ID Process", targetProcessName);
-          LONG value = 0;
-          DWORD pathListLength = 0;
-          PdhExpandWildCardPathW(NULL, queryString.c_str(), nullptr, &pathListLength, 0);
-          pathListLength += 1024; // 予備バッファ.
-          std::vector<wchar_t> wszPathListBuffer(pathListLength);
-          PdhExpandWildCardPathW(NULL, queryString.c_str(), wszPathListBuffer.data(), &pathListLength, 0);
+    // 収集処理自体の負荷.
+    CollectorStats collectorStats;
+  };
 
-          auto buffer = wszPathListBuffer.data();
-          size_t start = 0;
-          while (wszPathListBuffer[start] != L'\0')
-          {
-            size_t end = start;
-            while (wszPathListBuffer[end] != L'\0')
-            {
-              end++;
-            }
+  // プロセス単位の CPU 使用率の採取方法.
+  enum class ProcessCPUBackend
+  {
+    // GetProcessTimes / QueryProcessCycleTime の差分から計算する.
+    //  カウンタパスの解決が不要で、同名プロセスの増減の影響を受けない.
+    ProcessTimes,
+    // "\Process(*)\% Processor Time" カウンタを使用する.
+    PDH,
+  };
 
-            auto namePath = std::wstring(buffer + start, buffer + end);
-            if (auto pos = namePath.find(targetProcessName); pos != std::wstring::npos)
-            {
-              counterPathList.push_back(namePath);
-            }
-            start = end + 1;
-          }
-        }
-        CloseHandle(hProcess);
-        return counterPathList;
-      }
+  struct MetricSample
+  {
+    int64_t timestamp;    // QueryPerformanceCounter の値 (Linux では CLOCK_MONOTONIC の ns).
+    double value;
+  };
 
-      // パスのリストから設定したPIDと合うものを見つけ、プロセッサ時間を求めるカウンタパスを返す.
-      std::wstring GetPathMatched(const std::vector<std::wstring>& pathList)
-      {
-        std::wstring desiredInstancePath;
-        for (auto& counterPath : pathList)
-        {
-          PDH_HCOUNTER hCounter = 0;
+  // AddCounter で登録したカウンタのハンドル.
+  //  登録した Collector の Shutdown まで有効. 値の取得は配列の参照のみで、メモリ確保を行わない.
+  struct CounterHandle
+  {
+    static constexpr uint32_t kInvalidIndex = 0xFFFFFFFFu;
+    uint32_t index = kInvalidIndex;
 
-          auto status = PdhAddCounterW(m_pdhProcessCounterPathQuery, counterPath.c_str(), 0, &hCounter);
-          PdhCollectQueryData(m_pdhProcessCounterPathQuery);
+    constexpr bool IsValid() const
+    {
+      return index != kInvalidIndex;
+    }
+  };
 
-          PDH_FMT_COUNTERVALUE counterValue;
-          status = PdhGetFormattedCounterValue(hCounter, PDH_FMT_LONG, nullptr, &counterValue);
-          if (status == ERROR_SUCCESS)
-          {
-            auto PID = counterValue.longValue;
-            if (m_pid == PID)
-            {
-              desiredInstancePath = counterPath;
-            }
-          }
-          PdhRemoveCounter(hCounter);
-          if (!desiredInstancePath.empty())
-          {
-            break;
-          }
-        }
-        auto pos = desiredInstancePath.rfind(L"\\");
-        desiredInstancePath = desiredInstancePath.substr(0, pos) + L"\\% Processor Time";
-        return desiredInstancePath;
-      }
+  // AddCounter の値の形式 (組み合わせ可).
+  enum CounterFormatFlags : uint32_t
+  {
+    CounterFormatDefault = 0x0000,      // double. 百分率のカウンタは 100 でクリップされる.
+    CounterFormatNoCap100 = 0x0001,     // 百分率を 100 でクリップしない (PDH_FMT_NOCAP100).
+    CounterFormatNoScale = 0x0002,      // カウンタの既定の倍率を適用しない (PDH_FMT_NOSCALE).
+    CounterFormatMultiply1000 = 0x0004, // 値を 1000 倍する (PDH_FMT_1000).
+  };
 
-      double CollectCPUUsage()
+  // 指標の平滑化の方法.
+  enum class MetricFilterType
+  {
+    Raw,      // そのまま.
+    EMA,      // 指数移動平均.
+    Median,   // 直近 windowSize 回の中央値. 単発のスパイクを除く (HUD 向け).
+  };
+
+  // 指標ごとの平滑化フィルタの設定.
+  //  フィルタ適用後の値は Snapshot の該当する項目・取得関数・履歴・トリガーで使用され、
+  //  適用前の値は Snapshot::filteredMetrics で参照できる.
+  //  double の項目を持つ指標のみが対象. バイト数の指標・GPULocalMemoryBudgetUtilization・CPUThrottled には適用されない.
+  //  CPUUtilization は CPUGlobalUtilization / CPUProcessUtilization のフィルタ適用後の値となるため、指定できない.
+  struct MetricFilter
+  {
+    Metric metric;
+    MetricFilterType type = MetricFilterType::Raw;
+    // EMA の時定数 (ms). 採取間隔が不規則でも、経過時間 dt から重み 1 - exp(-dt / timeConstant) を求める.
+    //  0 の場合は採取ごとに sampleWeight の重みで更新する (値は 0 から始まる).
+    double timeConstantMilliSeconds = 0;
+    double sampleWeight = 0.5;
+    // Median の採取回数 (最大 kMaxMedianWindow).
+    uint32_t windowSize = 5;
+  };
+
+  // 指定期間内の値の統計.
+  struct MetricStatistics
+  {
+    uint32_t sampleCount;
+    double min;
+    double max;
+    double mean;
+    double p95;
+    double p99;
+  };
+
+  // 閾値トリガーの条件.
+  enum class TriggerCondition
+  {
+    Above,    // 値が閾値を超えている.
+    Below,    // 値が閾値を下回っている.
+  };
+
+  // 無効なトリガー ID.
+  constexpr uint32_t kInvalidTriggerId = 0;
+
+  // トリガーの発火・解除の通知.
+  struct TriggerEvent
+  {
+    uint32_t triggerId;
+    MetricId metric;
+    double value;
+    bool active;          // true: 発火, false: 解除.
+    int64_t timestamp;    // 判定に使用したスナップショットの採取時刻.
+  };
+
+  // 閾値トリガーの設定.
+  //  例: CPU 全体 > 95% が 500ms 続いた場合
+  //      { { Metric::CPUGlobalUtilization }, TriggerCondition::Above, 95.0, 500 }
+  struct TriggerDesc
+  {
+    MetricId metric;
+    TriggerCondition condition = TriggerCondition::Above;
+    double threshold = 0;
+    // 条件を満たし続けてから発火するまでの時間. (単位はms)
+    uint32_t durationMilliSeconds = 0;
+    // 発火後、閾値からこの幅だけ戻った場合に解除する.
+    double hysteresis = 0;
+    // 発火・解除時にワーカースレッドから呼び出される. 呼び出し中は次の採取が遅れるため、処理は短くすること.
+    std::function<void(const TriggerEvent&)> callback;
+    // 発火時に SetEvent、解除時に ResetEvent するイベントハンドル (マニュアルリセット). 省略可. Windows のみ.
+    void* event = nullptr;
+  };
+
+  // 採取する項目. InitParams::subsystems に組み合わせて指定する.
+  //  無効な項目のカウンタは登録されず、取得関数は kNotCollected / kNotCollectedBytes を返す.
+  enum SubsystemFlags : uint32_t
+  {
+    SubsystemCPUGlobal = 0x0001,    // システム全体の CPU 使用率.
+    SubsystemCPUProcess = 0x0002,   // プロセス単位の CPU 使用率.
+    SubsystemCPUCores = 0x0004,     // コア・NUMA ノード・ソケットごとの CPU 使用率.
+    SubsystemGPUEngine = 0x0008,    // GPU エンジンごとの使用率.
+    SubsystemGPUMemory = 0x0010,    // GPU メモリ (Dedicated/Shared) の使用量.
+    SubsystemCPUThreads = 0x0020,   // 自プロセスのスレッドごとの CPU 使用率.
+    SubsystemMemory = 0x0040,       // プロセス・システムのメモリ使用量とページング.
+    SubsystemProcessIO = 0x0080,    // プロセスの I/O.
+    SubsystemDisk = 0x0100,         // 物理ディスクごとの転送量・キューの長さ.
+    SubsystemNetwork = 0x0200,      // ネットワークインターフェースごとの転送量.
+    SubsystemCPUFrequency = 0x0400, // 論理プロセッサごとの性能・周波数と、電力・温度によるスロットリング.
+
+    // SubsystemMemory 以降は既定では採取しない. 必要な場合に追加すること.
+    SubsystemDefault = SubsystemCPUGlobal | SubsystemCPUProcess | SubsystemCPUCores | SubsystemGPUEngine | SubsystemGPUMemory,
+    SubsystemAll = 0xFFFFFFFFu,
+  };
+
+  struct InitParams
+  {
+    // パフォーマンスカウンタ情報の読み取り頻度. (単位はms)
+    uint32_t checkIntervalMilliSeconds = 100;
+
+    // グループごとの読み取り頻度 (単位はms). CounterGroup をインデックスとする.
+    //  0 の場合は checkIntervalMilliSeconds を使用する.
+    //  例: CPU は 10ms、GPU メモリは 1000ms など.
+    uint32_t groupIntervalMilliSeconds[kCounterGroupCount] = {};
+
+    // CPU使用率情報について、プロセス単位がグローバル単位かを選択.
+    // true :システム全体の使用率となり、タスクマネージャーの値と合致.
+    bool useGlobalCPUUtilization = true;      
+
+    // useGlobalCPUUtilization = false の場合の、プロセス単位の CPU 使用率の採取方法.
+    //  Linux では常に /proc/[pid]/stat の CPU 時間から求める.
+    ProcessCPUBackend processCPUBackend = ProcessCPUBackend::ProcessTimes;
+
+    // GPU メモリ使用量の採取方法.
+    GPUMemoryBackend gpuMemoryBackend = GPUMemoryBackend::DXGI;
+
+    // 監視対象のプロセス ID (最大 kMaxProcesses). 空の場合は自プロセスのみ.
+    //  自プロセス以外を含む場合、CPU は ProcessCPUBackend::ProcessTimes、GPU メモリは GPUMemoryBackend::PDH で採取する.
+    //  スレッドごとの CPU 使用率は、常に自プロセスのみが対象となる.
+    std::vector<uint32_t> processIds;
+
+    // processIds (空の場合は自プロセス) の子孫プロセスも監視対象とする.
+    //  子孫は1秒おきに探し直す. Linux では全プロセスの /proc/<pid>/stat を読むため、コストはシステムのプロセス数に比例する.
+    bool includeDescendantProcesses = false;
+
+    // ジョブオブジェクトのハンドル. 指定した場合、ジョブに属するプロセスも監視対象とする.
+    //  ハンドルは Shutdown まで有効にしておくこと. Linux では使用しない.
+    void* processJob = nullptr;
+
+    // 採取する項目 (SubsystemFlags の組み合わせ).
+    //  SubsystemCPUThreads はスレッドの列挙 (Windows では1秒おき) とスレッドごとの CPU 時間の取得を行うため、必要な場合のみ有効にする.
+    //  ProcessCPUBackend::PDH かつ useGlobalCPUUtilization = true の場合、SubsystemCPUProcess は採取しない.
+    uint32_t subsystems = SubsystemDefault;
+
+    // 指標ごとの平滑化フィルタ. 同じ指標を複数指定した場合は後のものを使用する. 指定のない指標は Raw となる.
+    //  既定はプロセス単位の CPU 使用率を、採取ごとに前回の値と平均する.
+    //  各指標の index (コアなど) ごとにフィルタの状態を持つ (合計で最大 kMaxFilteredMetrics).
+    std::vector<MetricFilter> metricFilters = { { Metric::CPUProcessUtilization, MetricFilterType::EMA, 0.0, 0.5 } };
+
+    // 指標ごとに保持する履歴のサンプル数 (最大 kMaxHistoryCapacity). 0 の場合は履歴を保持しない.
+    //  初期化時に全指標分の領域を確保し、採取中はメモリ確保を行わない.
+    uint32_t historyCapacity = 0;
+
+    // カウンタ値を PDH の生データ (PdhGetRawCounterArrayW) から自前で計算する.
+    //  集計対象のインスタンスのみ計算するため、インスタンス数が多い環境や短い採取間隔で負荷が下がる.
+    //  初回の採取では前回値がないため 0 となる. Linux では使用しない.
+    bool useRawCounters = false;
+
+    // 採取結果を公開する共有メモリの名前. 指定した場合、他のプロセスから SharedSnapshotReader で読み取れる.
+    //  例: L"Local\\MyToolPerfCounter". nullptr の場合は公開しない.
+    //  同じ名前で公開中のプロセス (自プロセスを含む) が実行中の場合、Initialize は失敗する.
+    const wchar_t* sharedMemoryName = nullptr;
+
+    // 全指標の値をバイナリ形式で記録するファイルのパス. nullptr の場合は記録しない.
+    //  ファイルはメモリマップで追記され、RecordingReader で読み取れる.
+    const wchar_t* recordingFilePath = nullptr;
+
+    // 記録でキーフレーム (全ての値をそのまま格納する) を置く間隔 (サンプル数).
+    //  それ以外のサンプルはキーフレームからの差分を float で格納する.
+    uint32_t recordingKeyframeInterval = 64;
+
+    // 取得関数の呼び出し回数を CollectorStats::getterCallCount に数える.
+    //  全スレッドが同じカウンタに書き込むため、多くのスレッドから頻繁に取得する場合はキャッシュラインの競合となる.
+    bool countGetterCalls = false;
+
+    // 採取を駆動する方法. CollectionMode::External の場合、以下のワーカースレッドの設定は使用しない.
+    CollectionMode collectionMode = CollectionMode::WorkerThread;
+
+    // ワーカースレッドを実行する CPU セット (GetSystemCpuSetInformation の Id、最大 kMaxWorkerCpuSets). 空の場合は指定しない.
+    //  CPU セットは優先的な割り当てであり、他に空きがない場合は OS が別のプロセッサで実行することがある.
+    //  Initialize 内で複製するため、領域は呼び出し中のみ有効であれば良い. Windows 10 より前と Linux では使用しない.
+    std::span<const uint32_t> workerCpuSetIds;
+
+    // ワーカースレッドのアフィニティマスク (workerProcessorGroup 内のプロセッサ). 0 の場合は指定しない.
+    //  Linux ではグループを 64 個ずつの論理プロセッサの区切りとして扱う.
+    //  リアルタイム処理のスレッドを固定しているコアから、確実に外す場合に使用する.
+    uint64_t workerAffinityMask = 0;
+    uint32_t workerProcessorGroup = 0;
+
+    // ワーカースレッドの優先度 (SetThreadPriority の値). 既定は THREAD_PRIORITY_NORMAL (0).
+    //  Linux ではスレッドの nice 値に換算する (1 あたり -5、-20 ～ 19 の範囲).
+    int workerThreadPriority = 0;
+
+    // ワーカースレッドを EcoQoS (実行速度の電力スロットリング) で実行する.
+    //  ハイブリッド CPU では高効率コアに割り当てられやすくなり、採取の時間は伸びることがある. Linux では使用しない.
+    bool workerEcoQoS = false;
+
+    // ワーカースレッドの説明 (SetThreadDescription). トレースやスレッドごとの CPU 使用率での名前となる.
+    //  nullptr の場合は設定しない.
+    const wchar_t* workerThreadName = L"tiny_perf_counter worker";
+  };
+
+  namespace impl
+  {
+    class SimplePerfCounter;
+  }
+
+  // 採取結果の公開を待つ側の情報. NextSample() の awaitable が使用する.
+  //  登録された待機はロックフリーのスタックで保持され、公開のたびにまとめて通知される.
+  struct SampleWaiter
+  {
+    SampleWaiter* next = nullptr;
+    // 公開後 (published = true) または終了時 (published = false) に呼び出される.
+    //  呼び出し後に waiter を参照することはないため、notify 内で破棄して良い.
+    void (*notify)(SampleWaiter* waiter) = nullptr;
+    bool published = false;
+  };
+
+  // パフォーマンスカウンタの採取器.
+  //  インスタンスごとに設定・ワーカースレッド・採取結果を持ち、互いに干渉しない.
+  //  例: 短い間隔で少数の項目を採取する HUD 用と、長い間隔で多くの項目を採取するテレメトリ用.
+  //  以下の自由関数は、既定のインスタンスに対する操作となる.
+  class Collector
+  {
+  public:
+    Collector();
+    ~Collector();
+    Collector(const Collector&) = delete;
+    Collector& operator=(const Collector&) = delete;
+    Collector(Collector&&) noexcept;
+    Collector& operator=(Collector&&) noexcept;
+
+    // 初期化処理. 初期化済みの場合は何もせず true を返す.
+    bool Initialize(const InitParams& initParams);
+
+    // 終了処理. デストラクタでも行われる.
+    void Shutdown();
+
+    // 初期化済みかを取得.
+    bool IsInitialized() const;
+
+    uint64_t GetUsedGPUDedicatedMemory();
+    uint64_t GetUsedGPUSharedMemory();
+
+    // GPU の使用率を取得 (3D).
+    double GetGPUEngineUtilization();
+
+    // GPU の使用率を取得 (エンジンごとの情報取得が可能).
+    //  例: 3D, Copy, VideoEncode, VideoDecode, ... など.
+    double GetGPUEngineUtilization(const wchar_t* engineName);
+
+    // 使用可能な GPU エンジンの名前リストを取得.
+    std::vector<std::wstring> GetGPUEngineNames();
+
+    // 使用可能な GPU エンジンの名前リストを取得 (メモリ確保なし).
+    //  names[i] にはエンジン ID i の名前が入る. ポインタは Shutdown まで有効.
+    //  戻り値は使用可能なエンジン数 (names のサイズを超えることもある).
+    uint32_t GetGPUEngineNames(std::span<const wchar_t*> names);
+
+    // GPU エンジン名から ID を取得. 見つからない場合は kInvalidGPUEngineId.
+    //  ID は一度割り当てられると Shutdown まで変わらない.
+    uint32_t FindGPUEngineId(const wchar_t* engineName);
+
+    // GPU エンジン ID を指定して使用率を取得.
+    double GetGPUEngineUtilizationById(uint32_t engineId);
+
+    // 全 GPU エンジンの使用率を ID 順に取得 (メモリ確保なし).
+    //  戻り値は使用可能なエンジン数.
+    uint32_t GetGPUEnginesUtilization(std::span<double> utilization);
+
+    // GPU アダプタごとの使用率・メモリ使用量を取得 (メモリ確保なし).
+    //  戻り値はアダプタ数.
+    uint32_t GetGPUAdapters(std::span<GPUAdapterSample> adapters);
+
+    // GPU エンジンのインスタンスごとの使用率を取得 (メモリ確保なし).
+    //  戻り値はインスタンス数.
+    uint32_t GetGPUEngineInstances(std::span<GPUEngineInstanceSample> instances);
+
+    // CPU の使用率を取得.
+    //  - useGlobalCPUUtilization = true の場合、システム全体での使用率.
+    //  - useGlobalCPUUtilization = false の場合、プロセス単体での使用率.
+    double GetCPUUtilization();
+
+    // CPU コアごとの使用率を取得.
+    //  - システム全体での使用率である点に注意.
+    std::vector<double> GetCPUCoresUtilization();
+
+    // CPU コアごとの使用率を取得 (メモリ確保なし).
+    //  戻り値はコア数 (coresUtilization のサイズを超えることもある).
+    uint32_t GetCPUCoresUtilization(std::span<double> coresUtilization);
+
+    // NUMA ノードごとの平均使用率を取得 (メモリ確保なし). 戻り値はノード数.
+    uint32_t GetCPUNumaNodesUtilization(std::span<double> nodesUtilization);
+
+    // ソケットごとの平均使用率を取得 (メモリ確保なし). 戻り値はソケット数.
+    uint32_t GetCPUPackagesUtilization(std::span<double> packagesUtilization);
+
+    // 論理プロセッサごとの性能・周波数を取得 (メモリ確保なし). SubsystemCPUFrequency が有効な場合のみ.
+    //  戻り値は論理プロセッサ数.
+    uint32_t GetCPUCoresFrequency(std::span<CPUFrequencySample> coresFrequency);
+
+    // システム全体の CPU 性能とスロットリングの有無を取得. SubsystemCPUFrequency が有効な場合のみ.
+    //  ベンチマーク中に throttled となった場合、その結果は電力・温度の影響を受けている.
+    CPUThrottleSample GetCPUThrottle();
+
+    // 平滑化フィルタを適用したチャンネルの適用前後の値を取得 (メモリ確保なし). 戻り値はチャンネル数.
+    //  HUD (適用後) と警告の判定 (適用前) で、同じ採取の値を参照できる.
+    uint32_t GetFilteredMetrics(std::span<FilteredMetricSample> metrics);
+
+    // 論理プロセッサの構成情報を取得. 戻り値は論理プロセッサ数.
+    // 64 を超える論理プロセッサを持つ環境では、複数のプロセッサグループにまたがる.
+    uint32_t GetCPUTopology(std::span<LogicalProcessorInfo> processors);
+
+    // 監視対象のプロセスごとの値を取得 (メモリ確保なし). 戻り値はプロセス数.
+    uint32_t GetProcesses(std::span<ProcessSample> processes);
+
+    // スレッドごとの CPU 使用率を使用率の高い順に取得 (メモリ確保なし).
+    //  SubsystemCPUThreads が有効な場合のみ. 戻り値は格納可能なスレッド数.
+    uint32_t GetThreadsUtilization(std::span<ThreadSample> threads);
+
+    // プロセス・システムのメモリ使用量とページングを取得.
+    //  SubsystemMemory (既定では無効) が無効な場合は、全て kNotCollected / kNotCollectedBytes となる.
+    MemorySample GetMemoryUsage();
+
+    // 物理ディスクごとの値を取得 (メモリ確保なし). SubsystemDisk が有効な場合のみ. 戻り値はディスク数.
+    uint32_t GetDisks(std::span<DiskSample> disks);
+
+    // ネットワークインターフェースごとの値を取得 (メモリ確保なし). SubsystemNetwork が有効な場合のみ.
+    //  戻り値はインターフェース数.
+    uint32_t GetNetworkInterfaces(std::span<NetworkInterfaceSample> interfaces);
+
+    // CPU使用率ピーク情報をリセット.
+    void ResetPeakCPU();
+
+    // CPU使用率ピーク情報を取得.
+    double GetPeakCPUUtilization();
+
+    // 指標の最新の値を取得.
+    double GetMetricValue(MetricId metric);
+
+    // 直近 windowMilliSeconds ミリ秒間の履歴から最小・最大・平均・パーセンタイルを求める.
+    //  historyCapacity = 0 の場合や、期間内にサンプルがない場合は false を返す.
+    bool GetMetricStatistics(MetricId metric, uint32_t windowMilliSeconds, MetricStatistics& statistics);
+
+    // 履歴から新しい順にサンプルを取得 (メモリ確保なし). 戻り値は格納したサンプル数.
+    uint32_t GetMetricHistory(MetricId metric, std::span<MetricSample> samples);
+
+    // 閾値トリガーを登録する. 条件は採取結果の公開ごとにワーカースレッドで判定される.
+    //  コールバックは採取中のスレッドで呼ばれるため、採取の完了を待つ SampleNow (timeoutMilliSeconds > 0)・
+    //  WaitForNextSample・AddCounter は待たずに失敗し、Shutdown は呼んではならない (自身の終了を待ち続ける).
+    //  戻り値はトリガー ID. 未初期化の場合は kInvalidTriggerId.
+    uint32_t AddTrigger(const TriggerDesc& desc);
+
+    // 閾値トリガーを解除する. 戻った後にコールバックが呼ばれることはない.
+    //  コールバック内 (自身を含む) からも呼び出せる. その場合は実行中の通知の完了を待たない.
+    bool RemoveTrigger(uint32_t triggerId);
+
+    // 任意の PDH カウンタを登録する. 例: LR"(\GPU Adapter Memory(*)\Dedicated Usage)". Linux では常に無効なハンドルを返す.
+    //  group のクエリに追加され、組み込みのカウンタと同じ採取でインスタンス名のキャッシュ・スナップショットの公開を行う.
+    //  group が採取対象の項目を持たない場合も、登録したカウンタのために採取するようになる.
+    //  instanceFilter はインスタンス名のパターン ('*' と '?'、大文字小文字を区別しない). nullptr の場合は _Total 以外の全て.
+    //  パスが不正な場合、登録数が kMaxCustomCounters を超える場合、採取中のスレッド (トリガーのコールバックなど) から
+    //  呼び出した場合や未初期化の場合は無効なハンドルを返す. 値は次の採取から取得できる.
+    CounterHandle AddCounter(const wchar_t* counterPath, uint32_t format = CounterFormatDefault,
+      const wchar_t* instanceFilter = nullptr, CounterGroup group = CounterGroup::CPU);
+
+    // 登録したカウンタのインスタンスの値を取得. instance は CustomCounterSample::values のインデックス.
+    //  無効なハンドルや、まだ現れていないインスタンスの場合は kNotCollected.
+    double GetCounterValue(CounterHandle handle, uint32_t instance = 0);
+
+    // 登録したカウンタの全インスタンスの値を取得 (メモリ確保なし). 戻り値はインスタンス数.
+    uint32_t GetCounterValues(CounterHandle handle, std::span<double> values);
+
+    // 登録したカウンタのインスタンス名を取得. 返した文字列は Shutdown まで有効. 範囲外の場合は nullptr.
+    const wchar_t* GetCounterInstanceName(CounterHandle handle, uint32_t instance);
+
+    // 次の採取周期を待たずに、すぐに採取を行うよう要求する.
+    //  timeoutMilliSeconds > 0 の場合は、要求後に開始した採取の結果が公開されるまで待つ.
+    //  タイムアウトした場合や未初期化の場合、採取中のスレッド (トリガーのコールバック内) から待とうとした場合は false を返す.
+    bool SampleNow(uint32_t timeoutMilliSeconds = 0);
+
+    // 次の採取結果が公開されるまで待つ. タイムアウトした場合や未初期化の場合、採取中のスレッドから呼んだ場合は false を返す.
+    bool WaitForNextSample(uint32_t timeoutMilliSeconds);
+
+    // CollectionMode::External の場合の、採取の時刻を知らせるハンドル (HANDLE).
+    //  最短のグループの採取間隔ごとにシグナル状態となる自動リセットのタイマーで、WaitForMultipleObjects などで待機できる.
+    //  Linux では timerfd のファイルディスクリプタ (int(intptr_t(handle))) で、poll などで読み取り可能になるまで待機できる.
+    //  閉じてはならない. それ以外のモードや未初期化の場合は nullptr.
+    void* GetSampleEvent();
+
+    // CollectionMode::External の場合に、期限を迎えたグループを呼び出し元のスレッドで採取する.
+    //  GetSampleEvent() のシグナル時に呼び出す. 採取結果を公開した場合は true.
+    //  このモードでは SampleNow() はハンドルをすぐにシグナル状態にする. 採取を行うスレッドで完了を待たないこと.
+    bool ProcessSampleEvent();
+
+    // 次の採取結果の公開時に waiter->notify を呼び出すよう登録する.
+    //  通常は NextSample() を使用する. 未初期化の場合は登録せず false を返す.
+    //  notify は公開したスレッド (ワーカースレッドなど) から呼び出される.
+    bool AddSampleWaiter(SampleWaiter* waiter);
+
+    // 指定した項目 (SubsystemFlags) が採取されているかを取得.
+    bool IsCollected(uint32_t subsystems);
+
+    // 最新の採取結果を一括で取得.
+    //  ロックを取らず、メモリ確保も行わない.
+    //  未初期化の場合は false を返す.
+    bool GetSnapshot(Snapshot& snapshot);
+
+    // 履歴 (カウンタ) とゾーン (TPC_ZONE) を Chrome トレース形式 (JSON) で書き出す.
+    //  chrome://tracing や Perfetto UI で読み込める. 時刻は両者とも QueryPerformanceCounter (Linux では CLOCK_MONOTONIC) の値を元にする.
+    //  windowMilliSeconds > 0 の場合は直近の期間のみ. historyCapacity = 0 の場合はゾーンのみとなる.
+    bool WriteChromeTrace(const wchar_t* path, uint32_t windowMilliSeconds = 0);
+  private:
+    std::unique_ptr<impl::SimplePerfCounter> m_impl;
+  };
+
+  // 他のプロセスが InitParams::sharedMemoryName で公開した採取結果を読み取る.
+  //  PDH やワーカースレッドを使用せず、読み取りはロックを取らない.
+  class SharedSnapshotReader
+  {
+  public:
+    SharedSnapshotReader() = default;
+    ~SharedSnapshotReader();
+    SharedSnapshotReader(const SharedSnapshotReader&) = delete;
+    SharedSnapshotReader& operator=(const SharedSnapshotReader&) = delete;
+
+    // 共有メモリを読み取り専用で開く. 存在しない場合や形式が異なる場合は false を返す.
+    bool Open(const wchar_t* name);
+    void Close();
+    bool IsOpen() const;
+
+    // 最新の採取結果を一括で取得. 開いていない場合は false を返す.
+    bool GetSnapshot(Snapshot& snapshot) const;
+
+    // 指標の最新の値を取得. スナップショット全体のコピーは行わない. 開いていない場合は kNotCollected.
+    double GetMetricValue(MetricId metric) const;
+
+    // 最新の採取結果の sequence. 増えない場合は公開側が停止している.
+    uint64_t GetSequence() const;
+
+    // 公開しているプロセスの ID. 公開側が終了している場合は 0.
+    uint32_t GetPublisherProcessId() const;
+  private:
+    void* m_mapping = nullptr;
+    const void* m_view = nullptr;
+  };
+
+  // InitParams::recordingFilePath で記録したファイルを読み取る.
+  //  ファイル全体をメモリマップし、時刻による検索は二分探索で行う.
+  class RecordingReader
+  {
+  public:
+    static constexpr uint32_t kInvalidChannel = 0xFFFFFFFFu;
+
+    RecordingReader() = default;
+    ~RecordingReader();
+    RecordingReader(const RecordingReader&) = delete;
+    RecordingReader& operator=(const RecordingReader&) = delete;
+
+    // 記録中のファイルも開ける. その場合、開いた時点までのサンプルが対象となる.
+    bool Open(const wchar_t* path);
+    void Close();
+    bool IsOpen() const;
+
+    // 記録されているチャンネル (指標) の構成.
+    uint32_t GetChannelCount() const;
+    MetricId GetChannel(uint32_t channel) const;
+    uint32_t FindChannel(MetricId metric) const;
+
+    // サンプル数 (欠番を含む) と、時刻 (QueryPerformanceCounter の値、Linux では ns) の周波数.
+    uint64_t GetRecordCount() const;
+    int64_t GetTimestampFrequency() const;
+
+    // index のサンプルの時刻と、チャンネル順の値を取得. 欠番の場合は false を返す.
+    bool ReadRecord(uint64_t index, int64_t& timestamp, std::span<double> values) const;
+
+    // 時刻が timestamp 以降となる最初のサンプルの index. 見つからない場合は GetRecordCount().
+    uint64_t FindRecord(int64_t timestamp) const;
+  private:
+    const void* GetHeader() const;
+
+    void* m_file = nullptr;
+    void* m_mapping = nullptr;
+    const uint8_t* m_view = nullptr;
+    uint64_t m_viewSize = 0;
+  };
+
+  // スコープの開始から終了までをゾーンとして記録する. TPC_ZONE マクロから使用する.
+  //  記録はスレッドごとのバッファに行い、ロックは最初の記録時にバッファを登録する際と、スレッドの終了時にのみ取る.
+  //  終了したスレッドのバッファは、新しいスレッドに割り当て直されるまで書き出せる.
+  //  name は文字列リテラルなど、書き出しまで有効なものを渡すこと.
+  class ScopedZone
+  {
+  public:
+    explicit ScopedZone(const char* name);
+    ~ScopedZone();
+    ScopedZone(const ScopedZone&) = delete;
+    ScopedZone& operator=(const ScopedZone&) = delete;
+  private:
+    const char* m_name;
+    int64_t m_begin;
+  };
+
+  // 既定のインスタンスに対する操作. 各関数の内容は Collector の同名関数と同じ.
+  //  初期化済みの場合、Initialize は何もせず true を返す.
+  bool Initialize(const InitParams& initParams);
+  void Shutdown();
+  uint64_t GetUsedGPUDedicatedMemory();
+  uint64_t GetUsedGPUSharedMemory();
+  double GetGPUEngineUtilization();
+  double GetGPUEngineUtilization(const wchar_t* engineName);
+  std::vector<std::wstring> GetGPUEngineNames();
+  uint32_t GetGPUEngineNames(std::span<const wchar_t*> names);
+  uint32_t FindGPUEngineId(const wchar_t* engineName);
+  double GetGPUEngineUtilizationById(uint32_t engineId);
+  uint32_t GetGPUEnginesUtilization(std::span<double> utilization);
+  uint32_t GetGPUAdapters(std::span<GPUAdapterSample> adapters);
+  uint32_t GetGPUEngineInstances(std::span<GPUEngineInstanceSample> instances);
+  double GetCPUUtilization();
+  std::vector<double> GetCPUCoresUtilization();
+  uint32_t GetCPUCoresUtilization(std::span<double> coresUtilization);
+  uint32_t GetCPUNumaNodesUtilization(std::span<double> nodesUtilization);
+  uint32_t GetCPUPackagesUtilization(std::span<double> packagesUtilization);
+  uint32_t GetCPUCoresFrequency(std::span<CPUFrequencySample> coresFrequency);
+  CPUThrottleSample GetCPUThrottle();
+  uint32_t GetFilteredMetrics(std::span<FilteredMetricSample> metrics);
+  uint32_t GetCPUTopology(std::span<LogicalProcessorInfo> processors);
+  uint32_t GetProcesses(std::span<ProcessSample> processes);
+  uint32_t GetThreadsUtilization(std::span<ThreadSample> threads);
+  MemorySample GetMemoryUsage();
+  uint32_t GetDisks(std::span<DiskSample> disks);
+  uint32_t GetNetworkInterfaces(std::span<NetworkInterfaceSample> interfaces);
+
+  // 呼び出し元スレッドに名前を付ける.
+  //  スレッドごとの CPU 使用率の名前として使用され、SetThreadDescription にも設定される.
+  //  Initialize 前に呼び出しても良い.
+  void SetCurrentThreadName(const wchar_t* name);
+
+  // スレッド ID を指定して名前を付ける. スレッドの説明 (GetThreadDescription) より優先される.
+  void RegisterThreadName(uint32_t threadId, const wchar_t* name);
+
+  void ResetPeakCPU();
+  double GetPeakCPUUtilization();
+  double GetMetricValue(MetricId metric);
+  bool GetMetricStatistics(MetricId metric, uint32_t windowMilliSeconds, MetricStatistics& statistics);
+  uint32_t GetMetricHistory(MetricId metric, std::span<MetricSample> samples);
+  uint32_t AddTrigger(const TriggerDesc& desc);
+  bool RemoveTrigger(uint32_t triggerId);
+  CounterHandle AddCounter(const wchar_t* counterPath, uint32_t format = CounterFormatDefault,
+    const wchar_t* instanceFilter = nullptr, CounterGroup group = CounterGroup::CPU);
+  double GetCounterValue(CounterHandle handle, uint32_t instance = 0);
+  uint32_t GetCounterValues(CounterHandle handle, std::span<double> values);
+  const wchar_t* GetCounterInstanceName(CounterHandle handle, uint32_t instance);
+  bool SampleNow(uint32_t timeoutMilliSeconds = 0);
+  bool WaitForNextSample(uint32_t timeoutMilliSeconds);
+  void* GetSampleEvent();
+  bool ProcessSampleEvent();
+  bool AddSampleWaiter(SampleWaiter* waiter);
+  bool IsCollected(uint32_t subsystems);
+  bool GetSnapshot(Snapshot& snapshot);
+  bool WriteChromeTrace(const wchar_t* path, uint32_t windowMilliSeconds = 0);
+
+  // 公開したスレッドでそのまま再開する executor.
+  //  ワーカースレッドで再開するため、再開後に重い処理を行うと次の採取が遅れる.
+  struct InlineExecutor
+  {
+    void operator()(std::coroutine_handle<> handle) const
+    {
+      handle.resume();
+    }
+  };
+
+  // 次の採取結果の公開を待つ awaitable.
+  //  公開時に executor(handle) で再開し、再開したスレッドで snapshot を GetSnapshot と同じ方法で取得する.
+  //  待機中はスレッドもポーリングも使用しない. co_await の結果は、取得できた場合 true.
+  //  Shutdown された場合や未初期化の場合は false で再開する.
+  template<class Executor>
+  class NextSampleAwaitable : private SampleWaiter
+  {
+  public:
+    NextSampleAwaitable(Collector* collector, Snapshot& snapshot, Executor executor)
+      : m_collector(collector), m_snapshot(snapshot), m_executor(std::move(executor))
+    {
+    }
+    bool await_ready() const noexcept
+    {
+      return false;
+    }
+    bool await_suspend(std::coroutine_handle<> handle)
+    {
+      m_handle = handle;
+      notify = &NextSampleAwaitable::Notify;
+      published = false;
+      // 登録できなかった場合は中断せずに再開する.
+      return m_collector ? m_collector->AddSampleWaiter(this) : AddSampleWaiter(this);
+    }
+    bool await_resume()
+    {
+      if (!published)
       {
-        double cpuUsage = 0;
-        PDH_FMT_COUNTERVALUE counter_value;
-        auto status = PdhGetFormattedCounterValue(m_hCpuUsage, PDH_FMT_DOUBLE | PDH_FMT_NOCAP100, 0, &counter_value);
-        auto result = counter_value.doubleValue;
-        if (status == ERROR_SUCCESS)
-        {
-          cpuUsage = result / m_logicalProcessorCount;
-        }
-        return cpuUsage;
+        return false;
       }
+      return m_collector ? m_collector->GetSnapshot(m_snapshot) : GetSnapshot(m_snapshot);
+    }
+  private:
+    static void Notify(SampleWaiter* waiter)
+    {
+      auto self = static_cast<NextSampleAwaitable*>(waiter);
+      self->m_executor(self->m_handle);
+    }
+
+    Collector* m_collector;
+    Snapshot& m_snapshot;
+    Executor m_executor;
+    std::coroutine_handle<> m_handle;
+  };
+
+  // 次の採取結果を待つ. 例: if (co_await tiny_perf_counter::NextSample(snapshot, executor)) { ... }
+  //  executor は std::coroutine_handle<> を受け取り、任意のスレッドで resume() する呼び出し可能なオブジェクト.
+  template<class Executor = InlineExecutor>
+  NextSampleAwaitable<Executor> NextSample(Collector& collector, Snapshot& snapshot, Executor executor = {})
+  {
+    return NextSampleAwaitable<Executor>(&collector, snapshot, std::move(executor));
+  }
+  // 既定のインスタンスの次の採取結果を待つ.
+  template<class Executor = InlineExecutor>
+  NextSampleAwaitable<Executor> NextSample(Snapshot& snapshot, Executor executor = {})
+  {
+    return NextSampleAwaitable<Executor>(nullptr, snapshot, std::move(executor));
+  }
+}
+
+// ゾーンの記録. TINY_PERFORMANCE_COUNTER_DISABLE_ZONES を定義すると何も行わない.
+//  例: void Update() { TPC_ZONE("Update"); ... }
+#if defined(TINY_PERFORMANCE_COUNTER_DISABLE_ZONES)
+# define TPC_ZONE(name)
+#else
+# define TPC_ZONE_CONCAT_(a, b) a##b
+# define TPC_ZONE_CONCAT(a, b) TPC_ZONE_CONCAT_(a, b)
+# define TPC_ZONE(name) ::tiny_perf_counter::ScopedZone TPC_ZONE_CONCAT(tpcZone_, __LINE__)(name)
+#endif
+
+#if defined(TINY_PERFORMANCE_COUNTER_IMPLEMENTATION)
+#if defined(_WIN32)
+#ifndef WIN32_LEAN_AND_MEAN
+# define WIN32_LEAN_AND_MEAN
+#endif 
+#include <windows.h>
+#include <pdh.h>
+#include <pdhmsg.h>
+#include <psapi.h>
+#include <tlhelp32.h>
+#include <dxgi1_4.h>
+#include <format>
+#elif defined(__linux__)
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <dlfcn.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/timerfd.h>
+#include <cerrno>
+#else
+# error "tiny_performance_counter: unsupported platform (Windows / Linux only)."
+#endif
+
+#include <unordered_map>
+#include <sstream>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <algorithm>
+#include <cstring>
+#include <cmath>
+#include <utility>
+#include <chrono>
+#include <cstdio>
+#include <cwctype>
+
+#if defined(_WIN32)
+#pragma comment(lib, "pdh.lib")
+#pragma comment(lib, "dxgi.lib")
+#endif
+
+namespace tiny_perf_counter
+{
+  namespace impl
+  {
+    using namespace std::chrono_literals;
+
+    // 時刻 (Windows は QueryPerformanceCounter、Linux は CLOCK_MONOTONIC の ns) とその周波数.
+    int64_t GetTimestamp()
+    {
+#if defined(_WIN32)
+      LARGE_INTEGER timestamp;
+      QueryPerformanceCounter(&timestamp);
+      return timestamp.QuadPart;
+#else
+      timespec now;
+      clock_gettime(CLOCK_MONOTONIC, &now);
+      return int64_t(now.tv_sec) * 1000000000 + now.tv_nsec;
+#endif
+    }
+    int64_t GetTimestampFrequency()
+    {
+#if defined(_WIN32)
+      LARGE_INTEGER frequency;
+      QueryPerformanceFrequency(&frequency);
+      return frequency.QuadPart;
+#else
+      return 1000000000;
+#endif
+    }
+    // 周波数 from の時刻の差を、周波数 to の値に変換する. 長い時間でも乗算が溢れないよう、秒と端数に分けて計算する.
+    int64_t ConvertTimestamp(int64_t value, int64_t from, int64_t to)
+    {
+      return value / from * to + value % from * to / from;
+    }
+
+    // 呼び出し元のスレッド ID. Linux ではカーネルのスレッド ID (gettid) で、/proc/<pid>/task の名前と一致する.
+    uint32_t GetThreadId()
+    {
+#if defined(_WIN32)
+      return GetCurrentThreadId();
+#else
+      return uint32_t(syscall(SYS_gettid));
+#endif
+    }
+
+    // 呼び出し元のプロセス ID.
+    uint32_t GetProcessId()
+    {
+#if defined(_WIN32)
+      return GetCurrentProcessId();
+#else
+      return uint32_t(getpid());
+#endif
+    }
+
+    // プロセスが実行中か. 権限がなく開けない場合も、存在するものとして扱う.
+    bool IsProcessAlive(uint32_t processId)
+    {
+#if defined(_WIN32)
+      auto process = OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, processId);
+      if (process == nullptr)
+      {
+        return GetLastError() == ERROR_ACCESS_DENIED;
+      }
+      DWORD exitCode = 0;
+      auto alive = GetExitCodeProcess(process, &exitCode) && exitCode == STILL_ACTIVE;
+      CloseHandle(process);
+      return alive;
+#else
+      return kill(pid_t(processId), 0) == 0 || errno == EPERM;
+#endif
+    }
+
+#if defined(_WIN32)
+    // wchar_t (UTF-16) の文字列を UTF-8 に変換する. 収まらない場合は空文字列とする.
+    void ToUtf8(const wchar_t* src, char* dst, size_t dstSize)
+    {
+      if (dstSize > 0 && WideCharToMultiByte(CP_UTF8, 0, src, -1, dst, int(dstSize), nullptr, nullptr) == 0)
+      {
+        dst[0] = '\0';
+      }
+    }
+
+    // Windows 10 以降のみにある kernel32 の関数. 古い OS でも読み込めるよう、実行時に取得する. ない場合は null.
+    struct Kernel32Functions
+    {
+      HRESULT(WINAPI* setThreadDescription)(HANDLE, LPCWSTR) = nullptr;
+      HRESULT(WINAPI* getThreadDescription)(HANDLE, PWSTR*) = nullptr;
+      BOOL(WINAPI* setThreadSelectedCpuSets)(HANDLE, const ULONG*, ULONG) = nullptr;
+
+      Kernel32Functions()
+      {
+        if (auto module = GetModuleHandleW(L"kernel32.dll"))
+        {
+          LoadSymbol(module, setThreadDescription, "SetThreadDescription");
+          LoadSymbol(module, getThreadDescription, "GetThreadDescription");
+          LoadSymbol(module, setThreadSelectedCpuSets, "SetThreadSelectedCpuSets");
+        }
+      }
+    private:
+      template<class Func>
+      static void LoadSymbol(HMODULE module, Func& func, const char* name)
+      {
+        func = reinterpret_cast<Func>(reinterpret_cast<void*>(GetProcAddress(module, name)));
+      }
+    };
+    const Kernel32Functions& GetKernel32Functions()
+    {
+      static const Kernel32Functions functions;
+      return functions;
+    }
+#elif defined(__linux__)
+    // wchar_t (UTF-32) の文字列を UTF-8 に変換する. 収まらない文字以降は切り捨てる.
+    void ToUtf8(const wchar_t* src, char* dst, size_t dstSize)
+    {
+      size_t length = 0;
+      for (; *src; ++src)
+      {
+        auto c = uint32_t(*src);
+        char bytes[4];
+        size_t count = 0;
+        if (c < 0x80)
+        {
+          bytes[count++] = char(c);
+        }
+        else if (c < 0x800)
+        {
+          bytes[count++] = char(0xC0 | (c >> 6));
+          bytes[count++] = char(0x80 | (c & 0x3F));
+        }
+        else if (c < 0x10000)
+        {
+          bytes[count++] = char(0xE0 | (c >> 12));
+          bytes[count++] = char(0x80 | ((c >> 6) & 0x3F));
+          bytes[count++] = char(0x80 | (c & 0x3F));
+        }
+        else
+        {
+          bytes[count++] = char(0xF0 | ((c >> 18) & 0x07));
+          bytes[count++] = char(0x80 | ((c >> 12) & 0x3F));
+          bytes[count++] = char(0x80 | ((c >> 6) & 0x3F));
+          bytes[count++] = char(0x80 | (c & 0x3F));
+        }
+        if (length + count >= dstSize)
+        {
+          break;
+        }
+        std::memcpy(dst + length, bytes, count);
+        length += count;
+      }
+      if (dstSize > 0)
+      {
+        dst[length] = '\0';
+      }
+    }
+
+    // UTF-8 の文字列 (srcLength バイト) を wchar_t に変換する. 不正なバイト列は '?' とする.
+    void FromUtf8(const char* src, size_t srcLength, wchar_t* dst, size_t dstSize)
+    {
+      size_t length = 0;
+      for (size_t i = 0; i < srcLength && src[i] != '\0' && length + 1 < dstSize;)
+      {
+        auto c = uint32_t(uint8_t(src[i]));
+        size_t count = c < 0x80 ? 1 : (c >> 5) == 0x06 ? 2 : (c >> 4) == 0x0E ? 3 : (c >> 3) == 0x1E ? 4 : 0;
+        if (count == 0 || i + count > srcLength)
+        {
+          dst[length++] = L'?';
+          i++;
+          continue;
+        }
+        c = count == 1 ? c : c & (0x7F >> count);
+        for (size_t k = 1; k < count; ++k)
+        {
+          c = (c << 6) | (uint8_t(src[i + k]) & 0x3F);
+        }
+        dst[length++] = wchar_t(c);
+        i += count;
+      }
+      if (dstSize > 0)
+      {
+        dst[length] = L'\0';
+      }
+    }
+
+    // 共有メモリの名前 (shm_open の名前). 先頭の '/' 以外に '/' を含められないため、区切り文字は '_' に置き換える.
+    //  例: L"Local\\MyToolPerfCounter" は "/Local_MyToolPerfCounter" となる.
+    void ToSharedMemoryName(const wchar_t* name, char (&dst)[256])
+    {
+      dst[0] = '/';
+      ToUtf8(name, dst + 1, sizeof(dst) - 1);
+      for (auto p = dst + 1; *p; ++p)
+      {
+        if (*p == '/' || *p == '\\')
+        {
+          *p = '_';
+        }
+      }
+    }
+#endif
+
+    // 書き込み1・読み込み多数のためのシーケンスロック (ダブルバッファ).
+    //  書き込み側は最新ではない側のスロットを更新してから切り替える.
+    //  読み込み側はロックを取らず、書き込みと重なった場合のみ読み直す.
+    template<class T>
+    class SeqLockBuffer
+    {
+    public:
+      void Publish(const T& value)
+      {
+        auto next = m_latest.load(std::memory_order_relaxed) + 1;
+        auto& slot = m_slots[next & 1];
+        auto sequence = slot.sequence.load(std::memory_order_relaxed);
+        slot.sequence.store(sequence + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        std::memcpy(&slot.value, &value, sizeof(T));
+        slot.sequence.store(sequence + 2, std::memory_order_release);
+        m_latest.store(next, std::memory_order_release);
+      }
+
+      // func はスロットの値を読み取って結果を返す.
+      //  書き込み中の値を読む可能性があるため、func 内では範囲チェックを行うこと.
+      //  retryCount を指定した場合は、書き込みと重なって読み直した回数を加算する.
+      template<class Func>
+      auto Read(Func&& func, uint64_t* retryCount = nullptr) const
+      {
+        for (uint64_t retry = 0;; ++retry)
+        {
+          auto& slot = m_slots[m_latest.load(std::memory_order_acquire) & 1];
+          auto sequence = slot.sequence.load(std::memory_order_acquire);
+          if (sequence & 1)
+          {
+            continue;
+          }
+          auto result = func(slot.value);
+          std::atomic_thread_fence(std::memory_order_acquire);
+          if (slot.sequence.load(std::memory_order_relaxed) == sequence)
+          {
+            if (retryCount)
+            {
+              *retryCount += retry;
+            }
+            return result;
+          }
+        }
+      }
+
+      void Read(T& value) const
+      {
+        Read([&](const T& src) { std::memcpy(&value, &src, sizeof(T)); return true; });
+      }
+    private:
+      struct Slot
+      {
+        std::atomic<uint64_t> sequence = 0;
+        T value{};
+      };
+      std::atomic<uint64_t> m_latest = 0;
+      Slot m_slots[2];
+    };
+
+    // 共有メモリに置く公開領域.
+    //  公開側は初期化を終えてから magic を書き込み、読み取り側は magic・バージョン・サイズが一致する場合のみ読む.
+    struct SharedSnapshotHeader
+    {
+      static constexpr uint32_t kMagic = 0x53435054u; // "TPCS"
+      static constexpr uint32_t kVersion = 2;
+      std::atomic<uint32_t> magic = 0;
+      uint32_t version = 0;
+      uint32_t snapshotSize = 0;
+      // 公開中のプロセスの ID. 公開側の終了時に 0 に戻す.
+      std::atomic<uint32_t> publisherProcessId = 0;
+      SeqLockBuffer<Snapshot> buffer;
+
+      bool IsValid() const
+      {
+        return magic.load(std::memory_order_acquire) == kMagic && version == kVersion && snapshotSize == sizeof(Snapshot);
+      }
+    };
+    // プロセス間で共有するため、アドレスに依存しないロックフリーのアトミック変数が必要.
+    static_assert(std::atomic<uint64_t>::is_always_lock_free && std::atomic<uint32_t>::is_always_lock_free);
+
+#if defined(_WIN32)
+    // GPU 関連カウンタのインスタンス名 "pid_X_luid_0xH_0xL_phys_N[_eng_N_engtype_T]" の解析結果.
+    struct GPUInstanceInfo
+    {
+      uint32_t pid = 0;
+      uint64_t luid = 0;
+      uint32_t physIndex = 0;
+      uint32_t engineIndex = 0;
+      uint32_t engineId = kInvalidGPUEngineId;
+      // 登録表のインデックス. 登録数の上限を超えた場合は kInvalidGPUAdapterIndex.
+      uint32_t adapterIndex = kInvalidGPUAdapterIndex;
+      uint32_t engineInstanceIndex = kInvalidGPUAdapterIndex;
+      // Snapshot::processes のインデックス.
+      uint32_t processIndex = 0;
+    };
+
+    // 生データから値を計算するための前回値.
+    struct RawCounterSample
+    {
+      PDH_RAW_COUNTER raw{};
+      bool valid = false;
+    };
+
+    // PDH カウンタ配列のインスタンス名キャッシュ.
+    //  インスタンス名ごとの解析結果を保持し、インスタンス構成が変化した場合のみ再解析する.
+    //  構成が同じ間は、名前の比較と対象インスタンスの値の走査のみで済む.
+    template<class Info>
+    class InstanceNameCache
+    {
+    public:
+      // items の並びがキャッシュと異なる場合は再構築する. 再構築した場合は true.
+      //  parser は (const wchar_t* name, Info& info) を受け取り、集計対象とする場合に true を返す.
+      template<class Item, class Parser>
+      bool Update(const Item* items, DWORD itemCount, Parser&& parser)
+      {
+        if (!m_invalidated && IsSameInstances(items, itemCount))
+        {
+          return false;
+        }
+        Rebuild(items, itemCount, parser);
+        return true;
+      }
+
+      // 集計対象の条件が変わった際に、次回更新時の再解析を要求する.
+      void Invalidate()
+      {
+        m_invalidated = true;
+      }
+
+      // 集計対象となるインスタンスの、PDH 配列中のインデックス.
+      const std::vector<uint32_t>& GetTargetIndices() const
+      {
+        return m_targetIndices;
+      }
+      const Info& GetInfo(uint32_t index) const
+      {
+        return m_entries[index].info;
+      }
+      // 生データ採取時の前回値. インスタンス構成が変わっても同名のインスタンスは引き継がれる.
+      RawCounterSample& GetPreviousRaw(uint32_t index)
+      {
+        return m_entries[index].previousRaw;
+      }
+    private:
+      struct Entry
+      {
+        std::wstring name;
+        Info info;
+        bool isTarget = false;
+        RawCounterSample previousRaw;
+      };
+
+      template<class Item>
+      bool IsSameInstances(const Item* items, DWORD itemCount) const
+      {
+        if (itemCount != m_entries.size())
+        {
+          return false;
+        }
+        for (DWORD i = 0; i < itemCount; ++i)
+        {
+          if (wcscmp(items[i].szName, m_entries[i].name.c_str()) != 0)
+          {
+            return false;
+          }
+        }
+        return true;
+      }
+
+      template<class Item, class Parser>
+      void Rebuild(const Item* items, DWORD itemCount, Parser& parser)
+      {
+        std::unordered_map<std::wstring, Entry> previous;
+        if (!m_invalidated)
+        {
+          for (auto& entry : m_entries)
+          {
+            auto name = entry.name;
+            previous.emplace(std::move(name), std::move(entry));
+          }
+        }
+        m_invalidated = false;
+        m_entries.clear();
+        m_targetIndices.clear();
+        m_entries.reserve(itemCount);
+        for (DWORD i = 0; i < itemCount; ++i)
+        {
+          if (auto itr = previous.find(items[i].szName); itr != previous.end())
+          {
+            m_entries.push_back(std::move(itr->second));
+          }
+          else
+          {
+            Entry entry;
+            entry.name = items[i].szName;
+            entry.isTarget = parser(items[i].szName, entry.info);
+            m_entries.push_back(std::move(entry));
+          }
+          if (m_entries.back().isTarget)
+          {
+            m_targetIndices.push_back(i);
+          }
+        }
+      }
+
+      std::vector<Entry> m_entries;
+      std::vector<uint32_t> m_targetIndices;
+      bool m_invalidated = false;
+    };
+
+    // "Processor Information" のインスタンス名 "N,M" の解析結果.
+    //  所属するプロセッサグループを考慮した通し番号に変換して保持する.
+    struct CPUInstanceInfo
+    {
+      uint32_t processorIndex = 0;
+    };
+
+    // "PhysicalDisk" / "Network Interface" のインスタンス名の解析結果.
+    struct IOInstanceInfo
+    {
+      // Snapshot::disks / networkInterfaces のインデックス.
+      uint32_t slot = 0;
+    };
+
+    // GetProcessTimes / QueryProcessCycleTime による CPU 時間の前回値.
+    struct ProcessTimesSample
+    {
+      uint64_t cpuTime = 0;     // カーネル + ユーザー時間 (100ns 単位).
+      uint64_t cycleTime = 0;
+      int64_t timestamp = 0;    // QueryPerformanceCounter の値.
+      bool valid = false;
+    };
+
+    // 監視対象のプロセスの CPU 時間の前回値.
+    struct ProcessState
+    {
+      DWORD pid = 0;
+      HANDLE handle = nullptr;
+      ProcessTimesSample previous;
+      // ページフォールト数の前回値. pageFaultTimestamp = 0 の場合は未取得.
+      DWORD pageFaultCount = 0;
+      int64_t pageFaultTimestamp = 0;
+      // I/O の前回値. ioTimestamp = 0 の場合は未取得.
+      IO_COUNTERS io{};
+      int64_t ioTimestamp = 0;
+    };
+
+    // スレッドごとの CPU 時間の前回値と名前.
+    struct ThreadState
+    {
+      HANDLE handle = nullptr;
+      ProcessTimesSample previous;
+      wchar_t name[kMaxThreadNameLength] = {};
+      uint64_t lastSeenSequence = 0;
+    };
+#elif defined(__linux__)
+    // /proc・/sys のファイル. 開いたままにし、採取のたびに先頭から pread で読み直す.
+    //  procfs・sysfs は読み込みのたびに内容を生成するため、開き直す必要はない.
+    class ProcFile
+    {
+    public:
+      ProcFile() = default;
+      ProcFile(ProcFile&& other) noexcept : m_fd(std::exchange(other.m_fd, -1))
+      {
+      }
+      ProcFile& operator=(ProcFile&& other) noexcept
+      {
+        if (this != &other)
+        {
+          Close();
+          m_fd = std::exchange(other.m_fd, -1);
+        }
+        return *this;
+      }
+      ProcFile(const ProcFile&) = delete;
+      ProcFile& operator=(const ProcFile&) = delete;
+      ~ProcFile()
+      {
+        Close();
+      }
+
+      // directory を指定した場合は、そのディレクトリからの相対パスとする.
+      bool Open(const char* path, int directory = AT_FDCWD)
+      {
+        Close();
+        m_fd = openat(directory, path, O_RDONLY | O_CLOEXEC);
+        return m_fd >= 0;
+      }
+      void Close()
+      {
+        if (m_fd >= 0)
+        {
+          close(m_fd);
+          m_fd = -1;
+        }
+      }
+      bool IsOpen() const
+      {
+        return m_fd >= 0;
+      }
+
+      // 内容を先頭から buffer に読み込み、終端文字を付ける. 読み込んだバイト数を返す. 失敗した場合は -1.
+      //  buffer に収まらない場合は size - 1 バイトまでとなる.
+      ssize_t Read(char* buffer, size_t size) const
+      {
+        size_t length = 0;
+        while (length + 1 < size)
+        {
+          auto result = pread(m_fd, buffer + length, size - 1 - length, off_t(length));
+          if (result < 0 && errno == EINTR)
+          {
+            continue;
+          }
+          if (result < 0)
+          {
+            return -1;
+          }
+          if (result == 0)
+          {
+            break;
+          }
+          length += size_t(result);
+        }
+        buffer[length] = '\0';
+        return ssize_t(length);
+      }
+
+      // 10進数の値を1つ読み取る (sysfs の属性など).
+      bool ReadValue(uint64_t& value) const;
+    private:
+      int m_fd = -1;
+    };
+
+    // 空白を読み飛ばして10進数を読み取り、text を数値の後ろに進める. 負の値は 0 とする.
+    uint64_t ParseUInt(const char*& text)
+    {
+      while (*text == ' ' || *text == '\t')
+      {
+        text++;
+      }
+      bool negative = *text == '-';
+      if (negative)
+      {
+        text++;
+      }
+      uint64_t value = 0;
+      for (; *text >= '0' && *text <= '9'; ++text)
+      {
+        value = value * 10 + uint64_t(*text - '0');
+      }
+      return negative ? 0 : value;
+    }
+
+    bool ProcFile::ReadValue(uint64_t& value) const
+    {
+      char buffer[32];
+      if (Read(buffer, sizeof(buffer)) <= 0)
+      {
+        return false;
+      }
+      const char* text = buffer;
+      value = ParseUInt(text);
+      return true;
+    }
+
+    // "key: value" または "key value" の形式の行 (/proc/meminfo, /proc/vmstat, /proc/<pid>/io) を1回の走査で読み取る.
+    //  keys[i] に一致した行の値を values[i] に格納する. 見つからなかった値は変更しない.
+    template<size_t N>
+    void ParseKeyValues(const char* text, const char* const (&keys)[N], uint64_t (&values)[N])
+    {
+      while (*text)
+      {
+        auto keyEnd = text;
+        while (*keyEnd && *keyEnd != ':' && *keyEnd != ' ' && *keyEnd != '\n')
+        {
+          keyEnd++;
+        }
+        auto keyLength = size_t(keyEnd - text);
+        for (size_t i = 0; i < N; ++i)
+        {
+          if (keyLength > 0 && std::strncmp(text, keys[i], keyLength) == 0 && keys[i][keyLength] == '\0')
+          {
+            auto value = keyEnd + (*keyEnd == ':' ? 1 : 0);
+            values[i] = ParseUInt(value);
+            break;
+          }
+        }
+        auto lineEnd = std::strchr(keyEnd, '\n');
+        if (lineEnd == nullptr)
+        {
+          break;
+        }
+        text = lineEnd + 1;
+      }
+    }
+
+    // /proc/<pid>/stat, /proc/<pid>/task/<tid>/stat の値.
+    struct ProcStat
+    {
+      uint32_t parentProcessId = 0;
+      uint64_t pageFaultCount = 0;  // minflt + majflt.
+      uint64_t cpuTicks = 0;        // utime + stime (clock tick 単位).
+    };
+
+    // プロセス名 (2番目の項目) は空白や括弧を含むことがあるため、最後の ')' の後ろから読み取る.
+    bool ParseProcStat(const char* text, ProcStat& stat)
+    {
+      auto fields = std::strrchr(text, ')');
+      if (fields == nullptr || fields[1] != ' ')
+      {
+        return false;
+      }
+      // 3番目の項目 (状態) を読み飛ばす.
+      fields += 2;
+      while (*fields && *fields != ' ')
+      {
+        fields++;
+      }
+      // 4番目 (ppid) から 15番目 (stime) まで.
+      uint64_t values[12];
+      for (auto& value : values)
+      {
+        value = ParseUInt(fields);
+      }
+      stat.parentProcessId = uint32_t(values[0]);
+      stat.pageFaultCount = values[6] + values[8];
+      stat.cpuTicks = values[10] + values[11];
+      return true;
+    }
+
+    // CPU 時間の前回値.
+    struct CPUTimeSample
+    {
+      uint64_t cpuTime = 0;     // ユーザー + カーネル時間 (ns).
+      int64_t timestamp = 0;    // CLOCK_MONOTONIC の値.
+      bool valid = false;
+    };
+
+    // 監視対象のプロセスの /proc/<pid> のファイルと前回値.
+    struct ProcessState
+    {
+      uint32_t pid = 0;
+      ProcFile stat;
+      ProcFile statm;
+      ProcFile io;
+      CPUTimeSample previous;
+      // ページフォールト数の前回値. pageFaultTimestamp = 0 の場合は未取得.
+      uint64_t pageFaultCount = 0;
+      int64_t pageFaultTimestamp = 0;
+      // I/O (rchar, wchar, syscr, syscw) の前回値. ioTimestamp = 0 の場合は未取得.
+      uint64_t ioCounters[4] = {};
+      int64_t ioTimestamp = 0;
+    };
+
+    // スレッドごとの CPU 時間の前回値と名前.
+    struct ThreadState
+    {
+      ProcFile stat;
+      // スレッド名の取得時に開く.
+      ProcFile comm;
+      CPUTimeSample previous;
+      wchar_t name[kMaxThreadNameLength] = {};
+      uint64_t lastSeenSequence = 0;
+    };
+
+    // /proc/diskstats, /proc/net/dev のデバイス名と Snapshot::disks / networkInterfaces のスロットの対応.
+    //  登録は追記のみ行うため、スロットは変化しない. 集計対象外の名前も MaxIgnoredCount 個まで覚えておき、判定を繰り返さない.
+    template<uint32_t MaxCount, uint32_t MaxIgnoredCount = 64>
+    class DeviceRegistry
+    {
+    public:
+      static constexpr uint32_t kInvalidSlot = 0xFFFFFFFFu;
+
+      // 名前に対応するスロットを返す. 未登録の場合は accept(name) が true であれば登録する.
+      //  集計対象外の場合や登録数の上限を超えた場合は kInvalidSlot.
+      template<class Accept>
+      uint32_t Register(const char* name, size_t length, Accept&& accept)
+      {
+        if (length == 0 || length >= kMaxIOInstanceNameLength)
+        {
+          return kInvalidSlot;
+        }
+        for (uint32_t i = 0; i < m_count; ++i)
+        {
+          if (std::strncmp(m_deviceNames[i], name, length) == 0 && m_deviceNames[i][length] == '\0')
+          {
+            return i;
+          }
+        }
+        for (uint32_t i = 0; i < m_ignoredCount; ++i)
+        {
+          if (std::strncmp(m_ignoredNames[i], name, length) == 0 && m_ignoredNames[i][length] == '\0')
+          {
+            return kInvalidSlot;
+          }
+        }
+        char deviceName[kMaxIOInstanceNameLength];
+        std::memcpy(deviceName, name, length);
+        deviceName[length] = '\0';
+        if (m_count == MaxCount || !accept(deviceName))
+        {
+          // 覚えきれない場合は、次回も判定し直す.
+          if (m_ignoredCount < MaxIgnoredCount)
+          {
+            std::memcpy(m_ignoredNames[m_ignoredCount++], deviceName, length + 1);
+          }
+          return kInvalidSlot;
+        }
+        std::memcpy(m_deviceNames[m_count], deviceName, length + 1);
+        FromUtf8(deviceName, length, m_names[m_count], kMaxIOInstanceNameLength);
+        return m_count++;
+      }
+      uint32_t GetCount() const
+      {
+        return m_count;
+      }
+      const wchar_t* GetName(uint32_t slot) const
+      {
+        return m_names[slot];
+      }
+    private:
+      char m_deviceNames[MaxCount][kMaxIOInstanceNameLength] = {};
+      wchar_t m_names[MaxCount][kMaxIOInstanceNameLength] = {};
+      uint32_t m_count = 0;
+      char m_ignoredNames[MaxIgnoredCount][kMaxIOInstanceNameLength] = {};
+      uint32_t m_ignoredCount = 0;
+    };
+
+    // DRM クライアントが持てるエンジンの種類の最大数.
+    constexpr uint32_t kMaxDrmEngines = 16;
+    // 領域を確保しておく DRM クライアントの数. 超える場合は拡張する.
+    constexpr uint32_t kMaxDrmClients = 64;
+
+    // DRM fdinfo (/proc/<pid>/fdinfo/<fd>) の1回の読み取り結果.
+    //  名前は読み取りに使用したバッファを指す.
+    struct DrmFdInfo
+    {
+      struct Engine
+      {
+        const char* name;
+        uint32_t nameLength;
+        uint64_t busy;          // drm-engine-<name>. 使用時間 (ns).
+        uint64_t cycles;        // drm-cycles-<name>. 使用中のサイクル数.
+        uint64_t totalCycles;   // drm-total-cycles-<name>. 報告しないドライバでは 0 となり、busy を使用する.
+      };
+      Engine engines[kMaxDrmEngines];
+      uint32_t engineCount;
+      // 領域の使用量 (byte). 1番目の添字は drm-resident-*、drm-memory-* (旧形式)、drm-total-* で、
+      //  この順に報告されているものを使用する. 2番目の添字は [0] がローカル (VRAM)、[1] がそれ以外の領域の合計.
+      uint64_t memory[3][2];
+      bool hasMemory[3];
+      uint64_t clientId;
+      bool hasClientId;
+      char pdev[32];
+      char driver[32];
+    };
+
+    // DRM 描画ノード (/dev/dri/*) を開いたファイルの fdinfo と、エンジンごとの前回値.
+    struct DrmClient
+    {
+      struct EngineState
+      {
+        char name[24];
+        uint32_t engineId;
+        uint32_t engineInstanceIndex;
+        uint64_t busy;
+        uint64_t cycles;
+        uint64_t totalCycles;
+        // 前回値を取得済みか.
+        bool valid;
+      };
+      uint32_t pid = 0;
+      int fd = -1;
+      ProcFile fdinfo;
+      uint64_t clientId = 0;
+      uint64_t luid = 0;
+      uint32_t processIndex = 0;
+      uint32_t adapterIndex = kInvalidGPUAdapterIndex;
+      EngineState engines[kMaxDrmEngines] = {};
+      uint32_t engineCount = 0;
+      // エンジンの前回値の時刻. 0 の場合は未取得.
+      int64_t timestamp = 0;
+      uint64_t lastSeenSequence = 0;
+    };
+
+    // NVML (NVIDIA Management Library). 実行時に読み込み、見つからない環境では使用しない.
+    //  NVIDIA のプロプライエタリドライバは DRM fdinfo にエンジンの使用時間を出力しないため、代わりに使用する.
+    struct NvmlLibrary
+    {
+      using Device = void*;
+      struct Memory
+      {
+        unsigned long long total;
+        unsigned long long free;
+        unsigned long long used;
+      };
+      struct PciInfo
+      {
+        char busIdLegacy[16];
+        unsigned int domain;
+        unsigned int bus;
+        unsigned int device;
+        unsigned int pciDeviceId;
+        unsigned int pciSubSystemId;
+        char busId[32];
+      };
+      struct ProcessInfo
+      {
+        unsigned int pid;
+        unsigned long long usedGpuMemory;
+        unsigned int gpuInstanceId;
+        unsigned int computeInstanceId;
+      };
+      struct ProcessUtilizationSample
+      {
+        unsigned int pid;
+        unsigned long long timeStamp;
+        unsigned int smUtil;
+        unsigned int memUtil;
+        unsigned int encUtil;
+        unsigned int decUtil;
+      };
+      // usedGpuMemory が取得できない場合の値 (NVML_VALUE_NOT_AVAILABLE).
+      static constexpr unsigned long long kValueNotAvailable = ~0ull;
+
+      void* library = nullptr;
+      int (*init)() = nullptr;
+      int (*shutdown)() = nullptr;
+      int (*deviceGetCount)(unsigned int*) = nullptr;
+      int (*deviceGetHandleByIndex)(unsigned int, Device*) = nullptr;
+      int (*deviceGetName)(Device, char*, unsigned int) = nullptr;
+      int (*deviceGetPciInfo)(Device, PciInfo*) = nullptr;
+      int (*deviceGetMemoryInfo)(Device, Memory*) = nullptr;
+      int (*deviceGetProcessUtilization)(Device, ProcessUtilizationSample*, unsigned int*, unsigned long long) = nullptr;
+      int (*deviceGetGraphicsRunningProcesses)(Device, unsigned int*, ProcessInfo*) = nullptr;
+      int (*deviceGetComputeRunningProcesses)(Device, unsigned int*, ProcessInfo*) = nullptr;
+
+      ~NvmlLibrary()
+      {
+        Unload();
+      }
+
+      // ライブラリを読み込んで初期化する. 必須の関数がない場合は false.
+      bool Load()
+      {
+        library = dlopen("libnvidia-ml.so.1", RTLD_NOW | RTLD_LOCAL);
+        if (library == nullptr)
+        {
+          return false;
+        }
+        LoadSymbol(init, "nvmlInit_v2");
+        LoadSymbol(shutdown, "nvmlShutdown");
+        LoadSymbol(deviceGetCount, "nvmlDeviceGetCount_v2");
+        LoadSymbol(deviceGetHandleByIndex, "nvmlDeviceGetHandleByIndex_v2");
+        LoadSymbol(deviceGetName, "nvmlDeviceGetName");
+        LoadSymbol(deviceGetPciInfo, "nvmlDeviceGetPciInfo_v3") || LoadSymbol(deviceGetPciInfo, "nvmlDeviceGetPciInfo_v2");
+        LoadSymbol(deviceGetMemoryInfo, "nvmlDeviceGetMemoryInfo");
+        LoadSymbol(deviceGetProcessUtilization, "nvmlDeviceGetProcessUtilization");
+        LoadSymbol(deviceGetGraphicsRunningProcesses, "nvmlDeviceGetGraphicsRunningProcesses_v3") ||
+          LoadSymbol(deviceGetGraphicsRunningProcesses, "nvmlDeviceGetGraphicsRunningProcesses_v2");
+        LoadSymbol(deviceGetComputeRunningProcesses, "nvmlDeviceGetComputeRunningProcesses_v3") ||
+          LoadSymbol(deviceGetComputeRunningProcesses, "nvmlDeviceGetComputeRunningProcesses_v2");
+        if (!init || !shutdown || !deviceGetCount || !deviceGetHandleByIndex || init() != 0)
+        {
+          dlclose(library);
+          library = nullptr;
+          return false;
+        }
+        return true;
+      }
+      void Unload()
+      {
+        if (library)
+        {
+          shutdown();
+          dlclose(library);
+          library = nullptr;
+        }
+      }
+      bool IsLoaded() const
+      {
+        return library != nullptr;
+      }
+    private:
+      template<class Func>
+      bool LoadSymbol(Func& func, const char* name)
+      {
+        func = reinterpret_cast<Func>(dlsym(library, name));
+        return func != nullptr;
+      }
+    };
+#endif
+
+    // RegisterThreadName で登録されたスレッド名.
+    //  登録はまれなため、ロックで保護する.
+    class ThreadNameRegistry
+    {
+    public:
+      void Register(uint32_t threadId, const wchar_t* name)
+      {
+        std::unique_lock lock(m_mutex);
+        m_names[threadId] = name;
+        m_version.fetch_add(1, std::memory_order_release);
+      }
+      bool Find(uint32_t threadId, wchar_t (&name)[kMaxThreadNameLength])
+      {
+        std::unique_lock lock(m_mutex);
+        if (auto itr = m_names.find(threadId); itr != m_names.end())
+        {
+          auto length = (std::min)(itr->second.size(), size_t(kMaxThreadNameLength - 1));
+          wmemcpy(name, itr->second.c_str(), length);
+          name[length] = L'\0';
+          return true;
+        }
+        return false;
+      }
+      // 終了したスレッドの名前を消す. 同じ ID の新しいスレッドに引き継がないようにする.
+      void Unregister(uint32_t threadId)
+      {
+        std::unique_lock lock(m_mutex);
+        m_names.erase(threadId);
+      }
+      uint32_t GetVersion() const
+      {
+        return m_version.load(std::memory_order_acquire);
+      }
+    private:
+      std::mutex m_mutex;
+      std::unordered_map<uint32_t, std::wstring> m_names;
+      std::atomic<uint32_t> m_version = 0;
+    };
+    ThreadNameRegistry gThreadNameRegistry;
+
+    // スレッドごとのゾーンの記録. 書き込みは所有するスレッドのみ.
+    //  古いものから上書きし、読み込み側は読み込み中に上書きされたものを捨てる.
+    //  終了したスレッドのバッファは別のスレッドに割り当て直し、それ以前の記録は読み込み側から見えなくする.
+    class ZoneBuffer
+    {
+    public:
+      static constexpr uint32_t kCapacity = 8192;
+
+      explicit ZoneBuffer(uint32_t threadId) : m_threadId(threadId)
+      {
+      }
+      // 所有するスレッドを切り替える. 新しいスレッドが最初の記録の前に呼ぶ.
+      //  読み込み側は m_generation の変化 (奇数の間は切り替え中) を見て、読み込んだ内容を捨てる.
+      void Reassign(uint32_t threadId)
+      {
+        auto generation = m_generation.load(std::memory_order_relaxed);
+        m_generation.store(generation + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        m_begin.store(m_head.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        m_threadId.store(threadId, std::memory_order_relaxed);
+        m_generation.store(generation + 2, std::memory_order_release);
+      }
+      void Push(const char* name, int64_t begin, int64_t end)
+      {
+        auto index = m_head.load(std::memory_order_relaxed);
+        auto& event = m_events[index % kCapacity];
+        m_writing.store(index + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        event.name.store(name, std::memory_order_relaxed);
+        event.begin.store(begin, std::memory_order_relaxed);
+        event.end.store(end, std::memory_order_relaxed);
+        m_head.store(index + 1, std::memory_order_release);
+      }
+      // 終了時刻が since 以降のゾーンを古い順に func(threadId, name, begin, end) に渡す.
+      //  読み込み中に別のスレッドへ割り当て直された場合は何も渡さない.
+      template<class Func>
+      void ForEach(int64_t since, Func&& func) const
+      {
+        struct Zone
+        {
+          const char* name;
+          int64_t begin;
+          int64_t end;
+        };
+        auto generation = m_generation.load(std::memory_order_acquire);
+        if (generation & 1)
+        {
+          return;
+        }
+        auto threadId = m_threadId.load(std::memory_order_relaxed);
+        auto first = m_begin.load(std::memory_order_relaxed);
+        auto head = m_head.load(std::memory_order_acquire);
+        auto count = (std::min)(head - first, uint64_t(kCapacity));
+        std::vector<Zone> zones(static_cast<size_t>(count));
+        for (uint64_t i = 0; i < count; ++i)
+        {
+          auto& event = m_events[(head - count + i) % kCapacity];
+          zones[size_t(i)] = { event.name.load(std::memory_order_relaxed), event.begin.load(std::memory_order_relaxed), event.end.load(std::memory_order_relaxed) };
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        auto writing = m_writing.load(std::memory_order_relaxed);
+        if (m_generation.load(std::memory_order_relaxed) != generation)
+        {
+          return;
+        }
+        auto oldestValid = writing > kCapacity ? writing - kCapacity : 0;
+        for (uint64_t i = 0; i < count; ++i)
+        {
+          auto& zone = zones[size_t(i)];
+          if (head - count + i >= oldestValid && zone.end >= since)
+          {
+            func(threadId, zone.name, zone.begin, zone.end);
+          }
+        }
+      }
+    private:
+      struct Event
+      {
+        std::atomic<const char*> name = nullptr;
+        std::atomic<int64_t> begin = 0;
+        std::atomic<int64_t> end = 0;
+      };
+      std::atomic<uint32_t> m_threadId;
+      // 現在のスレッドの最初の記録の通し番号と、割り当て直した回数の2倍 (切り替え中は奇数).
+      std::atomic<uint64_t> m_begin = 0;
+      std::atomic<uint32_t> m_generation = 0;
+      Event m_events[kCapacity];
+      std::atomic<uint64_t> m_head = 0;
+      std::atomic<uint64_t> m_writing = 0;
+    };
+
+    // ゾーンを記録したスレッドのバッファの一覧.
+    //  終了したスレッドのバッファは、書き出せるよう保持したまま空きとする. バッファが kRetainedBufferCount 個に達した後は、
+    //  最も前に空いたものを次にゾーンを記録するスレッドに割り当て直す. このため、バッファの数は
+    //  kRetainedBufferCount と同時にゾーンを記録したスレッドの数の大きい方に留まる.
+    class ZoneRegistry
+    {
+    public:
+      static constexpr uint32_t kRetainedBufferCount = 16;
+
+      ZoneBuffer& GetCurrentThreadBuffer()
+      {
+        // スレッドの終了時にバッファを空きに戻す.
+        struct ThreadBuffer
+        {
+          ZoneRegistry* registry = nullptr;
+          std::shared_ptr<ZoneBuffer> buffer;
+          ~ThreadBuffer()
+          {
+            if (buffer)
+            {
+              registry->Release(buffer.get());
+            }
+          }
+        };
+        thread_local ThreadBuffer current;
+        if (!current.buffer)
+        {
+          current.registry = this;
+          current.buffer = Acquire(impl::GetThreadId());
+        }
+        return *current.buffer;
+      }
+      std::vector<std::shared_ptr<ZoneBuffer>> GetBuffers()
+      {
+        std::unique_lock lock(m_mutex);
+        std::vector<std::shared_ptr<ZoneBuffer>> buffers;
+        buffers.reserve(m_entries.size());
+        for (auto& entry : m_entries)
+        {
+          buffers.push_back(entry.buffer);
+        }
+        return buffers;
+      }
+    private:
+      struct Entry
+      {
+        std::shared_ptr<ZoneBuffer> buffer;
+        bool inUse = false;
+        // 空いた順番. 小さいものから割り当て直す.
+        uint64_t releaseOrder = 0;
+      };
+
+      std::shared_ptr<ZoneBuffer> Acquire(uint32_t threadId)
+      {
+        std::unique_lock lock(m_mutex);
+        if (m_entries.size() >= kRetainedBufferCount)
+        {
+          Entry* oldest = nullptr;
+          for (auto& entry : m_entries)
+          {
+            if (!entry.inUse && (oldest == nullptr || entry.releaseOrder < oldest->releaseOrder))
+            {
+              oldest = &entry;
+            }
+          }
+          if (oldest)
+          {
+            oldest->inUse = true;
+            oldest->buffer->Reassign(threadId);
+            return oldest->buffer;
+          }
+        }
+        auto& entry = m_entries.emplace_back();
+        entry.buffer = std::make_shared<ZoneBuffer>(threadId);
+        entry.inUse = true;
+        return entry.buffer;
+      }
+      void Release(ZoneBuffer* buffer)
+      {
+        std::unique_lock lock(m_mutex);
+        for (auto& entry : m_entries)
+        {
+          if (entry.buffer.get() == buffer)
+          {
+            entry.inUse = false;
+            entry.releaseOrder = ++m_releaseCount;
+          }
+        }
+      }
+
+      std::mutex m_mutex;
+      std::vector<Entry> m_entries;
+      uint64_t m_releaseCount = 0;
+    };
+    ZoneRegistry gZoneRegistry;
+
+    // 全ての項目を採取対象外とした MemorySample.
+    MemorySample NotCollectedMemorySample()
+    {
+      MemorySample memory{};
+      memory.processWorkingSet = kNotCollectedBytes;
+      memory.processPrivateBytes = kNotCollectedBytes;
+      memory.processPageFaultsPerSecond = kNotCollected;
+      memory.systemCommitCharge = kNotCollectedBytes;
+      memory.systemCommitLimit = kNotCollectedBytes;
+      memory.systemPhysicalTotal = kNotCollectedBytes;
+      memory.systemAvailableMemory = kNotCollectedBytes;
+      memory.systemStandbyCache = kNotCollectedBytes;
+      memory.systemHardPageFaultsPerSecond = kNotCollected;
+      memory.systemSoftPageFaultsPerSecond = kNotCollected;
+      memory.systemPagesPerSecond = kNotCollected;
+      return memory;
+    }
+
+    // 指標を採取する項目.
+    uint32_t GetMetricSubsystem(Metric metric)
+    {
+      switch (metric)
+      {
+      case Metric::CPUGlobalUtilization:
+        return SubsystemCPUGlobal;
+      case Metric::CPUProcessUtilization:
+        return SubsystemCPUProcess;
+      case Metric::CPUCoreUtilization:
+        return SubsystemCPUCores;
+      case Metric::CPUCorePerformance:
+      case Metric::CPUCoreFrequency:
+      case Metric::CPUPerformanceLimit:
+      case Metric::CPUThermalPassiveLimit:
+      case Metric::CPUThrottled:
+        return SubsystemCPUFrequency;
+      case Metric::GPUEngineUtilization:
+        return SubsystemGPUEngine;
+      case Metric::GPUDedicatedMemory:
+      case Metric::GPUSharedMemory:
+      case Metric::GPULocalMemoryBudgetUtilization:
+        return SubsystemGPUMemory;
+      case Metric::ProcessWorkingSet:
+      case Metric::ProcessPrivateBytes:
+      case Metric::ProcessPageFaults:
+      case Metric::SystemCommitCharge:
+      case Metric::SystemAvailableMemory:
+      case Metric::SystemStandbyCache:
+      case Metric::SystemHardPageFaults:
+      case Metric::SystemSoftPageFaults:
+      case Metric::SystemPages:
+        return SubsystemMemory;
+      case Metric::ProcessIOReadBytes:
+      case Metric::ProcessIOWriteBytes:
+      case Metric::ProcessIOReadOperations:
+      case Metric::ProcessIOWriteOperations:
+        return SubsystemProcessIO;
+      case Metric::DiskReadBytes:
+      case Metric::DiskWriteBytes:
+      case Metric::DiskQueueLength:
+        return SubsystemDisk;
+      case Metric::NetworkReceivedBytes:
+      case Metric::NetworkSentBytes:
+        return SubsystemNetwork;
+      default:
+        return 0;
+      }
+    }
+
+    // 指標の名前 (トレースのトラック名などに使用).
+    const char* GetMetricName(Metric metric)
+    {
+      switch (metric)
+      {
+      case Metric::CPUUtilization:
+        return "CPU Utilization";
+      case Metric::CPUGlobalUtilization:
+        return "CPU Global Utilization";
+      case Metric::CPUProcessUtilization:
+        return "CPU Process Utilization";
+      case Metric::CPUCoreUtilization:
+        return "CPU Core Utilization";
+      case Metric::CPUCorePerformance:
+        return "CPU Core Performance";
+      case Metric::CPUCoreFrequency:
+        return "CPU Core Frequency";
+      case Metric::CPUPerformanceLimit:
+        return "CPU Performance Limit";
+      case Metric::CPUThermalPassiveLimit:
+        return "CPU Thermal Passive Limit";
+      case Metric::CPUThrottled:
+        return "CPU Throttled";
+      case Metric::GPUEngineUtilization:
+        return "GPU Engine Utilization";
+      case Metric::GPUDedicatedMemory:
+        return "GPU Dedicated Memory";
+      case Metric::GPUSharedMemory:
+        return "GPU Shared Memory";
+      case Metric::GPULocalMemoryBudgetUtilization:
+        return "GPU Local Memory Budget Utilization";
+      case Metric::ProcessWorkingSet:
+        return "Process Working Set";
+      case Metric::ProcessPrivateBytes:
+        return "Process Private Bytes";
+      case Metric::ProcessPageFaults:
+        return "Process Page Faults/sec";
+      case Metric::SystemCommitCharge:
+        return "System Commit Charge";
+      case Metric::SystemAvailableMemory:
+        return "System Available Memory";
+      case Metric::SystemStandbyCache:
+        return "System Standby Cache";
+      case Metric::SystemHardPageFaults:
+        return "System Hard Page Faults/sec";
+      case Metric::SystemSoftPageFaults:
+        return "System Soft Page Faults/sec";
+      case Metric::SystemPages:
+        return "System Pages/sec";
+      case Metric::ProcessIOReadBytes:
+        return "Process IO Read Bytes/sec";
+      case Metric::ProcessIOWriteBytes:
+        return "Process IO Write Bytes/sec";
+      case Metric::ProcessIOReadOperations:
+        return "Process IO Read Operations/sec";
+      case Metric::ProcessIOWriteOperations:
+        return "Process IO Write Operations/sec";
+      case Metric::DiskReadBytes:
+        return "Disk Read Bytes/sec";
+      case Metric::DiskWriteBytes:
+        return "Disk Write Bytes/sec";
+      case Metric::DiskQueueLength:
+        return "Disk Queue Length";
+      case Metric::NetworkReceivedBytes:
+        return "Network Received Bytes/sec";
+      case Metric::NetworkSentBytes:
+        return "Network Sent Bytes/sec";
+      default:
+        return "Unknown";
+      }
+    }
+
+    // JSON の文字列として書き出す.
+    void WriteJsonString(FILE* fp, const char* text)
+    {
+      fputc('"', fp);
+      for (; *text; ++text)
+      {
+        auto c = static_cast<unsigned char>(*text);
+        if (c == '"' || c == '\\')
+        {
+          fprintf(fp, "\\%c", c);
+        }
+        else if (c < 0x20)
+        {
+          fprintf(fp, "\\u%04x", c);
+        }
+        else
+        {
+          fputc(c, fp);
+        }
+      }
+      fputc('"', fp);
+    }
+
+    // スナップショットから指標の値を取り出す. 採取対象外の場合は kNotCollected.
+    double ReadMetric(const Snapshot& snapshot, MetricId id)
+    {
+      if (auto subsystem = GetMetricSubsystem(id.metric); subsystem != 0 && (snapshot.collectedSubsystems & subsystem) == 0)
+      {
+        return kNotCollected;
+      }
+      switch (id.metric)
+      {
+      case Metric::CPUUtilization:
+        return snapshot.cpuUtilization;
+      case Metric::CPUGlobalUtilization:
+        return snapshot.cpuUtilizationGlobal;
+      case Metric::CPUProcessUtilization:
+        return snapshot.cpuUtilizationProcess;
+      case Metric::CPUCoreUtilization:
+        return id.index < (std::min)(snapshot.cpuCoreCount, kMaxCPUCores) ? snapshot.cpuCoresUtilization[id.index] : 0.0;
+      case Metric::CPUCorePerformance:
+        return id.index < (std::min)(snapshot.cpuCoreCount, kMaxCPUCores) ? snapshot.cpuCoresFrequency[id.index].performancePercent : 0.0;
+      case Metric::CPUCoreFrequency:
+        return id.index < (std::min)(snapshot.cpuCoreCount, kMaxCPUCores) ? snapshot.cpuCoresFrequency[id.index].effectiveFrequencyMHz : 0.0;
+      case Metric::CPUPerformanceLimit:
+        return snapshot.cpuThrottle.performanceLimitPercent;
+      case Metric::CPUThermalPassiveLimit:
+        return snapshot.cpuThermalPassiveLimitPercent;
+      case Metric::CPUThrottled:
+        return snapshot.cpuThrottle.throttled ? 1.0 : 0.0;
+      case Metric::GPUEngineUtilization:
+        return id.index < (std::min)(snapshot.gpuEngineCount, kMaxGPUEngines) ? snapshot.gpuEngines[id.index].utilization : 0.0;
+      case Metric::GPUDedicatedMemory:
+        return double(snapshot.gpuDedicatedMemory);
+      case Metric::GPUSharedMemory:
+        return double(snapshot.gpuSharedMemory);
+      case Metric::GPULocalMemoryBudgetUtilization:
+        if (id.index < (std::min)(snapshot.gpuAdapterCount, kMaxGPUAdapters))
+        {
+          auto& memory = snapshot.gpuAdapters[id.index].localMemory;
+          if (memory.budget == kNotCollectedBytes || memory.currentUsage == kNotCollectedBytes)
+          {
+            return kNotCollected;
+          }
+          return memory.budget > 0 ? double(memory.currentUsage) * 100.0 / double(memory.budget) : 0.0;
+        }
+        return 0.0;
+      case Metric::ProcessWorkingSet:
+        return double(snapshot.memory.processWorkingSet);
+      case Metric::ProcessPrivateBytes:
+        return double(snapshot.memory.processPrivateBytes);
+      case Metric::ProcessPageFaults:
+        return snapshot.memory.processPageFaultsPerSecond;
+      case Metric::SystemCommitCharge:
+        return double(snapshot.memory.systemCommitCharge);
+      case Metric::SystemAvailableMemory:
+        return double(snapshot.memory.systemAvailableMemory);
+      case Metric::SystemStandbyCache:
+        return double(snapshot.memory.systemStandbyCache);
+      case Metric::SystemHardPageFaults:
+        return snapshot.memory.systemHardPageFaultsPerSecond;
+      case Metric::SystemSoftPageFaults:
+        return snapshot.memory.systemSoftPageFaultsPerSecond;
+      case Metric::SystemPages:
+        return snapshot.memory.systemPagesPerSecond;
+      case Metric::ProcessIOReadBytes:
+        return snapshot.processIO.readBytesPerSecond;
+      case Metric::ProcessIOWriteBytes:
+        return snapshot.processIO.writeBytesPerSecond;
+      case Metric::ProcessIOReadOperations:
+        return snapshot.processIO.readOperationsPerSecond;
+      case Metric::ProcessIOWriteOperations:
+        return snapshot.processIO.writeOperationsPerSecond;
+      case Metric::DiskReadBytes:
+        return id.index < (std::min)(snapshot.diskCount, kMaxDisks) ? snapshot.disks[id.index].readBytesPerSecond : 0.0;
+      case Metric::DiskWriteBytes:
+        return id.index < (std::min)(snapshot.diskCount, kMaxDisks) ? snapshot.disks[id.index].writeBytesPerSecond : 0.0;
+      case Metric::DiskQueueLength:
+        return id.index < (std::min)(snapshot.diskCount, kMaxDisks) ? snapshot.disks[id.index].queueLength : 0.0;
+      case Metric::NetworkReceivedBytes:
+        return id.index < (std::min)(snapshot.networkInterfaceCount, kMaxNetworkInterfaces) ? snapshot.networkInterfaces[id.index].receivedBytesPerSecond : 0.0;
+      case Metric::NetworkSentBytes:
+        return id.index < (std::min)(snapshot.networkInterfaceCount, kMaxNetworkInterfaces) ? snapshot.networkInterfaces[id.index].sentBytesPerSecond : 0.0;
+      default:
+        return 0.0;
+      }
+    }
+
+    // 指標を採取するグループ.
+    CounterGroup GetMetricGroup(Metric metric)
+    {
+      switch (GetMetricSubsystem(metric))
+      {
+      case SubsystemGPUEngine:
+        return CounterGroup::GPUEngine;
+      case SubsystemGPUMemory:
+        return CounterGroup::GPUMemory;
+      case SubsystemMemory:
+        return CounterGroup::Memory;
+      case SubsystemProcessIO:
+      case SubsystemDisk:
+      case SubsystemNetwork:
+        return CounterGroup::IO;
+      default:
+        return CounterGroup::CPU;
+      }
+    }
+
+    // 指標の値を格納する snapshot の項目. double の項目を持たない指標や、範囲外の index の場合は nullptr.
+    double* GetMetricField(Snapshot& snapshot, MetricId id)
+    {
+      switch (id.metric)
+      {
+      case Metric::CPUGlobalUtilization:
+        return &snapshot.cpuUtilizationGlobal;
+      case Metric::CPUProcessUtilization:
+        return &snapshot.cpuUtilizationProcess;
+      case Metric::CPUCoreUtilization:
+        return id.index < (std::min)(snapshot.cpuCoreCount, kMaxCPUCores) ? &snapshot.cpuCoresUtilization[id.index] : nullptr;
+      case Metric::CPUCorePerformance:
+        return id.index < (std::min)(snapshot.cpuCoreCount, kMaxCPUCores) ? &snapshot.cpuCoresFrequency[id.index].performancePercent : nullptr;
+      case Metric::CPUCoreFrequency:
+        return id.index < (std::min)(snapshot.cpuCoreCount, kMaxCPUCores) ? &snapshot.cpuCoresFrequency[id.index].effectiveFrequencyMHz : nullptr;
+      case Metric::CPUPerformanceLimit:
+        return &snapshot.cpuThrottle.performanceLimitPercent;
+      case Metric::CPUThermalPassiveLimit:
+        return &snapshot.cpuThermalPassiveLimitPercent;
+      case Metric::GPUEngineUtilization:
+        return id.index < (std::min)(snapshot.gpuEngineCount, kMaxGPUEngines) ? &snapshot.gpuEngines[id.index].utilization : nullptr;
+      case Metric::ProcessPageFaults:
+        return &snapshot.memory.processPageFaultsPerSecond;
+      case Metric::SystemHardPageFaults:
+        return &snapshot.memory.systemHardPageFaultsPerSecond;
+      case Metric::SystemSoftPageFaults:
+        return &snapshot.memory.systemSoftPageFaultsPerSecond;
+      case Metric::SystemPages:
+        return &snapshot.memory.systemPagesPerSecond;
+      case Metric::ProcessIOReadBytes:
+        return &snapshot.processIO.readBytesPerSecond;
+      case Metric::ProcessIOWriteBytes:
+        return &snapshot.processIO.writeBytesPerSecond;
+      case Metric::ProcessIOReadOperations:
+        return &snapshot.processIO.readOperationsPerSecond;
+      case Metric::ProcessIOWriteOperations:
+        return &snapshot.processIO.writeOperationsPerSecond;
+      case Metric::DiskReadBytes:
+        return id.index < (std::min)(snapshot.diskCount, kMaxDisks) ? &snapshot.disks[id.index].readBytesPerSecond : nullptr;
+      case Metric::DiskWriteBytes:
+        return id.index < (std::min)(snapshot.diskCount, kMaxDisks) ? &snapshot.disks[id.index].writeBytesPerSecond : nullptr;
+      case Metric::DiskQueueLength:
+        return id.index < (std::min)(snapshot.diskCount, kMaxDisks) ? &snapshot.disks[id.index].queueLength : nullptr;
+      case Metric::NetworkReceivedBytes:
+        return id.index < (std::min)(snapshot.networkInterfaceCount, kMaxNetworkInterfaces) ? &snapshot.networkInterfaces[id.index].receivedBytesPerSecond : nullptr;
+      case Metric::NetworkSentBytes:
+        return id.index < (std::min)(snapshot.networkInterfaceCount, kMaxNetworkInterfaces) ? &snapshot.networkInterfaces[id.index].sentBytesPerSecond : nullptr;
+      default:
+        return nullptr;
+      }
+    }
+
+    // 指標をチャンネル (通し番号) に割り当てる.
+    //  各指標の index の数だけチャンネルが連続して並ぶ.
+    class ChannelLayout
+    {
+    public:
+      static constexpr uint32_t kInvalidChannel = 0xFFFFFFFFu;
+
+      void Initialize(uint32_t cpuCoreCount)
+      {
+        uint32_t offset = 0;
+        for (uint32_t i = 0; i < uint32_t(Metric::Count); ++i)
+        {
+          m_offsets[i] = offset;
+          switch (Metric(i))
+          {
+          case Metric::CPUCoreUtilization:
+          case Metric::CPUCorePerformance:
+          case Metric::CPUCoreFrequency:
+            m_counts[i] = cpuCoreCount;
+            break;
+          case Metric::GPUEngineUtilization:
+            m_counts[i] = kMaxGPUEngines;
+            break;
+          case Metric::GPULocalMemoryBudgetUtilization:
+            m_counts[i] = kMaxGPUAdapters;
+            break;
+          case Metric::DiskReadBytes:
+          case Metric::DiskWriteBytes:
+          case Metric::DiskQueueLength:
+            m_counts[i] = kMaxDisks;
+            break;
+          case Metric::NetworkReceivedBytes:
+          case Metric::NetworkSentBytes:
+            m_counts[i] = kMaxNetworkInterfaces;
+            break;
+          default:
+            m_counts[i] = 1;
+            break;
+          }
+          offset += m_counts[i];
+        }
+        m_channelCount = offset;
+      }
+      uint32_t GetChannelCount() const
+      {
+        return m_channelCount;
+      }
+      // 指標の index の数.
+      uint32_t GetIndexCount(Metric metric) const
+      {
+        return uint32_t(metric) < uint32_t(Metric::Count) ? m_counts[uint32_t(metric)] : 0;
+      }
+      uint32_t ToChannel(MetricId id) const
+      {
+        auto metric = uint32_t(id.metric);
+        if (metric >= uint32_t(Metric::Count) || id.index >= m_counts[metric])
+        {
+          return kInvalidChannel;
+        }
+        return m_offsets[metric] + id.index;
+      }
+      MetricId ToMetric(uint32_t channel) const
+      {
+        uint32_t metric = 0;
+        while (metric + 1 < uint32_t(Metric::Count) && m_offsets[metric + 1] <= channel)
+        {
+          metric++;
+        }
+        return { Metric(metric), channel - m_offsets[metric] };
+      }
+      // 全チャンネルの値を一括で取り出す.
+      void Fill(const Snapshot& snapshot, double* values) const
+      {
+        for (uint32_t i = 0; i < uint32_t(Metric::Count); ++i)
+        {
+          for (uint32_t index = 0; index < m_counts[i]; ++index)
+          {
+            values[m_offsets[i] + index] = ReadMetric(snapshot, { Metric(i), index });
+          }
+        }
+      }
+    private:
+      uint32_t m_offsets[uint32_t(Metric::Count)] = {};
+      uint32_t m_counts[uint32_t(Metric::Count)] = {};
+      uint32_t m_channelCount = 0;
+    };
+
+    // 指標ごとの平滑化フィルタ.
+    //  状態はフィルタを適用するチャンネルごとの配列 (SoA) で保持し、採取のたびに1回の走査で更新する.
+    //  領域は初期化時に確保し、採取中はメモリ確保を行わない.
+    class MetricFilterSet
+    {
+    public:
+      void Initialize(const std::vector<MetricFilter>& filters, const ChannelLayout& layout)
+      {
+        // 後に指定したものを優先するため、チャンネルごとの設定を先に決める.
+        std::vector<const MetricFilter*> channelFilters(layout.GetChannelCount(), nullptr);
+        for (auto& filter : filters)
+        {
+          auto count = IsFilterable(filter.metric) ? layout.GetIndexCount(filter.metric) : 0;
+          for (uint32_t index = 0; index < count; ++index)
+          {
+            channelFilters[layout.ToChannel({ filter.metric, index })] = &filter;
+          }
+        }
+        for (uint32_t channel = 0; channel < layout.GetChannelCount() && m_ids.size() < kMaxFilteredMetrics; ++channel)
+        {
+          auto filter = channelFilters[channel];
+          if (filter == nullptr || filter->type == MetricFilterType::Raw)
+          {
+            continue;
+          }
+          m_ids.push_back(layout.ToMetric(channel));
+          m_groups.push_back(GetMetricGroup(filter->metric));
+          m_types.push_back(filter->type);
+          m_timeConstants.push_back((std::max)(filter->timeConstantMilliSeconds, 0.0));
+          m_sampleWeights.push_back((std::clamp)(filter->sampleWeight, 0.0, 1.0));
+          m_windowSizes.push_back(uint8_t((std::clamp)(filter->windowSize, 1u, kMaxMedianWindow)));
+        }
+        auto count = m_ids.size();
+        m_states.assign(count, 0.0);
+        m_timestamps.assign(count, 0);
+        m_windowCounts.assign(count, 0);
+        m_windowPositions.assign(count, 0);
+        m_windows.assign(count * kMaxMedianWindow, 0.0);
+      }
+
+      // 今回採取されたグループのチャンネルにフィルタを適用し、snapshot の項目を適用後の値で置き換える.
+      void Apply(Snapshot& snapshot)
+      {
+        auto count = uint32_t(m_ids.size());
+        snapshot.filteredMetricCount = count;
+        for (uint32_t i = 0; i < count; ++i)
+        {
+          auto& sample = snapshot.filteredMetrics[i];
+          sample.id = m_ids[i];
+          auto timestamp = snapshot.groupTimestamps[uint32_t(m_groups[i])];
+          if (timestamp == m_timestamps[i])
+          {
+            continue;
+          }
+          // 未採取 (kNotCollected) や、まだ存在しないディスクなどは状態を更新しない.
+          auto* field = GetMetricField(snapshot, m_ids[i]);
+          if (field == nullptr || std::isnan(*field))
+          {
+            sample.raw = field ? *field : 0.0;
+            sample.filtered = sample.raw;
+            continue;
+          }
+          auto previousTimestamp = m_timestamps[i];
+          m_timestamps[i] = timestamp;
+          auto raw = *field;
+          auto value = raw;
+          switch (m_types[i])
+          {
+          case MetricFilterType::EMA:
+            if (m_timeConstants[i] <= 0.0)
+            {
+              // (前回 + 今回) * 0.5 と同じ結果になるよう、重みをそれぞれに掛ける.
+              m_states[i] = m_states[i] * (1.0 - m_sampleWeights[i]) + raw * m_sampleWeights[i];
+            }
+            else if (previousTimestamp == 0)
+            {
+              m_states[i] = raw;
+            }
+            else
+            {
+              auto elapsedMilliSeconds = double(timestamp - previousTimestamp) * 1000.0 / double(snapshot.timestampFrequency);
+              m_states[i] += (raw - m_states[i]) * (1.0 - std::exp(-elapsedMilliSeconds / m_timeConstants[i]));
+            }
+            value = m_states[i];
+            break;
+          case MetricFilterType::Median:
+            value = PushMedian(i, raw);
+            break;
+          default:
+            break;
+          }
+          *field = value;
+          sample.raw = raw;
+          sample.filtered = value;
+        }
+      }
+
+    private:
+      // double の項目を持つ指標のみ. CPUUtilization は他の指標のフィルタ適用後の値から求める.
+      static bool IsFilterable(Metric metric)
+      {
+        switch (metric)
+        {
+        case Metric::CPUUtilization:
+        case Metric::CPUThrottled:
+        case Metric::GPUDedicatedMemory:
+        case Metric::GPUSharedMemory:
+        case Metric::GPULocalMemoryBudgetUtilization:
+        case Metric::ProcessWorkingSet:
+        case Metric::ProcessPrivateBytes:
+        case Metric::SystemCommitCharge:
+        case Metric::SystemAvailableMemory:
+        case Metric::SystemStandbyCache:
+          return false;
+        default:
+          return uint32_t(metric) < uint32_t(Metric::Count);
+        }
+      }
+
+      double PushMedian(uint32_t slot, double raw)
+      {
+        auto windowSize = m_windowSizes[slot];
+        auto* window = &m_windows[size_t(slot) * kMaxMedianWindow];
+        window[m_windowPositions[slot]] = raw;
+        m_windowPositions[slot] = uint8_t((m_windowPositions[slot] + 1) % windowSize);
+        m_windowCounts[slot] = (std::min)(uint8_t(m_windowCounts[slot] + 1), windowSize);
+        uint32_t count = m_windowCounts[slot];
+        double sorted[kMaxMedianWindow];
+        std::copy_n(window, count, sorted);
+        std::sort(sorted, sorted + count);
+        return (count & 1) ? sorted[count / 2] : (sorted[count / 2 - 1] + sorted[count / 2]) * 0.5;
+      }
+
+      std::vector<MetricId> m_ids;
+      std::vector<CounterGroup> m_groups;
+      std::vector<MetricFilterType> m_types;
+      // EMA の時定数 (ms). 0 の場合は m_sampleWeights を使用する.
+      std::vector<double> m_timeConstants;
+      std::vector<double> m_sampleWeights;
+      std::vector<uint8_t> m_windowSizes;
+      std::vector<double> m_states;
+      // 最後にフィルタを適用したグループの採取時刻.
+      std::vector<int64_t> m_timestamps;
+      std::vector<uint8_t> m_windowCounts;
+      std::vector<uint8_t> m_windowPositions;
+      // Median の直近の値. チャンネルごとに kMaxMedianWindow 個ずつ.
+      std::vector<double> m_windows;
+    };
+
+    // チャンネルごとの固定長リングバッファによる履歴.
+    //  書き込みはワーカースレッドのみ. 読み込み側はロックを取らず、読み込み中に上書きされた古いサンプルは捨てる.
+    class MetricHistory
+    {
+    public:
+      void Initialize(uint32_t capacity, uint32_t channelCount)
+      {
+        m_capacity = (std::min)(capacity, kMaxHistoryCapacity);
+        m_channelCount = channelCount;
+        if (m_capacity == 0)
+        {
+          return;
+        }
+        m_timestamps = std::make_unique<std::atomic<int64_t>[]>(m_capacity);
+        m_values = std::make_unique<std::atomic<double>[]>(size_t(m_capacity) * m_channelCount);
+      }
+      bool IsEnabled() const
+      {
+        return m_capacity != 0;
+      }
+
+      void Push(int64_t timestamp, const double* values)
+      {
+        auto index = m_head.load(std::memory_order_relaxed);
+        auto slot = uint32_t(index % m_capacity);
+        m_writing.store(index + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        m_timestamps[slot].store(timestamp, std::memory_order_relaxed);
+        for (uint32_t channel = 0; channel < m_channelCount; ++channel)
+        {
+          m_values[size_t(channel) * m_capacity + slot].store(values[channel], std::memory_order_relaxed);
+        }
+        m_head.store(index + 1, std::memory_order_release);
+      }
+
+      // 新しい順に、since 以降のサンプルを最大 limit 個 store(i, timestamp, value) に渡す.
+      //  戻り値は有効なサンプル数で、それ以降に渡したサンプルは使用しないこと.
+      template<class Store>
+      uint32_t Read(uint32_t channel, int64_t since, size_t limit, Store&& store) const
+      {
+        if (!IsEnabled() || channel >= m_channelCount)
+        {
+          return 0;
+        }
+        auto head = m_head.load(std::memory_order_acquire);
+        limit = size_t((std::min)(uint64_t(limit), (std::min)(uint64_t(m_capacity), head)));
+        uint32_t count = 0;
+        auto values = &m_values[size_t(channel) * m_capacity];
+        for (; count < limit; ++count)
+        {
+          auto slot = uint32_t((head - 1 - count) % m_capacity);
+          auto timestamp = m_timestamps[slot].load(std::memory_order_relaxed);
+          if (timestamp < since)
+          {
+            break;
+          }
+          store(count, timestamp, values[slot].load(std::memory_order_relaxed));
+        }
+
+        // 読み込み中に書き込みが始まったスロットのサンプルは無効とする.
+        std::atomic_thread_fence(std::memory_order_acquire);
+        auto writing = m_writing.load(std::memory_order_relaxed);
+        auto oldestValid = writing > m_capacity ? writing - m_capacity : 0;
+        while (count > 0 && head - count < oldestValid)
+        {
+          count--;
+        }
+        return count;
+      }
+
+      uint32_t Read(uint32_t channel, int64_t since, std::span<MetricSample> samples) const
+      {
+        return Read(channel, since, samples.size(), [&](uint32_t i, int64_t timestamp, double value) {
+          samples[i] = { timestamp, value };
+        });
+      }
+
+      bool GetStatistics(uint32_t channel, int64_t since, MetricStatistics& statistics) const
+      {
+        double values[kMaxHistoryCapacity];
+        auto count = Read(channel, since, kMaxHistoryCapacity, [&](uint32_t i, int64_t, double value) {
+          values[i] = value;
+        });
+        if (count == 0)
+        {
+          return false;
+        }
+        double sum = 0;
+        statistics.min = values[0];
+        statistics.max = values[0];
+        for (uint32_t i = 0; i < count; ++i)
+        {
+          auto value = values[i];
+          sum += value;
+          statistics.min = (std::min)(statistics.min, value);
+          statistics.max = (std::max)(statistics.max, value);
+        }
+        statistics.sampleCount = count;
+        statistics.mean = sum / count;
+        statistics.p95 = Percentile(values, count, 0.95);
+        statistics.p99 = Percentile(values, count, 0.99);
+        return true;
+      }
+    private:
+      // 最近傍順位法によるパーセンタイル. values は並べ替えられる.
+      static double Percentile(double* values, uint32_t count, double ratio)
+      {
+        auto rank = uint32_t(std::ceil(ratio * count));
+        auto nth = values + (std::max)(1u, rank) - 1;
+        std::nth_element(values, nth, values + count);
+        return *nth;
+      }
+
+      uint32_t m_capacity = 0;
+      uint32_t m_channelCount = 0;
+      std::unique_ptr<std::atomic<int64_t>[]> m_timestamps;
+      std::unique_ptr<std::atomic<double>[]> m_values;
+      std::atomic<uint64_t> m_head = 0;
+      std::atomic<uint64_t> m_writing = 0;
+    };
+
+    // 閾値トリガーの一覧と判定.
+    //  登録・解除は任意のスレッドから、判定と通知はワーカースレッドから行う.
+    class TriggerSet
+    {
+    public:
+      uint32_t Add(const TriggerDesc& desc)
+      {
+        auto state = std::make_shared<State>();
+        state->desc = desc;
+        std::lock_guard lock(m_mutex);
+        state->id = m_nextId++;
+        m_triggers.push_back(state);
+        return state->id;
+      }
+      // isDispatchThread = false の場合、通知中であれば終わるまで待つ.
+      bool Remove(uint32_t triggerId, bool isDispatchThread)
+      {
+        std::shared_ptr<State> removed;
+        {
+          std::lock_guard lock(m_mutex);
+          auto it = std::find_if(m_triggers.begin(), m_triggers.end(), [&](const auto& state) { return state->id == triggerId; });
+          if (it == m_triggers.end())
+          {
+            return false;
+          }
+          removed = *it;
+          m_triggers.erase(it);
+        }
+        removed->removed.store(true, std::memory_order_release);
+        if (!isDispatchThread)
+        {
+          std::lock_guard dispatchLock(m_dispatchMutex);
+        }
+        return true;
+      }
+      // 公開したスナップショットで条件を判定し、状態が変化したトリガーを通知する.
+      void Evaluate(const Snapshot& snapshot)
+      {
+        {
+          std::lock_guard lock(m_mutex);
+          for (auto& state : m_triggers)
+          {
+            TriggerEvent event;
+            if (UpdateState(*state, snapshot, event))
+            {
+              m_pending.emplace_back(state, event);
+            }
+          }
+        }
+        if (m_pending.empty())
+        {
+          return;
+        }
+
+        // コールバック内から Add/Remove を呼べるよう、一覧のロックの外で通知する.
+        std::lock_guard dispatchLock(m_dispatchMutex);
+        for (auto& [state, event] : m_pending)
+        {
+          if (state->removed.load(std::memory_order_acquire))
+          {
+            continue;
+          }
+#if defined(_WIN32)
+          if (state->desc.event)
+          {
+            if (event.active)
+            {
+              SetEvent(state->desc.event);
+            }
+            else
+            {
+              ResetEvent(state->desc.event);
+            }
+          }
+#endif
+          if (state->desc.callback)
+          {
+            state->desc.callback(event);
+          }
+        }
+        m_pending.clear();
+      }
+    private:
+      struct State
+      {
+        uint32_t id = kInvalidTriggerId;
+        TriggerDesc desc;
+        bool active = false;
+        // 条件を満たし始めた時刻.
+        bool conditionMet = false;
+        int64_t conditionSince = 0;
+        std::atomic<bool> removed = false;
+      };
+
+      // 状態が変化した場合は true を返し、event に通知内容を格納する.
+      static bool UpdateState(State& state, const Snapshot& snapshot, TriggerEvent& event)
+      {
+        auto& desc = state.desc;
+        auto value = ReadMetric(snapshot, desc.metric);
+        if (std::isnan(value))
+        {
+          state.conditionMet = false;
+          return false;
+        }
+        bool above = desc.condition == TriggerCondition::Above;
+        if (!state.active)
+        {
+          if (above ? value <= desc.threshold : value >= desc.threshold)
+          {
+            state.conditionMet = false;
+            return false;
+          }
+          if (!state.conditionMet)
+          {
+            state.conditionMet = true;
+            state.conditionSince = snapshot.timestamp;
+          }
+          auto elapsed = snapshot.timestamp - state.conditionSince;
+          if (elapsed * 1000 < int64_t(desc.durationMilliSeconds) * snapshot.timestampFrequency)
+          {
+            return false;
+          }
+          state.active = true;
+        }
+        else
+        {
+          auto releaseThreshold = above ? desc.threshold - desc.hysteresis : desc.threshold + desc.hysteresis;
+          if (above ? value >= releaseThreshold : value <= releaseThreshold)
+          {
+            return false;
+          }
+          state.active = false;
+          state.conditionMet = false;
+        }
+        event = { state.id, desc.metric, value, state.active, snapshot.timestamp };
+        return true;
+      }
+
+      std::mutex m_mutex;
+      std::vector<std::shared_ptr<State>> m_triggers;
+      uint32_t m_nextId = kInvalidTriggerId + 1;
+      // 通知中は保持する. 解除した後にコールバックが呼ばれないようにするため.
+      std::mutex m_dispatchMutex;
+      // 通知待ちのトリガー (ワーカースレッドのみが使用する).
+      std::vector<std::pair<std::shared_ptr<State>, TriggerEvent>> m_pending;
+    };
+
+    // 記録ファイルのヘッダ. この後ろにチャンネル表 (RecordingChannel x channelCount) とブロックが並ぶ.
+    //  ブロックは固定長で、キーフレーム1つと差分レコード (keyframeInterval - 1) 個からなる.
+    //  - キーフレーム: int64_t 時刻 + double 値 x channelCount
+    //  - 差分レコード: uint32_t 直前のレコードからの経過時刻 (deltaTimeFrequency 単位) + float 差分 x channelCount
+    //    経過時刻が 0 のものは欠番 (経過時刻が uint32_t に収まらない場合や、差分で表せない値が現れてブロックを打ち切った場合).
+    //    経過時刻は µs 単位のため、採取間隔が約 71 分までは欠番にならない.
+    struct RecordingHeader
+    {
+      static constexpr uint32_t kMagic = 0x52435054u; // "TPCR"
+      static constexpr uint32_t kVersion = 2;
+      static constexpr int64_t kDeltaTimeFrequency = 1000000;
+      uint32_t magic;
+      uint32_t version;
+      uint32_t channelCount;
+      uint32_t keyframeInterval;
+      int64_t timestampFrequency;
+      uint64_t recordCount;
+      uint32_t keyframeSize;
+      uint32_t deltaSize;
+      uint64_t dataOffset;
+      int64_t deltaTimeFrequency;
+
+      uint64_t GetBlockSize() const
+      {
+        return keyframeSize + uint64_t(deltaSize) * (keyframeInterval - 1);
+      }
+      uint64_t GetRecordOffset(uint64_t index) const
+      {
+        auto slot = index % keyframeInterval;
+        auto offset = dataOffset + (index / keyframeInterval) * GetBlockSize();
+        return slot == 0 ? offset : offset + keyframeSize + (slot - 1) * deltaSize;
+      }
+    };
+    struct RecordingChannel
+    {
+      uint32_t metric;
+      uint32_t index;
+    };
+
+    // 記録ファイルへの書き込み. ワーカースレッドのみが使用する.
+    //  ファイルはメモリマップで書き込み、領域が足りなくなった場合のみ拡張してマップし直す.
+    class MetricRecorder
+    {
+    public:
+      ~MetricRecorder()
+      {
+        Close();
+      }
+      bool Open(const wchar_t* path, const ChannelLayout& layout, int64_t timestampFrequency, uint32_t keyframeInterval)
+      {
+#if defined(_WIN32)
+        m_file = CreateFileW(path, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (m_file == INVALID_HANDLE_VALUE)
+        {
+          m_file = nullptr;
+          return false;
+        }
+#else
+        char filePath[4096];
+        ToUtf8(path, filePath, sizeof(filePath));
+        m_file = open(filePath, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (m_file < 0)
+        {
+          m_file = -1;
+          return false;
+        }
+#endif
+        RecordingHeader header{};
+        header.magic = RecordingHeader::kMagic;
+        header.version = RecordingHeader::kVersion;
+        header.channelCount = layout.GetChannelCount();
+        header.keyframeInterval = (std::max)(keyframeInterval, 1u);
+        header.timestampFrequency = timestampFrequency;
+        header.keyframeSize = uint32_t(sizeof(int64_t) + sizeof(double) * header.channelCount);
+        header.deltaSize = uint32_t(sizeof(uint32_t) + sizeof(float) * header.channelCount);
+        header.dataOffset = (sizeof(RecordingHeader) + sizeof(RecordingChannel) * header.channelCount + 7) & ~uint64_t(7);
+        header.deltaTimeFrequency = RecordingHeader::kDeltaTimeFrequency;
+        if (!Remap(header.dataOffset + header.GetBlockSize()))
+        {
+          return false;
+        }
+        auto channels = reinterpret_cast<RecordingChannel*>(m_view + sizeof(RecordingHeader));
+        for (uint32_t i = 0; i < header.channelCount; ++i)
+        {
+          auto id = layout.ToMetric(i);
+          channels[i] = { uint32_t(id.metric), id.index };
+        }
+        std::memcpy(m_view, &header, sizeof(header));
+        m_header = reinterpret_cast<RecordingHeader*>(m_view);
+        m_keyframe.resize(header.channelCount);
+        return true;
+      }
+      bool IsOpen() const
+      {
+        return m_header != nullptr;
+      }
+      // 1サンプルを書き込む. ファイルを拡張できなかった場合は書き込まずに false を返す.
+      bool Push(int64_t timestamp, const double* values)
+      {
+        auto header = *m_header;
+        auto index = header.recordCount;
+        // キーフレームからの経過時刻を deltaTimeFrequency 単位で丸め、直前のレコードとの差を記録する.
+        //  丸めた経過時刻の差を積み上げるため、読み取り側で誤差が蓄積しない.
+        int64_t elapsed = 0;
+        int64_t step = 0;
+        if (index % header.keyframeInterval != 0)
+        {
+          elapsed = ConvertTimestamp(timestamp - m_keyframeTimestamp, header.timestampFrequency, header.deltaTimeFrequency);
+          step = (std::max)(elapsed - m_previousElapsed, int64_t(1));
+        }
+        if (index % header.keyframeInterval != 0 &&
+          (step >= 0xFFFFFFFFll || !CanEncodeDelta(values, header.channelCount)))
+        {
+          // 経過時刻や差分が収まらない場合は、残りを欠番としてブロックを打ち切る.
+          index += header.keyframeInterval - index % header.keyframeInterval;
+        }
+        auto offset = header.GetRecordOffset(index);
+        auto size = index % header.keyframeInterval == 0 ? header.keyframeSize : header.deltaSize;
+        if (offset + size > m_viewSize)
+        {
+          // 失敗した場合も元のマップは残るため、書き込み済みの分はそのまま読み取れる.
+          if (!Remap((std::max)(m_viewSize + kGrowSize, offset + size)))
+          {
+            return false;
+          }
+          m_header = reinterpret_cast<RecordingHeader*>(m_view);
+        }
+
+        auto record = m_view + offset;
+        if (index % header.keyframeInterval == 0)
+        {
+          std::memcpy(record, &timestamp, sizeof(timestamp));
+          std::memcpy(record + sizeof(timestamp), values, sizeof(double) * header.channelCount);
+          std::copy_n(values, header.channelCount, m_keyframe.begin());
+          m_keyframeTimestamp = timestamp;
+          m_previousElapsed = 0;
+        }
+        else
+        {
+          auto encoded = uint32_t(step);
+          std::memcpy(record, &encoded, sizeof(encoded));
+          m_previousElapsed += step;
+          auto deltas = record + sizeof(encoded);
+          for (uint32_t i = 0; i < header.channelCount; ++i)
+          {
+            auto delta = float(values[i] - m_keyframe[i]);
+            std::memcpy(deltas + sizeof(float) * i, &delta, sizeof(float));
+          }
+        }
+        m_header->recordCount = index + 1;
+        return true;
+      }
+      // 書き込んだ分にファイルを切り詰めて閉じる.
+      void Close()
+      {
+        uint64_t fileSize = 0;
+        if (m_header)
+        {
+          fileSize = m_header->recordCount > 0 ? (std::min)(m_viewSize, m_header->GetRecordOffset(m_header->recordCount)) : m_header->dataOffset;
+          m_header = nullptr;
+        }
+        Unmap();
+#if defined(_WIN32)
+        if (m_file)
+        {
+          if (fileSize > 0)
+          {
+            LARGE_INTEGER position;
+            position.QuadPart = LONGLONG(fileSize);
+            SetFilePointerEx(m_file, position, nullptr, FILE_BEGIN);
+            SetEndOfFile(m_file);
+          }
+          CloseHandle(m_file);
+          m_file = nullptr;
+        }
+#else
+        if (m_file >= 0)
+        {
+          if (fileSize > 0)
+          {
+            // 切り詰めに失敗した場合も、末尾の未使用領域が残るだけで記録は読み取れるため、結果は使わない.
+            auto result = ftruncate(m_file, off_t(fileSize));
+            static_cast<void>(result);
+          }
+          close(m_file);
+          m_file = -1;
+        }
+#endif
+      }
+    private:
+      static constexpr uint64_t kGrowSize = 16ull * 1024 * 1024;
+      // 差分から復元した値に許す誤差 (値の大きさに対する割合. 1 未満の値は 1 に対する割合).
+      static constexpr double kDeltaTolerance = 1.0 / (1 << 16);
+
+      // キーフレームとの float の差分で、values を復元できるか.
+      //  キーフレームが NaN の場合 (未採取から採取済みへの切り替わり) や、UINT64_MAX などの大きな値と
+      //  通常の値が入れ替わった場合は、差分が NaN になるか桁落ちするため、キーフレームから記録し直す.
+      bool CanEncodeDelta(const double* values, uint32_t channelCount) const
+      {
+        for (uint32_t i = 0; i < channelCount; ++i)
+        {
+          auto value = values[i];
+          auto restored = m_keyframe[i] + double(float(value - m_keyframe[i]));
+          if (std::isnan(value) ? !std::isnan(restored) :
+            !(std::abs(restored - value) <= (std::max)(std::abs(value), 1.0) * kDeltaTolerance))
+          {
+            return false;
+          }
+        }
+        return true;
+      }
+
+      // ファイルを size まで拡張してマップし直す.
+      //  新しいマップが成功してから元のマップを解除する. 失敗した場合は元のマップのまま false を返す.
+      bool Remap(uint64_t size)
+      {
+#if defined(_WIN32)
+        auto mapping = CreateFileMappingW(m_file, nullptr, PAGE_READWRITE, DWORD(size >> 32), DWORD(size), nullptr);
+        if (mapping == nullptr)
+        {
+          return false;
+        }
+        auto view = static_cast<uint8_t*>(MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, size_t(size)));
+        if (view == nullptr)
+        {
+          CloseHandle(mapping);
+          return false;
+        }
+        Unmap();
+        m_mapping = mapping;
+        m_view = view;
+#else
+        if (ftruncate(m_file, off_t(size)) != 0)
+        {
+          return false;
+        }
+        auto view = mmap(nullptr, size_t(size), PROT_READ | PROT_WRITE, MAP_SHARED, m_file, 0);
+        if (view == MAP_FAILED)
+        {
+          return false;
+        }
+        Unmap();
+        m_view = static_cast<uint8_t*>(view);
+#endif
+        m_viewSize = size;
+        return true;
+      }
+      void Unmap()
+      {
+#if defined(_WIN32)
+        if (m_view)
+        {
+          UnmapViewOfFile(m_view);
+          m_view = nullptr;
+          m_viewSize = 0;
+        }
+        if (m_mapping)
+        {
+          CloseHandle(m_mapping);
+          m_mapping = nullptr;
+        }
+#else
+        if (m_view)
+        {
+          munmap(m_view, size_t(m_viewSize));
+          m_view = nullptr;
+          m_viewSize = 0;
+        }
+#endif
+      }
+
+#if defined(_WIN32)
+      HANDLE m_file = nullptr;
+      HANDLE m_mapping = nullptr;
+#else
+      int m_file = -1;
+#endif
+      uint8_t* m_view = nullptr;
+      uint64_t m_viewSize = 0;
+      RecordingHeader* m_header = nullptr;
+      std::vector<double> m_keyframe;
+      int64_t m_keyframeTimestamp = 0;
+      // キーフレームから直前のレコードまでの経過時刻 (deltaTimeFrequency 単位).
+      int64_t m_previousElapsed = 0;
+    };
+
+    // 採取器の本体. 公開・採取のスケジュール・取得関数・履歴・記録・トリガーはプラットフォームで共通とし、
+    //  カウンタの準備と採取 (Setup* / Collect*) のみプラットフォームごとに実装する.
+    //  Windows は PDH・DXGI・Win32 API、Linux は /proc・/sys のファイル (初期化時に開いておき、採取のたびに pread で読み直す) で採取する.
+    //  Linux の採取中のメモリ確保は、新しいスレッドを見つけた場合と、子孫プロセス・DRM のクライアントが確保済みの数を超えた場合のみ行う.
+    class SimplePerfCounter
+    {
+      // 公開中のスナップショットを読み取る. 読み直し回数と、有効な場合は取得関数の呼び出し回数を数える.
+      //  戻り値の型を推論するため、取得関数より前に定義する.
+      template<class Func>
+      auto ReadPublished(Func&& func)
+      {
+        if (m_countGetterCalls)
+        {
+          m_getterCallCount.fetch_add(1, std::memory_order_relaxed);
+        }
+        uint64_t retryCount = 0;
+        auto result = m_published->Read(func, &retryCount);
+        if (retryCount > 0)
+        {
+          m_getterRetryCount.fetch_add(retryCount, std::memory_order_relaxed);
+        }
+        return result;
+      }
+
+      // 呼び出し元のスレッドが採取中か (トリガーのコールバック内など). m_mutex を取得して呼ぶこと.
+      //  採取の完了を待つ操作は、このスレッドからは完了しない.
+      bool IsSamplingOnCurrentThread() const
+      {
+        return m_sampling && m_samplingThread == std::this_thread::get_id();
+      }
+
+      // m_mutex を取得する. 他のスレッドが保持していて待つことになった場合は数える.
+      void LockMutex(std::unique_lock<std::mutex>& lock)
+      {
+        if (!lock.try_lock())
+        {
+          m_lockContentionCount.fetch_add(1, std::memory_order_relaxed);
+          lock.lock();
+        }
+      }
+      static int64_t QueryTimestamp()
+      {
+        return GetTimestamp();
+      }
+      double ElapsedMicroSeconds(int64_t begin) const
+      {
+        return double(QueryTimestamp() - begin) * 1.0e6 / double(m_timestampFrequency);
+      }
+    public:
+      SimplePerfCounter() = default;
+      ~SimplePerfCounter()
+      {
+        {
+          // スレッド側の終了処理をトリガー. 採取結果を待っているスレッドも起床させる.
+          std::unique_lock lock(m_mutex);
+          m_exit = true;
+          lock.unlock();
+
+          m_condVar.notify_all();
+          m_sampleCondVar.notify_all();
+        }
+        if (m_workerThread.joinable())
+        {
+          m_workerThread.join();
+        }
+        NotifySampleWaiters(false);
+        // 公開を引き継げるよう、公開中のプロセスの記録を消しておく.
+        if (m_sharedHeader && m_published == &m_sharedHeader->buffer)
+        {
+          m_sharedHeader->publisherProcessId.store(0, std::memory_order_release);
+        }
+        ReleasePlatformResources();
+      }
+
+      bool Initialize(const InitParams& initParams)
+      {
+        m_useCpuUtilizationGlobal = initParams.useGlobalCPUUtilization;
+        m_subsystems = initParams.subsystems;
+        m_pid = GetProcessId();
+        m_timestampFrequency = GetTimestampFrequency();
+
+        // 監視対象のプロセス. ジョブオブジェクト (processJob) は Windows のみ.
+        m_rootProcessIds.assign(initParams.processIds.begin(), initParams.processIds.end());
+        if (m_rootProcessIds.empty())
+        {
+          m_rootProcessIds.push_back(m_pid);
+        }
+        m_includeDescendantProcesses = initParams.includeDescendantProcesses;
+        m_dynamicProcessSet = m_includeDescendantProcesses;
+        m_countGetterCalls = initParams.countGetterCalls;
+
+        // カウンタの準備. 採取できない項目はプラットフォームごとに m_subsystems から除く.
+        if (!SetupPlatform(initParams))
+        {
+          return false;
+        }
+        for (uint32_t i = 0; i < kCounterGroupCount; ++i)
+        {
+          auto& group = m_groups[i];
+          auto interval = initParams.groupIntervalMilliSeconds[i];
+          group.interval = std::chrono::milliseconds(interval != 0 ? interval : initParams.checkIntervalMilliSeconds);
+          group.active = IsEnabled(GetGroupSubsystems(CounterGroup(i)));
+        }
+
+        m_channelLayout.Initialize(uint32_t(m_cpuTopology.size()));
+        m_channelValues.resize(m_channelLayout.GetChannelCount());
+        m_filters.Initialize(initParams.metricFilters, m_channelLayout);
+        m_history.Initialize(initParams.historyCapacity, m_channelLayout.GetChannelCount());
+        if (initParams.recordingFilePath &&
+          !m_recorder.Open(initParams.recordingFilePath, m_channelLayout, m_timestampFrequency, initParams.recordingKeyframeInterval))
+        {
+          return false;
+        }
+
+        if (initParams.sharedMemoryName && !SetupSharedMemory(initParams.sharedMemoryName))
+        {
+          return false;
+        }
+
+        // 初回の採取までは、採取対象外の値のみ設定したものを公開しておく.
+        InitializeSnapshot(m_workSnapshot);
+        RefreshTargetProcesses(m_workSnapshot, QueryTimestamp());
+        m_published->Publish(m_workSnapshot);
+
+        m_workerAffinityMask = initParams.workerAffinityMask;
+        m_workerProcessorGroup = initParams.workerProcessorGroup;
+        m_workerThreadPriority = initParams.workerThreadPriority;
+        m_workerThreadName = initParams.workerThreadName ? initParams.workerThreadName : L"";
+        m_exit = false;
+        auto now = std::chrono::steady_clock::now();
+        for (auto& group : m_groups)
+        {
+          group.nextSampleTime = now;
+        }
+        if (initParams.collectionMode == CollectionMode::External)
+        {
+          return SetupSampleTimer();
+        }
+        m_workerThread = std::thread([this] { this->WorkerThread(); });
+        return true;
+      }
+
+      double GetGPUEngineUtilization(const wchar_t* engineName)
+      {
+        return GetGPUEngineUtilizationById(FindGPUEngineId(engineName));
+      }
+      double GetGPUEngineUtilizationById(uint32_t engineId)
+      {
+        return ReadPublished([&](const Snapshot& snapshot) {
+          if ((snapshot.collectedSubsystems & SubsystemGPUEngine) == 0)
+          {
+            return kNotCollected;
+          }
+          if (engineId < (std::min)(snapshot.gpuEngineCount, kMaxGPUEngines))
+          {
+            return snapshot.gpuEngines[engineId].utilization;
+          }
+          return 0.0;
+        });
+      }
+      uint32_t GetGPUEnginesUtilization(std::span<double> utilization)
+      {
+        return ReadPublished([&](const Snapshot& snapshot) {
+          auto count = (std::min)(snapshot.gpuEngineCount, kMaxGPUEngines);
+          auto writeCount = (std::min)(size_t(count), utilization.size());
+          for (size_t i = 0; i < writeCount; ++i)
+          {
+            utilization[i] = snapshot.gpuEngines[i].utilization;
+          }
+          return count;
+        });
+      }
+      uint32_t GetProcesses(std::span<ProcessSample> processes)
+      {
+        return ReadPublished([&](const Snapshot& snapshot) {
+          auto count = (std::min)(snapshot.processCount, kMaxProcesses);
+          std::copy_n(snapshot.processes, (std::min)(size_t(count), processes.size()), processes.begin());
+          return count;
+        });
+      }
+      uint32_t GetGPUAdapters(std::span<GPUAdapterSample> adapters)
+      {
+        return ReadPublished([&](const Snapshot& snapshot) {
+          auto count = (std::min)(snapshot.gpuAdapterCount, kMaxGPUAdapters);
+          auto copyCount = (std::min)(count, uint32_t(adapters.size()));
+          std::copy_n(snapshot.gpuAdapters, copyCount, adapters.begin());
+          return count;
+        });
+      }
+      uint32_t GetGPUEngineInstances(std::span<GPUEngineInstanceSample> instances)
+      {
+        return ReadPublished([&](const Snapshot& snapshot) {
+          auto count = (std::min)(snapshot.gpuEngineInstanceCount, kMaxGPUEngineInstances);
+          auto copyCount = (std::min)(count, uint32_t(instances.size()));
+          std::copy_n(snapshot.gpuEngineInstances, copyCount, instances.begin());
+          return count;
+        });
+      }
+      void GetGPUEngineUtilization(std::vector<std::wstring>& nameList)
+      {
+        nameList.clear();
+        auto count = m_gpuEngineNameCount.load(std::memory_order_acquire);
+        for (uint32_t i = 0; i < count; ++i)
+        {
+          nameList.emplace_back(m_gpuEngineNames[i]);
+        }
+      }
+      uint32_t GetGPUEngineNames(std::span<const wchar_t*> names)
+      {
+        auto count = m_gpuEngineNameCount.load(std::memory_order_acquire);
+        auto writeCount = (std::min)(size_t(count), names.size());
+        for (size_t i = 0; i < writeCount; ++i)
+        {
+          names[i] = m_gpuEngineNames[i];
+        }
+        return count;
+      }
+      uint32_t FindGPUEngineId(const wchar_t* engineName)
+      {
+        auto count = m_gpuEngineNameCount.load(std::memory_order_acquire);
+        for (uint32_t i = 0; i < count; ++i)
+        {
+          if (wcsncmp(m_gpuEngineNames[i], engineName, kMaxGPUEngineNameLength) == 0)
+          {
+            return i;
+          }
+        }
+        return kInvalidGPUEngineId;
+      }
+      uint64_t GetUsedGPUDedicatedMemory()
+      {
+        return ReadPublished([](const Snapshot& snapshot) { return snapshot.gpuDedicatedMemory; });
+      }
+      uint64_t GetUsedGPUSharedMemory()
+      {
+        return ReadPublished([](const Snapshot& snapshot) { return snapshot.gpuSharedMemory; });
+      }
+      double GetCPUUtilization()
+      {
+        return ReadPublished([](const Snapshot& snapshot) { return snapshot.cpuUtilization; });
+      }
+      std::vector<double> GetCPUCoresUtilization()
+      {
+        std::vector<double> cpuCoresUsage;
+        ReadPublished([&](const Snapshot& snapshot) {
+          auto count = (std::min)(snapshot.cpuCoreCount, kMaxCPUCores);
+          cpuCoresUsage.assign(snapshot.cpuCoresUtilization, snapshot.cpuCoresUtilization + count);
+          return true;
+        });
+        return cpuCoresUsage;
+      }
+      uint32_t GetCPUCoresUtilization(std::span<double> coresUtilization)
+      {
+        return ReadPublished([&](const Snapshot& snapshot) {
+          auto count = (std::min)(snapshot.cpuCoreCount, kMaxCPUCores);
+          auto writeCount = (std::min)(size_t(count), coresUtilization.size());
+          std::copy_n(snapshot.cpuCoresUtilization, writeCount, coresUtilization.begin());
+          return count;
+        });
+      }
+      uint32_t GetCPUNumaNodesUtilization(std::span<double> nodesUtilization)
+      {
+        return ReadPublished([&](const Snapshot& snapshot) {
+          auto count = (std::min)(snapshot.cpuNumaNodeCount, kMaxCPUNumaNodes);
+          std::copy_n(snapshot.cpuNumaNodesUtilization, (std::min)(size_t(count), nodesUtilization.size()), nodesUtilization.begin());
+          return count;
+        });
+      }
+      uint32_t GetCPUPackagesUtilization(std::span<double> packagesUtilization)
+      {
+        return ReadPublished([&](const Snapshot& snapshot) {
+          auto count = (std::min)(snapshot.cpuPackageCount, kMaxCPUPackages);
+          std::copy_n(snapshot.cpuPackagesUtilization, (std::min)(size_t(count), packagesUtilization.size()), packagesUtilization.begin());
+          return count;
+        });
+      }
+      uint32_t GetCPUCoresFrequency(std::span<CPUFrequencySample> coresFrequency)
+      {
+        return ReadPublished([&](const Snapshot& snapshot) {
+          auto count = (std::min)(snapshot.cpuCoreCount, kMaxCPUCores);
+          std::copy_n(snapshot.cpuCoresFrequency, (std::min)(size_t(count), coresFrequency.size()), coresFrequency.begin());
+          return count;
+        });
+      }
+      CPUThrottleSample GetCPUThrottle()
+      {
+        return ReadPublished([](const Snapshot& snapshot) { return snapshot.cpuThrottle; });
+      }
+      uint32_t GetFilteredMetrics(std::span<FilteredMetricSample> metrics)
+      {
+        return ReadPublished([&](const Snapshot& snapshot) {
+          auto count = (std::min)(snapshot.filteredMetricCount, kMaxFilteredMetrics);
+          std::copy_n(snapshot.filteredMetrics, (std::min)(size_t(count), metrics.size()), metrics.begin());
+          return count;
+        });
+      }
+      uint32_t GetCPUTopology(std::span<LogicalProcessorInfo> processors)
+      {
+        // 構成情報は初期化時に確定し、以降変更されない.
+        auto count = uint32_t(m_cpuTopology.size());
+        std::copy_n(m_cpuTopology.begin(), (std::min)(size_t(count), processors.size()), processors.begin());
+        return count;
+      }
+      uint32_t GetThreadsUtilization(std::span<ThreadSample> threads)
+      {
+        return ReadPublished([&](const Snapshot& snapshot) {
+          auto count = (std::min)(snapshot.threadCount, kMaxThreads);
+          std::copy_n(snapshot.threads, (std::min)(size_t(count), threads.size()), threads.begin());
+          return count;
+        });
+      }
+      MemorySample GetMemoryUsage()
+      {
+        return ReadPublished([](const Snapshot& snapshot) { return snapshot.memory; });
+      }
+      uint32_t GetDisks(std::span<DiskSample> disks)
+      {
+        return ReadPublished([&](const Snapshot& snapshot) {
+          auto count = (std::min)(snapshot.diskCount, kMaxDisks);
+          std::copy_n(snapshot.disks, (std::min)(size_t(count), disks.size()), disks.begin());
+          return count;
+        });
+      }
+      uint32_t GetNetworkInterfaces(std::span<NetworkInterfaceSample> interfaces)
+      {
+        return ReadPublished([&](const Snapshot& snapshot) {
+          auto count = (std::min)(snapshot.networkInterfaceCount, kMaxNetworkInterfaces);
+          std::copy_n(snapshot.networkInterfaces, (std::min)(size_t(count), interfaces.size()), interfaces.begin());
+          return count;
+        });
+      }
+      double GetMetricValue(MetricId metric)
+      {
+        return ReadPublished([&](const Snapshot& snapshot) { return ReadMetric(snapshot, metric); });
+      }
+      bool GetMetricStatistics(MetricId metric, uint32_t windowMilliSeconds, MetricStatistics& statistics)
+      {
+        if (auto subsystem = GetMetricSubsystem(metric.metric); subsystem != 0 && !IsEnabled(subsystem))
+        {
+          return false;
+        }
+        auto since = QueryTimestamp() - int64_t(windowMilliSeconds) * m_timestampFrequency / 1000;
+        return m_history.GetStatistics(m_channelLayout.ToChannel(metric), since, statistics);
+      }
+      uint32_t GetMetricHistory(MetricId metric, std::span<MetricSample> samples)
+      {
+        return m_history.Read(m_channelLayout.ToChannel(metric), INT64_MIN, samples);
+      }
+      void ResetPeakCPU()
+      {
+        m_cpuUsagePeak.store(0.0, std::memory_order_relaxed);
+      }
+      double GetPeakCPUUtilization()
+      {
+        return m_cpuUsagePeak.load(std::memory_order_relaxed);
+      }
+      bool SampleNow(uint32_t timeoutMilliSeconds)
+      {
+        std::unique_lock lock(m_mutex, std::defer_lock);
+        LockMutex(lock);
+        // 採取中のスレッド (トリガーのコールバックなど) から待つと、採取が完了しないため待たずに失敗する.
+        if (timeoutMilliSeconds > 0 && IsSamplingOnCurrentThread())
+        {
+          return false;
+        }
+        // 採取中の場合、その結果は要求より前に開始したものなので、さらに次の採取を待つ.
+        auto target = m_completedSampleCount + (m_sampling ? 2 : 1);
+        m_sampleRequested = true;
+        m_condVar.notify_all();
+        if (GetSampleEvent())
+        {
+          ArmSampleTimer(true);
+        }
+        if (timeoutMilliSeconds == 0)
+        {
+          return true;
+        }
+        return m_sampleCondVar.wait_for(lock, std::chrono::milliseconds(timeoutMilliSeconds), [&] {
+          return m_exit || m_completedSampleCount >= target;
+        }) && !m_exit;
+      }
+      bool WaitForNextSample(uint32_t timeoutMilliSeconds)
+      {
+        std::unique_lock lock(m_mutex, std::defer_lock);
+        LockMutex(lock);
+        if (IsSamplingOnCurrentThread())
+        {
+          return false;
+        }
+        auto target = m_completedSampleCount + 1;
+        return m_sampleCondVar.wait_for(lock, std::chrono::milliseconds(timeoutMilliSeconds), [&] {
+          return m_exit || m_completedSampleCount >= target;
+        }) && !m_exit;
+      }
+      bool AddSampleWaiter(SampleWaiter* waiter)
+      {
+        auto head = m_sampleWaiters.load(std::memory_order_relaxed);
+        do
+        {
+          waiter->next = head;
+        } while (!m_sampleWaiters.compare_exchange_weak(head, waiter, std::memory_order_release, std::memory_order_relaxed));
+        // 終了処理と重なった場合に取り残されないよう、自分で通知する.
+        if (m_exit.load())
+        {
+          NotifySampleWaiters(false);
+        }
+        return true;
+      }
+#if defined(_WIN32)
+      void* GetSampleEvent() const
+      {
+        return m_sampleTimer;
+      }
+#else
+      // Linux では timerfd (読み取り可能になるまで poll などで待機する).
+      void* GetSampleEvent() const
+      {
+        return m_sampleTimer >= 0 ? reinterpret_cast<void*>(intptr_t(m_sampleTimer)) : nullptr;
+      }
+#endif
+      bool ProcessSampleEvent()
+      {
+        if (!ResetSampleEvent())
+        {
+          return false;
+        }
+        std::unique_lock lock(m_mutex, std::defer_lock);
+        LockMutex(lock);
+        // 複数のスレッドから同時に呼び出された場合は、先に呼び出した側のみが採取する.
+        if (m_sampling || m_exit)
+        {
+          return false;
+        }
+        // タイマーの揺らぎで期限の直前に起床した場合も、その周期の採取として扱う.
+        auto published = RunSampleCycle(lock, m_sampleTimerPeriod / 2);
+        if (m_sampleTimerRearmed)
+        {
+          // SampleNow() で早めた周期を元に戻す.
+          m_sampleTimerRearmed = false;
+          ArmSampleTimer(false);
+        }
+        return published;
+      }
+      uint32_t AddTrigger(const TriggerDesc& desc)
+      {
+        return m_triggers.Add(desc);
+      }
+
+      // コールバックは採取中のスレッド (ワーカースレッド、または External の場合の呼び出し元) で呼ばれる.
+      //  そのスレッドからの解除では、通知の完了を待たない. 待つ間に m_mutex を保持しないよう、判定後に解放する.
+      bool RemoveTrigger(uint32_t triggerId)
+      {
+        std::unique_lock lock(m_mutex, std::defer_lock);
+        LockMutex(lock);
+        bool isDispatchThread = IsSamplingOnCurrentThread();
+        lock.unlock();
+        return m_triggers.Remove(triggerId, isDispatchThread);
+      }
+
+      bool WriteChromeTrace(const wchar_t* path, uint32_t windowMilliSeconds)
+      {
+#if defined(_WIN32)
+        FILE* fp = nullptr;
+        if (_wfopen_s(&fp, path, L"wb") != 0 || fp == nullptr)
+        {
+          return false;
+        }
+#else
+        char filePath[4096];
+        ToUtf8(path, filePath, sizeof(filePath));
+        FILE* fp = fopen(filePath, "wb");
+        if (fp == nullptr)
+        {
+          return false;
+        }
+#endif
+        int64_t since = INT64_MIN;
+        if (windowMilliSeconds > 0)
+        {
+          since = QueryTimestamp() - int64_t(windowMilliSeconds) * m_timestampFrequency / 1000;
+        }
+        auto toMicroseconds = [this](int64_t timestamp) { return double(timestamp) * 1.0e6 / double(m_timestampFrequency); };
+        auto pid = unsigned(m_pid);
+        const char* separator = "";
+        fprintf(fp, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+
+        // カウンタのトラック. 未使用の GPU エンジン ID・アダプタ・ディスク・インターフェースのチャンネルは書き出さない.
+        uint32_t gpuEngineCount = m_gpuEngineNameCount.load(std::memory_order_acquire);
+        uint32_t gpuAdapterCount = m_published->Read([](const Snapshot& snapshot) { return snapshot.gpuAdapterCount; });
+        uint32_t diskCount = m_published->Read([](const Snapshot& snapshot) { return snapshot.diskCount; });
+        uint32_t networkInterfaceCount = m_published->Read([](const Snapshot& snapshot) { return snapshot.networkInterfaceCount; });
+        std::vector<MetricSample> samples(kMaxHistoryCapacity);
+        for (uint32_t channel = 0; channel < m_channelLayout.GetChannelCount(); ++channel)
+        {
+          auto id = m_channelLayout.ToMetric(channel);
+          if (auto subsystem = GetMetricSubsystem(id.metric); subsystem != 0 && !IsEnabled(subsystem))
+          {
+            continue;
+          }
+          char trackName[kMaxGPUEngineNameLength * 4 + 32];
+          if (id.metric == Metric::GPUEngineUtilization)
+          {
+            if (id.index >= gpuEngineCount)
+            {
+              continue;
+            }
+            char engineName[kMaxGPUEngineNameLength * 4] = {};
+            ToUtf8(m_gpuEngineNames[id.index], engineName, sizeof(engineName));
+            snprintf(trackName, sizeof(trackName), "GPU %s Utilization", engineName);
+          }
+          else if (m_channelLayout.GetIndexCount(id.metric) > 1)
+          {
+            if ((id.metric == Metric::GPULocalMemoryBudgetUtilization && id.index >= gpuAdapterCount) ||
+              (GetMetricSubsystem(id.metric) == SubsystemDisk && id.index >= diskCount) ||
+              (GetMetricSubsystem(id.metric) == SubsystemNetwork && id.index >= networkInterfaceCount))
+            {
+              continue;
+            }
+            snprintf(trackName, sizeof(trackName), "%s %u", GetMetricName(id.metric), id.index);
+          }
+          else
+          {
+            snprintf(trackName, sizeof(trackName), "%s", GetMetricName(id.metric));
+          }
+
+          auto count = m_history.Read(channel, since, samples);
+          for (uint32_t i = count; i-- > 0;)
+          {
+            if (std::isnan(samples[i].value))
+            {
+              continue;
+            }
+            fprintf(fp, "%s\n{\"ph\":\"C\",\"pid\":%u,\"name\":", separator, pid);
+            WriteJsonString(fp, trackName);
+            fprintf(fp, ",\"ts\":%.3f,\"args\":{\"value\":%.6g}}", toMicroseconds(samples[i].timestamp), samples[i].value);
+            separator = ",";
+          }
+        }
+
+        // ゾーンのスライス.
+        for (auto& buffer : gZoneRegistry.GetBuffers())
+        {
+          // スレッド名は最初のゾーンの前に書き出す.
+          bool namedThread = false;
+          buffer->ForEach(since, [&](uint32_t threadId, const char* name, int64_t begin, int64_t end) {
+            auto tid = unsigned(threadId);
+            wchar_t threadName[kMaxThreadNameLength] = {};
+            if (!namedThread && gThreadNameRegistry.Find(threadId, threadName))
+            {
+              char utf8Name[kMaxThreadNameLength * 4] = {};
+              ToUtf8(threadName, utf8Name, sizeof(utf8Name));
+              fprintf(fp, "%s\n{\"ph\":\"M\",\"pid\":%u,\"tid\":%u,\"name\":\"thread_name\",\"args\":{\"name\":", separator, pid, tid);
+              WriteJsonString(fp, utf8Name);
+              fprintf(fp, "}}");
+              separator = ",";
+            }
+            namedThread = true;
+            fprintf(fp, "%s\n{\"ph\":\"X\",\"pid\":%u,\"tid\":%u,\"name\":", separator, pid, tid);
+            WriteJsonString(fp, name ? name : "");
+            fprintf(fp, ",\"ts\":%.3f,\"dur\":%.3f}", toMicroseconds(begin), toMicroseconds(end) - toMicroseconds(begin));
+            separator = ",";
+          });
+        }
+        fprintf(fp, "\n]}\n");
+        return fclose(fp) == 0;
+      }
+#if defined(_WIN32)
+      CounterHandle AddCustomCounter(const wchar_t* counterPath, uint32_t format, const wchar_t* instanceFilter, CounterGroup groupId)
+      {
+        if (counterPath == nullptr || uint32_t(groupId) >= kCounterGroupCount)
+        {
+          return {};
+        }
+        std::unique_lock lock(m_mutex, std::defer_lock);
+        LockMutex(lock);
+        // PDH のクエリは採取と同時に操作できないため、採取の完了を待つ.
+        if (IsSamplingOnCurrentThread())
+        {
+          return {};
+        }
+        m_sampleCondVar.wait(lock, [this] { return !m_sampling || m_exit; });
+        auto index = m_customCounterCount.load(std::memory_order_relaxed);
+        if (m_exit || index == kMaxCustomCounters)
+        {
+          return {};
+        }
+        auto counter = std::make_unique<CustomCounter>();
+        counter->hCounter = AddCounter(groupId, counterPath);
+        if (!counter->hCounter)
+        {
+          return {};
+        }
+        counter->group = groupId;
+        counter->format = PDH_FMT_DOUBLE |
+          ((format & CounterFormatNoCap100) ? PDH_FMT_NOCAP100 : 0) |
+          ((format & CounterFormatNoScale) ? PDH_FMT_NOSCALE : 0) |
+          ((format & CounterFormatMultiply1000) ? PDH_FMT_1000 : 0);
+        counter->instanceFilter = instanceFilter ? instanceFilter : L"";
+        m_customCounters[index] = std::move(counter);
+        m_customCounterCount.store(index + 1, std::memory_order_release);
+
+        // 採取対象の項目を持たないグループは、ここから採取を始める.
+        auto& group = m_groups[uint32_t(groupId)];
+        if (!group.active)
+        {
+          group.active = true;
+          group.nextSampleTime = std::chrono::steady_clock::now();
+          NotifyScheduleChanged();
+        }
+        return { index };
+      }
+#else
+      // AddCounter (PDH のカウンタ) は Windows のみ. 登録できないため、無効なハンドルを返す.
+      CounterHandle AddCustomCounter(const wchar_t*, uint32_t, const wchar_t*, CounterGroup)
+      {
+        return {};
+      }
+#endif
+      double GetCounterValue(CounterHandle handle, uint32_t instance)
+      {
+        if (handle.index >= kMaxCustomCounters || instance >= kMaxCustomCounterInstances)
+        {
+          return kNotCollected;
+        }
+        return ReadPublished([&](const Snapshot& snapshot) {
+          auto& counter = snapshot.customCounters[handle.index];
+          return handle.index < snapshot.customCounterCount && instance < counter.instanceCount ? counter.values[instance] : kNotCollected;
+        });
+      }
+      uint32_t GetCounterValues(CounterHandle handle, std::span<double> values)
+      {
+        if (handle.index >= kMaxCustomCounters)
+        {
+          return 0;
+        }
+        return ReadPublished([&](const Snapshot& snapshot) {
+          if (handle.index >= snapshot.customCounterCount)
+          {
+            return 0u;
+          }
+          auto& counter = snapshot.customCounters[handle.index];
+          auto count = (std::min)(counter.instanceCount, kMaxCustomCounterInstances);
+          std::copy_n(counter.values, (std::min)(size_t(count), values.size()), values.begin());
+          return count;
+        });
+      }
+#if defined(_WIN32)
+      const wchar_t* GetCounterInstanceName(CounterHandle handle, uint32_t instance)
+      {
+        if (handle.index >= m_customCounterCount.load(std::memory_order_acquire))
+        {
+          return nullptr;
+        }
+        // 名前は公開前に書き込まれ、以降は変わらない. 公開済みのインスタンス数の範囲のみ参照する.
+        auto instanceCount = ReadPublished([&](const Snapshot& snapshot) {
+          return handle.index < snapshot.customCounterCount ? snapshot.customCounters[handle.index].instanceCount : 0u;
+        });
+        return instance < instanceCount ? m_customCounters[handle.index]->names[instance] : nullptr;
+      }
+#else
+      const wchar_t* GetCounterInstanceName(CounterHandle, uint32_t)
+      {
+        return nullptr;
+      }
+#endif
+      bool IsCollected(uint32_t subsystems) const
+      {
+        return (m_subsystems & subsystems) == subsystems;
+      }
+      void GetSnapshot(Snapshot& snapshot)
+      {
+        ReadPublished([&](const Snapshot& src) { std::memcpy(&snapshot, &src, sizeof(Snapshot)); return true; });
+      }
+    private:
+      std::thread m_workerThread;
+      std::atomic<bool> m_exit;
+      std::mutex m_mutex;
+      std::condition_variable m_condVar;
+      std::condition_variable m_sampleCondVar;
+
+      // ---- 以下メンバは、m_mutex で保護する変数群.
+      bool m_sampleRequested = false;
+      bool m_sampling = false;
+      // 採取中のスレッド. ワーカースレッド、または CollectionMode::External の場合の呼び出し元.
+      std::thread::id m_samplingThread;
+      uint64_t m_completedSampleCount = 0;
+      bool m_sampleTimerRearmed = false;
+      // グループの有効化などで採取スケジュールが変わった. ワーカースレッドは次の期限を計算し直す.
+      bool m_scheduleChanged = false;
+      // ------------------
+      // 負荷の計測用. 取得関数を呼ぶスレッドが書き込むため、他のメンバとはキャッシュラインを分ける.
+      alignas(64) std::atomic<uint64_t> m_getterCallCount = 0;
+      std::atomic<uint64_t> m_getterRetryCount = 0;
+      std::atomic<uint64_t> m_lockContentionCount = 0;
+      alignas(64) double m_postSampleMicroSeconds = 0;
+      // 記録できなかったサンプル数. 公開後に記録するため、postSampleMicroSeconds と同じく次の採取の値として公開する.
+      uint64_t m_recordingDroppedCount = 0;
+      uint32_t m_pid = 0xFFFFFFFFu;
+      uint32_t m_logicalProcessorCount = 0;
+
+      std::vector<LogicalProcessorInfo> m_cpuTopology;
+      uint32_t m_cpuNumaNodeCount = 0;
+      uint32_t m_cpuPackageCount = 0;
+
+      // カウンタのグループごとの採取スケジュール. Windows ではグループごとに別の PDH クエリを持つ.
+      struct CounterGroupState
+      {
+#if defined(_WIN32)
+        PDH_HQUERY query = {};
+        // 登録したカウンタ数. 0 の場合は PdhCollectQueryData を呼ばない.
+        uint32_t counterCount = 0;
+#endif
+        bool active = false;
+        std::chrono::milliseconds interval{};
+        std::chrono::steady_clock::time_point nextSampleTime;
+      } m_groups[kCounterGroupCount];
+
+      bool m_useCpuUtilizationGlobal = true;
+      // 取得関数の呼び出し回数を数えるか. 初期化後は変わらない.
+      bool m_countGetterCalls = false;
+
+      // 監視対象のプロセス.
+      std::vector<uint32_t> m_rootProcessIds;
+      bool m_includeDescendantProcesses = false;
+      // 子孫プロセスやジョブを監視する場合、構成を定期的に取得し直す.
+      bool m_dynamicProcessSet = false;
+      int64_t m_processSetRefreshTimestamp = 0;
+
+      uint32_t m_subsystems = SubsystemDefault;
+
+      // NextSample() で採取結果の公開を待っている待機のスタック.
+      std::atomic<SampleWaiter*> m_sampleWaiters = nullptr;
+
+      // CollectionMode::External の場合の、採取周期.
+      std::chrono::milliseconds m_sampleTimerPeriod{};
+
+      // ワーカースレッドの実行設定.
+      uint64_t m_workerAffinityMask = 0;
+      uint32_t m_workerProcessorGroup = 0;
+      int m_workerThreadPriority = 0;
+      std::wstring m_workerThreadName;
+      uint32_t m_threadNameVersion = 0;
+      int64_t m_threadNameRefreshTimestamp = 0;
+      int64_t m_timestampFrequency = 0;
+
+      // GPU アダプタ・エンジンインスタンスの登録表 (ワーカースレッドのみが更新する).
+      //  追記のみ行うため、インデックスは変化しない.
+      GPUAdapterSample m_gpuAdapters[kMaxGPUAdapters] = {};
+      uint32_t m_gpuAdapterCount = 0;
+      GPUEngineInstanceSample m_gpuEngineInstanceEntries[kMaxGPUEngineInstances] = {};
+      uint32_t m_gpuEngineInstanceCount = 0;
+      // Linux ではプロセスごとの値 (DRM fdinfo・NVML) から集計するため、常に PDH と同じ扱いとなる.
+      GPUMemoryBackend m_gpuMemoryBackend = GPUMemoryBackend::PDH;
+
+      SeqLockBuffer<Snapshot> m_localPublished;
+      SharedSnapshotHeader* m_sharedHeader = nullptr;
+
+      // ワーカースレッドで値を組み立てる作業用領域.
+      Snapshot m_workSnapshot{};
+      double m_gpuEngineUtilization[kMaxGPUEngines] = {};
+      double m_cpuCoresUsage[kMaxCPUCores] = {};
+
+      ChannelLayout m_channelLayout;
+      std::vector<double> m_channelValues;
+      MetricFilterSet m_filters;
+
+      // ---- 以下メンバは、ワーカースレッドから公開される変数群.
+      // 共有メモリで公開する場合は、共有メモリ内のバッファを指す.
+      SeqLockBuffer<Snapshot>* m_published = &m_localPublished;
+      MetricHistory m_history;
+      TriggerSet m_triggers;
+      MetricRecorder m_recorder;
+      std::atomic<double> m_cpuUsagePeak = 0;
+
+      // GPU エンジン名の登録表. 追記のみ行うため、ID (インデックス) は変化しない.
+      wchar_t m_gpuEngineNames[kMaxGPUEngines][kMaxGPUEngineNameLength] = {};
+      std::atomic<uint32_t> m_gpuEngineNameCount = 0;
+      // ------------------
+
+#if defined(_WIN32)
+      // プロセッサグループごとの、通し番号の開始位置.
+      std::vector<uint32_t> m_processorGroupOffsets;
+
+      PDH_HCOUNTER m_hGpuDedicateMem = {}, m_hGpuSharedMem = {};
+      PDH_HCOUNTER m_hGpuUsage = {};
+      PDH_HCOUNTER m_hCpuUsage = {};
+      PDH_HCOUNTER m_hCpuUsageGlobal = {};
+      PDH_HCOUNTER m_hCpuPerformance = {}, m_hCpuFrequency = {}, m_hCpuPerformanceLimit = {}, m_hCpuPerformanceLimitFlags = {};
+      PDH_HCOUNTER m_hThermalPassiveLimit = {}, m_hThermalThrottleReasons = {};
+      PDH_HCOUNTER m_hMemoryStandbyCache[3] = {};
+      PDH_HCOUNTER m_hMemoryPageFaults = {}, m_hMemoryPageReads = {}, m_hMemoryPages = {};
+      PDH_HCOUNTER m_hDiskReadBytes = {}, m_hDiskWriteBytes = {}, m_hDiskReads = {}, m_hDiskWrites = {}, m_hDiskQueueLength = {};
+      PDH_HCOUNTER m_hNetworkReceivedBytes = {}, m_hNetworkSentBytes = {};
+
+      PDH_HQUERY m_pdhProcessCounterPathQuery = {};
+      std::vector<uint8_t> m_workBuffer;
+
+      InstanceNameCache<GPUInstanceInfo> m_gpuEngineInstances;
+      InstanceNameCache<GPUInstanceInfo> m_gpuDedicatedMemInstances;
+      InstanceNameCache<GPUInstanceInfo> m_gpuSharedMemInstances;
+      InstanceNameCache<CPUInstanceInfo> m_cpuInstances;
+      // 性能・周波数のカウンタごとのインスタンス名キャッシュ. 並びは % Processor Utility と一致するとは限らない.
+      InstanceNameCache<CPUInstanceInfo> m_cpuFrequencyInstances[4];
+      InstanceNameCache<IOInstanceInfo> m_thermalZoneInstances[2];
+      // カウンタごとのインスタンス名キャッシュ. スロットの割り当ては名前ごとに共通.
+      InstanceNameCache<IOInstanceInfo> m_diskInstances[5];
+      InstanceNameCache<IOInstanceInfo> m_networkInstances[2];
+      wchar_t m_diskNames[kMaxDisks][kMaxIOInstanceNameLength] = {};
+      uint32_t m_diskCount = 0;
+      wchar_t m_networkInterfaceNames[kMaxNetworkInterfaces][kMaxIOInstanceNameLength] = {};
+      uint32_t m_networkInterfaceCount = 0;
+
+      // AddCounter で登録したカウンタ. 登録は採取していない間に m_mutex を取って行い、解除はしない.
+      struct CustomCounter
+      {
+        PDH_HCOUNTER hCounter = {};
+        CounterGroup group = CounterGroup::CPU;
+        DWORD format = PDH_FMT_DOUBLE;
+        std::wstring instanceFilter;
+        InstanceNameCache<IOInstanceInfo> instances;
+        // インスタンス名. 書き込みはワーカースレッドのみで、追加した名前は変わらない.
+        wchar_t names[kMaxCustomCounterInstances][kMaxIOInstanceNameLength] = {};
+        uint32_t nameCount = 0;
+      };
+      std::unique_ptr<CustomCounter> m_customCounters[kMaxCustomCounters];
+      std::atomic<uint32_t> m_customCounterCount = 0;
+      RawCounterSample m_cpuUsagePreviousRaw;
+      bool m_useRawCounters = false;
+      ProcessCPUBackend m_processCpuBackend = ProcessCPUBackend::ProcessTimes;
+      double m_cpuProcessCyclesPerSecond = 0;
+
+      // 監視対象のプロセス. インデックスは Snapshot::processes と対応する.
+      //  構成の変化時は m_processesWork に組み立てて入れ替え、どちらも kMaxProcesses 分の領域を使い回す.
+      std::vector<ProcessState> m_processes;
+      std::vector<ProcessState> m_processesWork;
+      HANDLE m_processJob = nullptr;
+      std::vector<DWORD> m_processIdsWork;
+      std::vector<std::pair<DWORD, DWORD>> m_parentsWork;
+      // ジョブに属するプロセスの一覧 (JOBOBJECT_BASIC_PROCESS_ID_LIST) の作業領域.
+      std::vector<uint8_t> m_jobProcessListWork;
+
+      // CollectionMode::External の場合の、採取周期のタイマー.
+      HANDLE m_sampleTimer = nullptr;
+
+      ULONG m_workerCpuSetIds[kMaxWorkerCpuSets] = {};
+      ULONG m_workerCpuSetIdCount = 0;
+      bool m_workerEcoQoS = false;
+      // スレッド ID ごとの状態. 一覧は m_threadListRefreshTimestamp から1秒おきに取得し直す.
+      std::unordered_map<DWORD, ThreadState> m_threads;
+      int64_t m_threadListRefreshTimestamp = 0;
+
+      // アダプタのインデックスに対応する DXGI アダプタ. IDXGIAdapter3 が使用できない場合は null.
+      IDXGIAdapter3* m_dxgiAdapters[kMaxGPUAdapters] = {};
+      uint32_t m_dxgiAdapterCount = 0;
+
+      HANDLE m_sharedMemory = nullptr;
+#elif defined(__linux__)
+      // /proc のファイルの読み取り用. 不足した場合のみ拡張する.
+      std::vector<char> m_workBuffer;
+      // getdents64 の読み取り用.
+      std::vector<char> m_directoryBuffer;
+
+      // /proc/stat. 1回の読み取りで、システム全体とコアごとの値を得る.
+      ProcFile m_procStat;
+      struct CPUStatSample
+      {
+        uint64_t busy = 0;
+        uint64_t total = 0;
+      };
+      CPUStatSample m_cpuGlobalPrevious;
+      std::vector<CPUStatSample> m_cpuCoresPrevious;
+      double m_nanoSecondsPerClockTick = 1.0e7;
+      uint64_t m_pageSize = 4096;
+
+      // 論理プロセッサごとの cpufreq (/sys/devices/system/cpu/cpuN/cpufreq).
+      struct CPUFrequencySource
+      {
+        ProcFile current;   // scaling_cur_freq (kHz).
+        ProcFile limit;     // scaling_max_freq (kHz).
+        double nominalMHz = 0;
+        double maximumMHz = 0;
+      };
+      std::vector<CPUFrequencySource> m_cpuFrequencySources;
+      // パッケージごとの温度によるスロットリングの回数 (thermal_throttle/package_throttle_count).
+      struct PackageThrottleState
+      {
+        ProcFile count;
+        uint64_t previous = 0;
+        bool valid = false;
+      } m_packageThrottles[kMaxCPUPackages];
+
+      ProcFile m_procMemInfo;
+      ProcFile m_procVmStat;
+      // pgfault, pgmajfault, pswpin, pswpout の前回値. m_vmStatTimestamp = 0 の場合は未取得.
+      uint64_t m_vmStatPrevious[4] = {};
+      int64_t m_vmStatTimestamp = 0;
+
+      ProcFile m_procDiskStats;
+      ProcFile m_procNetDev;
+      DeviceRegistry<kMaxDisks> m_disks;
+      DeviceRegistry<kMaxNetworkInterfaces> m_networkInterfaces;
+      struct DiskCounters
+      {
+        uint64_t sectorsRead = 0;
+        uint64_t sectorsWritten = 0;
+        uint64_t reads = 0;
+        uint64_t writes = 0;
+        bool valid = false;
+      } m_diskPrevious[kMaxDisks];
+      int64_t m_diskTimestamp = 0;
+      struct NetworkCounters
+      {
+        uint64_t receivedBytes = 0;
+        uint64_t sentBytes = 0;
+        bool valid = false;
+      } m_networkPrevious[kMaxNetworkInterfaces];
+      int64_t m_networkTimestamp = 0;
+      // 監視対象のプロセス. インデックスは Snapshot::processes と対応する.
+      //  構成の変化時は m_processesWork に組み立てて入れ替え、どちらも kMaxProcesses 分の領域を使い回す.
+      std::vector<ProcessState> m_processes;
+      std::vector<ProcessState> m_processesWork;
+      std::vector<uint32_t> m_processIdsWork;
+      std::vector<std::pair<uint32_t, uint32_t>> m_parentsWork;
+      // /proc と /proc/self/task. 列挙のたびに先頭に戻して読み直す.
+      int m_procDirectory = -1;
+      int m_taskDirectory = -1;
+
+      // CollectionMode::External の場合の、採取周期のタイマー (timerfd).
+      int m_sampleTimer = -1;
+
+      // スレッド ID ごとの状態. 要素の確保は新しいスレッドを見つけた場合のみ行う.
+      std::unordered_map<uint32_t, ThreadState> m_threads;
+
+      // 監視対象のプロセスが開いている DRM のファイル. 1秒おき、またはプロセスの構成の変化時に取得し直す.
+      //  領域は kMaxDrmClients 分を確保しておき、それを超える場合のみ拡張する.
+      std::vector<DrmClient> m_drmClients;
+      int64_t m_drmRefreshTimestamp = 0;
+      uint64_t m_drmRefreshSequence = 0;
+      bool m_drmClientsInvalidated = true;
+      DrmFdInfo m_drmFdInfo{};
+
+      // NVML で採取するアダプタ. 使用率は NVML のエンジンの分類 (SM・エンコーダ・デコーダ) ごとに扱う.
+      static constexpr uint32_t kNvmlEngineCount = 3;
+      NvmlLibrary m_nvml;
+      struct NvmlDevice
+      {
+        NvmlLibrary::Device handle = nullptr;
+        uint32_t adapterIndex = kInvalidGPUAdapterIndex;
+        // nvmlDeviceGetProcessUtilization で前回取得したサンプルの時刻.
+        unsigned long long lastSeenTimeStamp = 0;
+        // 監視対象のプロセスごとの最新の使用率と、それを取得した時刻.
+        double utilization[kMaxProcesses][kNvmlEngineCount] = {};
+        int64_t utilizationTimestamp[kMaxProcesses] = {};
+        uint32_t engineInstanceIndices[kNvmlEngineCount] = {};
+      } m_nvmlDevices[kMaxGPUAdapters];
+      uint32_t m_nvmlDeviceCount = 0;
+      uint32_t m_nvmlEngineIds[kNvmlEngineCount] = { kInvalidGPUEngineId, kInvalidGPUEngineId, kInvalidGPUEngineId };
+      // アダプタのインデックスに対応するアダプタを NVML で採取するか. DRM fdinfo の値は使用しない.
+      bool m_nvmlAdapters[kMaxGPUAdapters] = {};
+      std::vector<NvmlLibrary::ProcessUtilizationSample> m_nvmlSamples;
+      std::vector<NvmlLibrary::ProcessInfo> m_nvmlProcesses;
+#endif
+    private:
+
+      // グループに属する項目.
+      static uint32_t GetGroupSubsystems(CounterGroup group)
+      {
+        switch (group)
+        {
+        case CounterGroup::CPU:
+          return SubsystemCPUGlobal | SubsystemCPUProcess | SubsystemCPUCores | SubsystemCPUFrequency;
+        case CounterGroup::GPUEngine:
+          return SubsystemGPUEngine;
+        case CounterGroup::GPUMemory:
+          return SubsystemGPUMemory;
+        case CounterGroup::CPUThreads:
+          return SubsystemCPUThreads;
+        case CounterGroup::Memory:
+          return SubsystemMemory;
+        case CounterGroup::IO:
+          return SubsystemProcessIO | SubsystemDisk | SubsystemNetwork;
+        default:
+          return 0;
+        }
+      }
+
+      // いずれかの項目が有効か.
+      bool IsEnabled(uint32_t subsystems) const
+      {
+        return (m_subsystems & subsystems) != 0;
+      }
+
+      // 採取対象外の値を設定する.
+      void InitializeSnapshot(Snapshot& snapshot) const
+      {
+        snapshot.timestampFrequency = m_timestampFrequency;
+        snapshot.collectedSubsystems = m_subsystems;
+        snapshot.gpuMemoryBackend = m_gpuMemoryBackend;
+        if (!IsEnabled(SubsystemCPUGlobal))
+        {
+          snapshot.cpuUtilizationGlobal = kNotCollected;
+        }
+        if (!IsEnabled(SubsystemCPUProcess))
+        {
+          snapshot.cpuUtilizationProcess = kNotCollected;
+          snapshot.cpuProcessCyclesPerSecond = kNotCollected;
+        }
+        if (!IsEnabled(m_useCpuUtilizationGlobal ? SubsystemCPUGlobal : SubsystemCPUProcess))
+        {
+          snapshot.cpuUtilization = kNotCollected;
+          snapshot.cpuPeakUtilization = kNotCollected;
+        }
+        if (!IsEnabled(SubsystemCPUFrequency))
+        {
+          CPUFrequencySample frequency = { kNotCollected, kNotCollected, kNotCollected, kNotCollected, 0 };
+          CPUThrottleSample throttle = { kNotCollected, kNotCollected, kNotCollected, 0, false };
+          std::fill_n(snapshot.cpuCoresFrequency, kMaxCPUCores, frequency);
+          std::fill_n(snapshot.cpuPackagesThrottle, kMaxCPUPackages, throttle);
+          snapshot.cpuThrottle = throttle;
+          snapshot.cpuThermalPassiveLimitPercent = kNotCollected;
+          snapshot.cpuThermalThrottleReasons = 0;
+        }
+        if (!IsEnabled(SubsystemGPUMemory))
+        {
+          snapshot.gpuDedicatedMemory = kNotCollectedBytes;
+          snapshot.gpuSharedMemory = kNotCollectedBytes;
+        }
+        if (!IsEnabled(SubsystemMemory))
+        {
+          snapshot.memory = NotCollectedMemorySample();
+        }
+        if (!IsEnabled(SubsystemProcessIO))
+        {
+          snapshot.processIO = { kNotCollected, kNotCollected, kNotCollected, kNotCollected };
+        }
+      }
+
+      // エンジン名に対応する ID を取得. 未登録の場合は登録する.
+      uint32_t RegisterGPUEngine(const wchar_t* engineName, size_t length)
+      {
+        length = (std::min)(length, size_t(kMaxGPUEngineNameLength - 1));
+        auto count = m_gpuEngineNameCount.load(std::memory_order_relaxed);
+        for (uint32_t i = 0; i < count; ++i)
+        {
+          if (wcsncmp(m_gpuEngineNames[i], engineName, length) == 0 && m_gpuEngineNames[i][length] == L'\0')
+          {
+            return i;
+          }
+        }
+        if (count == kMaxGPUEngines)
+        {
+          return kInvalidGPUEngineId;
+        }
+        wmemcpy(m_gpuEngineNames[count], engineName, length);
+        m_gpuEngineNames[count][length] = L'\0';
+        m_gpuEngineNameCount.store(count + 1, std::memory_order_release);
+        return count;
+      }
+      // 公開用の共有メモリを作成し、m_published をその中のバッファに切り替える.
+      //  同名の領域が既にある場合 (前回の公開側の終了後も読み取り側が開いている場合など) は引き継ぐ.
+      //  記録された公開側のプロセスが実行中の場合は、二重に公開しないよう false を返す.
+      bool SetupSharedMemory(const wchar_t* name)
+      {
+        bool created = false;
+        m_sharedHeader = MapSharedMemory(name, created);
+        if (m_sharedHeader == nullptr)
+        {
+          return false;
+        }
+        if (created)
+        {
+          // 領域を初期化するのは作成したプロセスのみ. magic を書き込むまで、他のプロセスは引き継がない.
+          new (m_sharedHeader) SharedSnapshotHeader();
+          m_sharedHeader->version = SharedSnapshotHeader::kVersion;
+          m_sharedHeader->snapshotSize = uint32_t(sizeof(Snapshot));
+          m_sharedHeader->publisherProcessId.store(m_pid, std::memory_order_relaxed);
+          m_sharedHeader->magic.store(SharedSnapshotHeader::kMagic, std::memory_order_release);
+        }
+        else
+        {
+          // 作成したプロセスが初期化中 (magic が未設定) の場合や、形式が異なる場合は公開しない.
+          if (!m_sharedHeader->IsValid())
+          {
+            return false;
+          }
+          // 公開側が終了済み (0) か、異常終了している場合のみ引き継ぐ.
+          //  同時に引き継ごうとした場合も1つのみ成功するよう、比較しながら書き込む.
+          auto publisher = m_sharedHeader->publisherProcessId.load(std::memory_order_acquire);
+          if ((publisher != 0 && IsProcessAlive(publisher)) ||
+            !m_sharedHeader->publisherProcessId.compare_exchange_strong(publisher, m_pid, std::memory_order_acq_rel))
+          {
+            return false;
+          }
+        }
+        m_published = &m_sharedHeader->buffer;
+        return true;
+      }
+
+      // LUID に対応するアダプタのインデックスを取得. 未登録の場合は登録する.
+      uint32_t RegisterGPUAdapter(uint64_t luid)
+      {
+        for (uint32_t i = 0; i < m_gpuAdapterCount; ++i)
+        {
+          if (m_gpuAdapters[i].luid == luid)
+          {
+            return i;
+          }
+        }
+        if (m_gpuAdapterCount == kMaxGPUAdapters)
+        {
+          return kInvalidGPUAdapterIndex;
+        }
+        auto& adapter = m_gpuAdapters[m_gpuAdapterCount];
+        adapter.luid = luid;
+        adapter.dedicatedMemory = IsEnabled(SubsystemGPUMemory) ? 0 : kNotCollectedBytes;
+        adapter.sharedMemory = adapter.dedicatedMemory;
+        adapter.localMemory = { kNotCollectedBytes, kNotCollectedBytes, kNotCollectedBytes, kNotCollectedBytes };
+        adapter.nonLocalMemory = adapter.localMemory;
+        adapter.overBudget = false;
+        std::fill(std::begin(adapter.enginesUtilization), std::end(adapter.enginesUtilization), IsEnabled(SubsystemGPUEngine) ? 0.0 : kNotCollected);
+        return m_gpuAdapterCount++;
+      }
+
+      // 新たに登録されたアダプタ・エンジンインスタンスを snapshot に反映する.
+      void SyncGPURegistry(Snapshot& snapshot)
+      {
+        for (uint32_t i = snapshot.gpuAdapterCount; i < m_gpuAdapterCount; ++i)
+        {
+          snapshot.gpuAdapters[i] = m_gpuAdapters[i];
+        }
+        snapshot.gpuAdapterCount = m_gpuAdapterCount;
+        for (uint32_t i = snapshot.gpuEngineInstanceCount; i < m_gpuEngineInstanceCount; ++i)
+        {
+          snapshot.gpuEngineInstances[i] = m_gpuEngineInstanceEntries[i];
+        }
+        snapshot.gpuEngineInstanceCount = m_gpuEngineInstanceCount;
+      }
+
+      // 論理プロセッサごとの性能を集計し、温度による制限と合わせて snapshot に格納する.
+      void UpdateCPUFrequency(Snapshot& snapshot, uint32_t cpuCoreCount)
+      {
+        auto throttle = [](const CPUFrequencySample& frequency, CPUThrottleSample& sample) {
+          sample.performancePercent += frequency.performancePercent;
+          sample.effectiveFrequencyMHz += frequency.effectiveFrequencyMHz;
+          sample.performanceLimitPercent = (std::min)(sample.performanceLimitPercent, frequency.performanceLimitPercent);
+          sample.performanceLimitFlags |= frequency.performanceLimitFlags;
+        };
+        auto average = [](CPUThrottleSample& sample, uint32_t processorCount) {
+          sample.performancePercent /= (std::max)(1u, processorCount);
+          sample.effectiveFrequencyMHz /= (std::max)(1u, processorCount);
+          sample.throttled = sample.performanceLimitPercent < 100.0;
+        };
+        CPUThrottleSample empty = { 0.0, 0.0, 100.0, 0, false };
+        auto& total = snapshot.cpuThrottle;
+        total = empty;
+        std::fill_n(snapshot.cpuPackagesThrottle, m_cpuPackageCount, empty);
+        uint32_t packageProcessors[kMaxCPUPackages] = {};
+        for (uint32_t i = 0; i < cpuCoreCount; ++i)
+        {
+          auto& frequency = snapshot.cpuCoresFrequency[i];
+          auto package = m_cpuTopology[i].package;
+          throttle(frequency, total);
+          throttle(frequency, snapshot.cpuPackagesThrottle[package]);
+          packageProcessors[package]++;
+        }
+        average(total, cpuCoreCount);
+        for (uint32_t i = 0; i < m_cpuPackageCount; ++i)
+        {
+          average(snapshot.cpuPackagesThrottle[i], packageProcessors[i]);
+        }
+        snapshot.cpuCoreCount = cpuCoreCount;
+        snapshot.cpuPackageCount = m_cpuPackageCount;
+        CollectThermalThrottle(snapshot);
+        total.throttled = total.throttled || snapshot.cpuThermalPassiveLimitPercent < 100.0 || snapshot.cpuThermalThrottleReasons != 0;
+      }
+
+      // フィルタ適用後の値から GetCPUUtilization() の値とピーク値を求める.
+      void UpdateCPUUtilization(Snapshot& snapshot)
+      {
+        // ピーク値はリセットと競合しないよう CAS で更新する.
+        if (IsEnabled(m_useCpuUtilizationGlobal ? SubsystemCPUGlobal : SubsystemCPUProcess))
+        {
+          double current = m_useCpuUtilizationGlobal ? snapshot.cpuUtilizationGlobal : snapshot.cpuUtilizationProcess;
+          double peak = m_cpuUsagePeak.load(std::memory_order_relaxed);
+          while (peak < current && !m_cpuUsagePeak.compare_exchange_weak(peak, current, std::memory_order_relaxed))
+          {
+          }
+          snapshot.cpuUtilization = current;
+          snapshot.cpuPeakUtilization = (std::max)(m_cpuUsagePeak.load(std::memory_order_relaxed), current);
+        }
+      }
+
+      // CPU 使用率を採取して snapshot に格納する.
+      void UpdateCPUUsage(Snapshot& snapshot)
+      {
+        auto cpuCoreCount = CollectCPUUtilization(snapshot);
+        if (IsEnabled(SubsystemCPUFrequency))
+        {
+          UpdateCPUFrequency(snapshot, cpuCoreCount);
+        }
+
+        if (!IsEnabled(SubsystemCPUCores))
+        {
+          return;
+        }
+        snapshot.cpuCoreCount = cpuCoreCount;
+        snapshot.cpuNumaNodeCount = m_cpuNumaNodeCount;
+        snapshot.cpuPackageCount = m_cpuPackageCount;
+        std::fill_n(snapshot.cpuNumaNodesUtilization, m_cpuNumaNodeCount, 0.0);
+        std::fill_n(snapshot.cpuPackagesUtilization, m_cpuPackageCount, 0.0);
+        uint32_t numaNodeProcessors[kMaxCPUNumaNodes] = {};
+        uint32_t packageProcessors[kMaxCPUPackages] = {};
+        for (uint32_t i = 0; i < cpuCoreCount; ++i)
+        {
+          auto usage = (std::min)(m_cpuCoresUsage[i], 100.0);
+          auto& processor = m_cpuTopology[i];
+          snapshot.cpuCoresUtilization[i] = usage;
+          snapshot.cpuNumaNodesUtilization[processor.numaNode] += usage;
+          snapshot.cpuPackagesUtilization[processor.package] += usage;
+          numaNodeProcessors[processor.numaNode]++;
+          packageProcessors[processor.package]++;
+        }
+        for (uint32_t i = 0; i < m_cpuNumaNodeCount; ++i)
+        {
+          snapshot.cpuNumaNodesUtilization[i] /= (std::max)(1u, numaNodeProcessors[i]);
+        }
+        for (uint32_t i = 0; i < m_cpuPackageCount; ++i)
+        {
+          snapshot.cpuPackagesUtilization[i] /= (std::max)(1u, packageProcessors[i]);
+        }
+      }
+
+      // GPU エンジンの使用率を採取して snapshot に格納する.
+      void UpdateGPUEngineUsage(Snapshot& snapshot)
+      {
+        CollectGPUUtilization(snapshot);
+        snapshot.gpuEngineCount = m_gpuEngineNameCount.load(std::memory_order_relaxed);
+        for (uint32_t i = 0; i < snapshot.gpuEngineCount; ++i)
+        {
+          auto& engine = snapshot.gpuEngines[i];
+          wmemcpy(engine.name, m_gpuEngineNames[i], kMaxGPUEngineNameLength);
+          engine.utilization = m_gpuEngineUtilization[i];
+        }
+      }
+
+      // dueGroups (CounterGroup のビット) の項目を採取してスナップショットを公開する.
+      //  公開できた場合は true.
+      bool Sample(uint32_t dueGroups)
+      {
+        auto& stats = m_workSnapshot.collectorStats;
+        auto sampleBegin = QueryTimestamp();
+        stats.instancesScanned = 0;
+        stats.instancesKept = 0;
+
+        uint32_t collectedGroups = 0;
+        for (uint32_t i = 0; i < kCounterGroupCount; ++i)
+        {
+          auto& group = m_groups[i];
+          if ((dueGroups & (1u << i)) == 0 || !group.active)
+          {
+            continue;
+          }
+#if defined(_WIN32)
+          if (group.counterCount > 0)
+          {
+            PDH_STATUS pdhStatus;
+            auto begin = QueryTimestamp();
+            pdhStatus = PdhCollectQueryData(group.query);
+            stats.pdhCollectMicroSeconds[i] = ElapsedMicroSeconds(begin);
+            if (pdhStatus != ERROR_SUCCESS)
+            {
+              continue;
+            }
+          }
+#endif
+          collectedGroups |= 1u << i;
+        }
+        if (collectedGroups == 0)
+        {
+          return false;
+        }
+        auto isCollected = [collectedGroups](CounterGroup group) { return (collectedGroups & (1u << uint32_t(group))) != 0; };
+
+        auto& snapshot = m_workSnapshot;
+        auto timestamp = QueryTimestamp();
+        snapshot.sequence++;
+        snapshot.timestamp = timestamp;
+        {
+          auto begin = QueryTimestamp();
+          RefreshTargetProcesses(snapshot, timestamp);
+          stats.processRefreshMicroSeconds = ElapsedMicroSeconds(begin);
+        }
+        for (uint32_t i = 0; i < kCounterGroupCount; ++i)
+        {
+          if (collectedGroups & (1u << i))
+          {
+            snapshot.groupTimestamps[i] = timestamp;
+          }
+        }
+
+        auto collect = [&](CounterGroup group, auto&& func) {
+          if (isCollected(group))
+          {
+            auto begin = QueryTimestamp();
+            func(snapshot);
+            stats.collectMicroSeconds[uint32_t(group)] = ElapsedMicroSeconds(begin);
+          }
+        };
+        collect(CounterGroup::CPU, [this](Snapshot& snapshot) { UpdateCPUUsage(snapshot); });
+        collect(CounterGroup::GPUEngine, [this](Snapshot& snapshot) { UpdateGPUEngineUsage(snapshot); });
+        collect(CounterGroup::GPUMemory, [this](Snapshot& snapshot) { UpdateGPUMemoryUsage(snapshot); });
+        collect(CounterGroup::CPUThreads, [this](Snapshot& snapshot) { CollectThreadsUsage(snapshot); });
+        collect(CounterGroup::Memory, [this](Snapshot& snapshot) { CollectMemoryUsage(snapshot); });
+        collect(CounterGroup::IO, [this](Snapshot& snapshot) { CollectIOUsage(snapshot); });
+#if defined(_WIN32)
+        CollectCustomCounters(snapshot, collectedGroups);
+#endif
+        m_filters.Apply(snapshot);
+        if (isCollected(CounterGroup::CPU))
+        {
+          UpdateCPUUtilization(snapshot);
+        }
+
+        // 公開後の処理の時間は、次の採取の値として公開する.
+        stats.sampleCount++;
+        stats.sampleMicroSeconds = ElapsedMicroSeconds(sampleBegin);
+        stats.postSampleMicroSeconds = m_postSampleMicroSeconds;
+        stats.totalSampleMicroSeconds += stats.sampleMicroSeconds + m_postSampleMicroSeconds;
+        stats.workBufferBytes = m_workBuffer.size();
+        stats.getterCallCount = m_getterCallCount.load(std::memory_order_relaxed);
+        stats.getterRetryCount = m_getterRetryCount.load(std::memory_order_relaxed);
+        stats.lockContentionCount = m_lockContentionCount.load(std::memory_order_relaxed);
+        stats.recordingDroppedCount = m_recordingDroppedCount;
+        auto postSampleBegin = QueryTimestamp();
+        m_published->Publish(snapshot);
+
+        if (m_history.IsEnabled() || m_recorder.IsOpen())
+        {
+          m_channelLayout.Fill(snapshot, m_channelValues.data());
+          if (m_history.IsEnabled())
+          {
+            m_history.Push(snapshot.timestamp, m_channelValues.data());
+          }
+          if (m_recorder.IsOpen() && !m_recorder.Push(snapshot.timestamp, m_channelValues.data()))
+          {
+            m_recordingDroppedCount++;
+          }
+        }
+        m_triggers.Evaluate(snapshot);
+        NotifySampleWaiters(true);
+        m_postSampleMicroSeconds = ElapsedMicroSeconds(postSampleBegin);
+        return true;
+      }
+
+      // 登録された待機をまとめて取り出し、通知する.
+      void NotifySampleWaiters(bool published)
+      {
+        auto waiter = m_sampleWaiters.exchange(nullptr, std::memory_order_acquire);
+        while (waiter)
+        {
+          // notify で waiter が破棄される可能性があるため、先に次を取り出しておく.
+          auto next = waiter->next;
+          waiter->published = published;
+          waiter->notify(waiter);
+          waiter = next;
+        }
+      }
+
+      // 期限を迎えたグループを採取し、次の期限を更新する. SampleNow() の要求時は全グループを採取する.
+      //  lock (m_mutex) を保持した状態で呼び出す. 採取中はロックを解放する.
+      //  tolerance 以内に期限を迎えるグループも採取する. 公開できた場合は true.
+      bool RunSampleCycle(std::unique_lock<std::mutex>& lock, std::chrono::steady_clock::duration tolerance)
+      {
+        uint32_t dueGroups = 0;
+        auto now = std::chrono::steady_clock::now();
+        for (uint32_t i = 0; i < kCounterGroupCount; ++i)
+        {
+          if (m_sampleRequested || m_groups[i].nextSampleTime <= now + tolerance)
+          {
+            dueGroups |= 1u << i;
+          }
+        }
+        m_sampleRequested = false;
+        m_sampling = true;
+        m_samplingThread = std::this_thread::get_id();
+        lock.unlock();
+        bool published = Sample(dueGroups);
+        LockMutex(lock);
+        m_sampling = false;
+        if (published)
+        {
+          m_completedSampleCount++;
+        }
+        // 採取の完了を待つ AddCounter のため、公開しなかった場合も通知する.
+        m_sampleCondVar.notify_all();
+
+        // 処理が周期に間に合わなかった場合は、遅れを取り戻さずに次の周期から再開する.
+        now = std::chrono::steady_clock::now();
+        for (uint32_t i = 0; i < kCounterGroupCount; ++i)
+        {
+          auto& group = m_groups[i];
+          if (group.active && (dueGroups & (1u << i)))
+          {
+            group.nextSampleTime = (std::max)(group.nextSampleTime + group.interval, now);
+          }
+        }
+        return published;
+      }
+
+      // 次に期限を迎えるグループまで条件変数で待機し、終了要求や SampleNow() で即座に起床する.
+      void WorkerThread()
+      {
+        SetupWorkerThread();
+        std::unique_lock lock(m_mutex);
+        while (!m_exit)
+        {
+          RunSampleCycle(lock, {});
+          m_scheduleChanged = false;
+          auto nextSampleTime = std::chrono::steady_clock::time_point::max();
+          for (auto& group : m_groups)
+          {
+            if (group.active)
+            {
+              nextSampleTime = (std::min)(nextSampleTime, group.nextSampleTime);
+            }
+          }
+          m_condVar.wait_until(lock, nextSampleTime, [this] { return m_exit || m_sampleRequested || m_scheduleChanged; });
+        }
+      }
+
+      // 採取スケジュールの変更 (グループの有効化など) を、ワーカースレッドの待機と外部のタイマーに反映する.
+      //  m_mutex を取得して呼び出す.
+      void NotifyScheduleChanged()
+      {
+        m_scheduleChanged = true;
+        m_condVar.notify_all();
+        if (GetSampleEvent())
+        {
+          UpdateSampleTimerPeriod();
+          ArmSampleTimer(true);
+        }
+      }
+
+      // CollectionMode::External の場合の採取周期のタイマーを作成する.
+      bool SetupSampleTimer()
+      {
+        UpdateSampleTimerPeriod();
+        if (!CreateSampleTimer())
+        {
+          return false;
+        }
+        // 初回はすぐに採取する.
+        return ArmSampleTimer(true);
+      }
+
+      // 採取周期を、有効なグループの最短の採取間隔とする. 各グループは周期ごとに期限を判定する.
+      void UpdateSampleTimerPeriod()
+      {
+        m_sampleTimerPeriod = std::chrono::milliseconds::max();
+        for (auto& group : m_groups)
+        {
+          if (group.active)
+          {
+            m_sampleTimerPeriod = (std::min)(m_sampleTimerPeriod, group.interval);
+          }
+        }
+        if (m_sampleTimerPeriod == std::chrono::milliseconds::max())
+        {
+          m_sampleTimerPeriod = std::chrono::milliseconds(1000);
+        }
+        m_sampleTimerPeriod = (std::max)(m_sampleTimerPeriod, std::chrono::milliseconds(1));
+      }
+
+#if defined(_WIN32)
+      // PDH のクエリ・カウンタと DXGI を準備する. 採取できない項目は m_subsystems から除く.
+      bool SetupPlatform(const InitParams& initParams)
+      {
+        m_useRawCounters = initParams.useRawCounters;
+        m_processCpuBackend = initParams.processCPUBackend;
+        m_gpuMemoryBackend = initParams.gpuMemoryBackend;
+        m_processJob = initParams.processJob;
+        m_dynamicProcessSet = m_dynamicProcessSet || m_processJob != nullptr;
+        if (m_dynamicProcessSet || m_rootProcessIds.size() != 1 || m_rootProcessIds[0] != m_pid)
+        {
+          // PDH のプロセスカウンタと DXGI は自プロセス専用のため、複数プロセスに対応した方法で採取する.
+          m_processCpuBackend = ProcessCPUBackend::ProcessTimes;
+          m_gpuMemoryBackend = GPUMemoryBackend::PDH;
+        }
+        if (m_processCpuBackend == ProcessCPUBackend::PDH && m_useCpuUtilizationGlobal)
+        {
+          m_subsystems &= ~uint32_t(SubsystemCPUProcess);
+        }
+
+        // グループごとに別のクエリとし、期限を迎えたグループのみ採取する.
+        PDH_STATUS status;
+        for (auto& group : m_groups)
+        {
+          status = PdhOpenQueryW(NULL, 0, &group.query);
+          if (status != ERROR_SUCCESS)
+          {
+            return false;
+          }
+        }
+        status = PdhOpenQueryW(NULL, 0, &m_pdhProcessCounterPathQuery);
+        if (status != ERROR_SUCCESS)
+        {
+          return false;
+        }
+
+        SetupCPUTopology();
+        if (IsEnabled(SubsystemGPUEngine | SubsystemGPUMemory))
+        {
+          SetupGPUAdapters();
+        }
+        if (IsEnabled(SubsystemGPUEngine))
+        {
+          SetupCounterGpuUsage();
+        }
+        if (IsEnabled(SubsystemGPUMemory))
+        {
+          if (m_gpuMemoryBackend == GPUMemoryBackend::DXGI && m_dxgiAdapterCount == 0)
+          {
+            m_gpuMemoryBackend = GPUMemoryBackend::PDH;
+          }
+          if (m_gpuMemoryBackend == GPUMemoryBackend::PDH)
+          {
+            SetupCounterGpuDedicatedMemory();
+          }
+        }
+        SetupCounterCpuUsage();
+        if (IsEnabled(SubsystemMemory))
+        {
+          SetupCounterMemory();
+        }
+        SetupCounterIO();
+        m_workBuffer.resize(4096);
+
+        // 監視対象のプロセスの更新でメモリ確保を行わないよう、作業領域を確保しておく.
+        //  子孫プロセスの列挙の作業領域は、システムのプロセス数が確保済みの数を超えた場合のみ拡張する.
+        m_processes.reserve(kMaxProcesses);
+        m_processesWork.reserve(kMaxProcesses);
+        m_processIdsWork.reserve(kMaxProcesses);
+        if (m_processJob)
+        {
+          m_jobProcessListWork.resize(sizeof(JOBOBJECT_BASIC_PROCESS_ID_LIST) + sizeof(ULONG_PTR) * kMaxProcesses);
+        }
+        if (m_includeDescendantProcesses)
+        {
+          m_parentsWork.reserve(4096);
+        }
+        m_workerCpuSetIdCount = ULONG((std::min)(initParams.workerCpuSetIds.size(), size_t(kMaxWorkerCpuSets)));
+        std::copy_n(initParams.workerCpuSetIds.begin(), m_workerCpuSetIdCount, m_workerCpuSetIds);
+        m_workerEcoQoS = initParams.workerEcoQoS;
+        return true;
+      }
+
+      // ワーカースレッドの終了後に、PDH のクエリ・共有メモリ・DXGI アダプタ・ハンドルを解放する.
+      void ReleasePlatformResources()
+      {
+        if (m_sampleTimer)
+        {
+          CancelWaitableTimer(m_sampleTimer);
+          CloseHandle(m_sampleTimer);
+          m_sampleTimer = nullptr;
+        }
+        for (auto& group : m_groups)
+        {
+          if (group.query)
+          {
+            PdhCloseQuery(group.query);
+            group.query = { };
+          }
+        }
+        if (m_pdhProcessCounterPathQuery)
+        {
+          PdhCloseQuery(m_pdhProcessCounterPathQuery);
+          m_pdhProcessCounterPathQuery = {};
+        }
+        if (m_sharedHeader)
+        {
+          UnmapViewOfFile(m_sharedHeader);
+          m_sharedHeader = nullptr;
+          m_published = &m_localPublished;
+        }
+        if (m_sharedMemory)
+        {
+          CloseHandle(m_sharedMemory);
+          m_sharedMemory = nullptr;
+        }
+        for (auto& dxgiAdapter : m_dxgiAdapters)
+        {
+          if (dxgiAdapter)
+          {
+            dxgiAdapter->Release();
+            dxgiAdapter = nullptr;
+          }
+        }
+        for (auto& [threadId, thread] : m_threads)
+        {
+          if (thread.handle)
+          {
+            CloseHandle(thread.handle);
+          }
+        }
+        for (auto& process : m_processes)
+        {
+          if (process.handle)
+          {
+            CloseHandle(process.handle);
+          }
+        }
+      }
+
+      // 全プロセッサグループの論理プロセッサと、コア・NUMA ノード・ソケットの対応を調べる.
+      //  GetSystemInfo は呼び出しスレッドのグループ分しか返さないため使用しない.
+      void SetupCPUTopology()
+      {
+        auto groupCount = GetActiveProcessorGroupCount();
+        m_processorGroupOffsets.assign(groupCount, 0);
+        uint32_t processorCount = 0;
+        for (WORD group = 0; group < groupCount; ++group)
+        {
+          m_processorGroupOffsets[group] = processorCount;
+          processorCount += GetActiveProcessorCount(group);
+        }
+        m_logicalProcessorCount = processorCount;
+
+        m_cpuTopology.resize((std::min)(processorCount, kMaxCPUCores));
+        for (WORD group = 0; group < groupCount; ++group)
+        {
+          auto count = GetActiveProcessorCount(group);
+          for (DWORD number = 0; number < count; ++number)
+          {
+            auto index = ToProcessorIndex(group, number);
+            if (index < m_cpuTopology.size())
+            {
+              m_cpuTopology[index] = { group, uint8_t(number), 0, index, 0, 0 };
+            }
+          }
+        }
+
+        DWORD length = 0;
+        GetLogicalProcessorInformationEx(RelationAll, nullptr, &length);
+        std::vector<uint8_t> buffer(length);
+        auto infoTop = reinterpret_cast<PSYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX>(buffer.data());
+        if (length == 0 || !GetLogicalProcessorInformationEx(RelationAll, infoTop, &length))
+        {
+          m_cpuNumaNodeCount = 1;
+          m_cpuPackageCount = 1;
+          return;
+        }
+
+        auto forEachProcessor = [this](const GROUP_AFFINITY& affinity, auto&& func) {
+          for (uint32_t bit = 0; bit < sizeof(KAFFINITY) * 8; ++bit)
+          {
+            if (affinity.Mask & (KAFFINITY(1) << bit))
+            {
+              auto index = ToProcessorIndex(affinity.Group, bit);
+              if (index < m_cpuTopology.size())
+              {
+                func(m_cpuTopology[index]);
+              }
+            }
+          }
+        };
+
+        uint32_t coreId = 0;
+        uint32_t packageId = 0;
+        uint32_t numaNodeCount = 0;
+        for (DWORD offset = 0; offset < length;)
+        {
+          auto info = reinterpret_cast<PSYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX>(buffer.data() + offset);
+          switch (info->Relationship)
+          {
+          case RelationProcessorCore:
+            for (WORD i = 0; i < info->Processor.GroupCount; ++i)
+            {
+              forEachProcessor(info->Processor.GroupMask[i], [&](LogicalProcessorInfo& processor) {
+                processor.coreId = coreId;
+                processor.efficiencyClass = info->Processor.EfficiencyClass;
+              });
+            }
+            coreId++;
+            break;
+          case RelationProcessorPackage:
+            for (WORD i = 0; i < info->Processor.GroupCount; ++i)
+            {
+              forEachProcessor(info->Processor.GroupMask[i], [&](LogicalProcessorInfo& processor) {
+                processor.package = (std::min)(packageId, kMaxCPUPackages - 1);
+              });
+            }
+            packageId++;
+            break;
+          case RelationNumaNode:
+            {
+              // 古い OS では GroupCount が 0 となり、GroupMask のみ有効.
+              auto nodeNumber = (std::min)(uint32_t(info->NumaNode.NodeNumber), kMaxCPUNumaNodes - 1);
+              WORD maskCount = (std::max)(WORD(1), info->NumaNode.GroupCount);
+              for (WORD i = 0; i < maskCount; ++i)
+              {
+                forEachProcessor(info->NumaNode.GroupMasks[i], [&](LogicalProcessorInfo& processor) {
+                  processor.numaNode = nodeNumber;
+                });
+              }
+              numaNodeCount = (std::max)(numaNodeCount, nodeNumber + 1);
+            }
+            break;
+          default:
+            break;
+          }
+          offset += info->Size;
+        }
+        m_cpuNumaNodeCount = (std::max)(1u, numaNodeCount);
+        m_cpuPackageCount = (std::clamp)(packageId, 1u, kMaxCPUPackages);
+      }
+
+      // プロセッサグループとグループ内の番号から通し番号を求める.
+      uint32_t ToProcessorIndex(uint32_t group, uint32_t number) const
+      {
+        if (group < m_processorGroupOffsets.size())
+        {
+          return m_processorGroupOffsets[group] + number;
+        }
+        return 0xFFFFFFFFu;
+      }
+
+      void SetupCounterGpuDedicatedMemory()
+      {
+        m_hGpuDedicateMem = AddCounter(CounterGroup::GPUMemory, LR"(\GPU Process Memory(*)\Dedicated Usage)");
+        m_hGpuSharedMem = AddCounter(CounterGroup::GPUMemory, LR"(\GPU Process Memory(*)\Shared Usage)");
+      }
+      void SetupCounterGpuUsage()
+      {
+        m_hGpuUsage = AddCounter(CounterGroup::GPUEngine, LR"(\GPU Engine(*)\Utilization Percentage)");
+      }
+      void SetupCounterMemory()
+      {
+        // GetProcessMemoryInfo / GetPerformanceInfo で得られない値のみ PDH で採取する.
+        m_hMemoryStandbyCache[0] = AddCounter(CounterGroup::Memory, LR"(\Memory\Standby Cache Core Bytes)");
+        m_hMemoryStandbyCache[1] = AddCounter(CounterGroup::Memory, LR"(\Memory\Standby Cache Normal Priority Bytes)");
+        m_hMemoryStandbyCache[2] = AddCounter(CounterGroup::Memory, LR"(\Memory\Standby Cache Reserve Bytes)");
+        m_hMemoryPageFaults = AddCounter(CounterGroup::Memory, LR"(\Memory\Page Faults/sec)");
+        m_hMemoryPageReads = AddCounter(CounterGroup::Memory, LR"(\Memory\Page Reads/sec)");
+        m_hMemoryPages = AddCounter(CounterGroup::Memory, LR"(\Memory\Pages/sec)");
+      }
+      void SetupCounterIO()
+      {
+        if (IsEnabled(SubsystemDisk))
+        {
+          m_hDiskReadBytes = AddCounter(CounterGroup::IO, LR"(\PhysicalDisk(*)\Disk Read Bytes/sec)");
+          m_hDiskWriteBytes = AddCounter(CounterGroup::IO, LR"(\PhysicalDisk(*)\Disk Write Bytes/sec)");
+          m_hDiskReads = AddCounter(CounterGroup::IO, LR"(\PhysicalDisk(*)\Disk Reads/sec)");
+          m_hDiskWrites = AddCounter(CounterGroup::IO, LR"(\PhysicalDisk(*)\Disk Writes/sec)");
+          m_hDiskQueueLength = AddCounter(CounterGroup::IO, LR"(\PhysicalDisk(*)\Current Disk Queue Length)");
+        }
+        if (IsEnabled(SubsystemNetwork))
+        {
+          m_hNetworkReceivedBytes = AddCounter(CounterGroup::IO, LR"(\Network Interface(*)\Bytes Received/sec)");
+          m_hNetworkSentBytes = AddCounter(CounterGroup::IO, LR"(\Network Interface(*)\Bytes Sent/sec)");
+        }
+      }
+      void SetupCounterCpuUsage()
+      {
+        // Windows11 タスクマネージャーの値と合う値を得るには、"(\Processor Information(_Total)\% Processor Utility)" を使う.
+        //  こちらのカウンタは、クロック周波数が状況に応じて変化する CPU に対応したものとなっている.
+        //  100% を超える値が取得できることもあるが、タスクマネージャーでは100%にクリップしているそう.
+        if (IsEnabled(SubsystemCPUGlobal | SubsystemCPUCores))
+        {
+          m_hCpuUsageGlobal = AddCounter(CounterGroup::CPU, LR"(\Processor Information(*)\% Processor Utility)");
+        }
+        // % Processor Utility は周波数の変化を含むため、性能の低下が低負荷によるものか
+        //  電力・温度の制限によるものかを区別するには、性能・周波数・上限を別に採取する.
+        if (IsEnabled(SubsystemCPUFrequency))
+        {
+          m_hCpuPerformance = AddCounter(CounterGroup::CPU, LR"(\Processor Information(*)\% Processor Performance)");
+          m_hCpuFrequency = AddCounter(CounterGroup::CPU, LR"(\Processor Information(*)\Processor Frequency)");
+          m_hCpuPerformanceLimit = AddCounter(CounterGroup::CPU, LR"(\Processor Information(*)\% Performance Limit)");
+          m_hCpuPerformanceLimitFlags = AddCounter(CounterGroup::CPU, LR"(\Processor Information(*)\Performance Limit Flags)");
+          m_hThermalPassiveLimit = AddCounter(CounterGroup::CPU, LR"(\Thermal Zone Information(*)\% Passive Limit)");
+          m_hThermalThrottleReasons = AddCounter(CounterGroup::CPU, LR"(\Thermal Zone Information(*)\Throttle Reasons)");
+        }
+
+        // プロセス単位の CPU 使用率を PDH で求める場合のみ、カウンタパスを解決する.
+        if (!IsEnabled(SubsystemCPUProcess) || m_processCpuBackend != ProcessCPUBackend::PDH)
+        {
+          return;
+        }
+        auto counterPath = GetPathMatched(GetProcessPathList());
+        if (counterPath.empty())
+        {
+          return;
+        }
+        m_hCpuUsage = AddCounter(CounterGroup::CPU, counterPath.c_str());
+      }
+
+      // グループのクエリにカウンタを登録する. 失敗した場合は null を返す.
+      PDH_HCOUNTER AddCounter(CounterGroup groupId, const wchar_t* counterPath)
+      {
+        auto& group = m_groups[uint32_t(groupId)];
+        PDH_HCOUNTER hCounter = {};
+        if (PdhAddCounterW(group.query, counterPath, 0, &hCounter) != ERROR_SUCCESS)
+        {
+          return {};
+        }
+        group.counterCount++;
+        return hCounter;
+      }
+
+      // 共有メモリを作成 (同名の領域が既にある場合は開いて) マップする. created にはこの呼び出しで作成したかを返す.
+      SharedSnapshotHeader* MapSharedMemory(const wchar_t* name, bool& created)
+      {
+        m_sharedMemory = CreateFileMappingW(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, 0, DWORD(sizeof(SharedSnapshotHeader)), name);
+        if (m_sharedMemory == nullptr)
+        {
+          return nullptr;
+        }
+        created = GetLastError() != ERROR_ALREADY_EXISTS;
+        return static_cast<SharedSnapshotHeader*>(MapViewOfFile(m_sharedMemory, FILE_MAP_ALL_ACCESS, 0, 0, sizeof(SharedSnapshotHeader)));
+      }
+
+      // DXGI でアダプタを列挙し、名前を登録しておく.
+      void SetupGPUAdapters()
+      {
+        IDXGIFactory1* factory = nullptr;
+        if (FAILED(CreateDXGIFactory1(__uuidof(IDXGIFactory1), reinterpret_cast<void**>(&factory))))
+        {
+          return;
+        }
+        IDXGIAdapter1* adapter = nullptr;
+        for (UINT i = 0; factory->EnumAdapters1(i, &adapter) != DXGI_ERROR_NOT_FOUND; ++i)
+        {
+          DXGI_ADAPTER_DESC1 desc{};
+          if (SUCCEEDED(adapter->GetDesc1(&desc)))
+          {
+            auto luid = (uint64_t(uint32_t(desc.AdapterLuid.HighPart)) << 32) | desc.AdapterLuid.LowPart;
+            auto adapterIndex = RegisterGPUAdapter(luid);
+            if (adapterIndex != kInvalidGPUAdapterIndex)
+            {
+              wcsncpy_s(m_gpuAdapters[adapterIndex].name, desc.Description, _TRUNCATE);
+
+              // メモリ予算の取得用に保持しておく.
+              IDXGIAdapter3* adapter3 = nullptr;
+              if (!m_dxgiAdapters[adapterIndex] && SUCCEEDED(adapter->QueryInterface(__uuidof(IDXGIAdapter3), reinterpret_cast<void**>(&adapter3))))
+              {
+                m_dxgiAdapters[adapterIndex] = adapter3;
+                m_dxgiAdapterCount++;
+              }
+            }
+          }
+          adapter->Release();
+        }
+        factory->Release();
+      }
+
+      // エンジンのインスタンスに対応するインデックスを取得. 未登録の場合は登録する.
+      uint32_t RegisterGPUEngineInstance(const GPUInstanceInfo& info)
+      {
+        for (uint32_t i = 0; i < m_gpuEngineInstanceCount; ++i)
+        {
+          auto& entry = m_gpuEngineInstanceEntries[i];
+          if (entry.adapterIndex == info.adapterIndex && entry.physIndex == info.physIndex && entry.engineIndex == info.engineIndex)
+          {
+            return i;
+          }
+        }
+        if (m_gpuEngineInstanceCount == kMaxGPUEngineInstances)
+        {
+          return kInvalidGPUAdapterIndex;
+        }
+        auto& entry = m_gpuEngineInstanceEntries[m_gpuEngineInstanceCount];
+        entry.adapterIndex = info.adapterIndex;
+        entry.physIndex = info.physIndex;
+        entry.engineIndex = info.engineIndex;
+        entry.engineId = info.engineId;
+        entry.utilization = 0;
+        return m_gpuEngineInstanceCount++;
+      }
+
+      // インスタンス名キャッシュを更新し、走査・集計対象のインスタンス数を記録する.
+      template<class Info, class Item, class Parser>
+      void UpdateInstances(InstanceNameCache<Info>& instances, const Item* items, DWORD itemCount, Parser& parser)
+      {
+        auto& stats = m_workSnapshot.collectorStats;
+        if (instances.Update(items, itemCount, parser))
+        {
+          stats.instanceCacheRebuildCount++;
+        }
+        stats.instancesScanned += itemCount;
+        stats.instancesKept += uint32_t(instances.GetTargetIndices().size());
+      }
+
+      // カウンタ配列を取得する.
+      //  作業バッファで足りる場合は1回の呼び出しで済ませ、不足時 (PDH_MORE_DATA) のみ拡張して取得し直す.
+      template<class Item, class Getter>
+      Item* FetchCounterArray(DWORD& itemCount, Getter&& getter)
+      {
+        for (;;)
+        {
+          DWORD bufferSize = DWORD(m_workBuffer.size());
+          itemCount = 0;
+          auto items = reinterpret_cast<Item*>(m_workBuffer.data());
+          auto status = getter(&bufferSize, &itemCount, items);
+          if (status == PDH_MORE_DATA)
+          {
+            m_workBuffer.resize((std::max)(size_t(bufferSize), m_workBuffer.size() * 2));
+            m_workSnapshot.collectorStats.workBufferResizeCount++;
+            continue;
+          }
+          return status == ERROR_SUCCESS ? items : nullptr;
+        }
+      }
+      PDH_FMT_COUNTERVALUE_ITEM* FetchFormattedCounterArray(PDH_HCOUNTER hCounter, DWORD format, DWORD& itemCount)
+      {
+        return FetchCounterArray<PDH_FMT_COUNTERVALUE_ITEM>(itemCount, [&](DWORD* bufferSize, DWORD* count, PDH_FMT_COUNTERVALUE_ITEM* items) {
+          return PdhGetFormattedCounterArrayW(hCounter, format, bufferSize, count, items);
+        });
+      }
+      PDH_RAW_COUNTER_ITEM_W* FetchRawCounterArray(PDH_HCOUNTER hCounter, DWORD& itemCount)
+      {
+        return FetchCounterArray<PDH_RAW_COUNTER_ITEM_W>(itemCount, [&](DWORD* bufferSize, DWORD* count, PDH_RAW_COUNTER_ITEM_W* items) {
+          return PdhGetRawCounterArrayW(hCounter, bufferSize, count, items);
+        });
+      }
+
+      // 前回値との差分からカウンタ値を計算し、前回値を更新する.
+      static double CalculateFromRaw(PDH_HCOUNTER hCounter, DWORD format, const PDH_RAW_COUNTER& current, RawCounterSample& previous)
+      {
+        double value = 0;
+        auto raw = current;
+        if (previous.valid)
+        {
+          PDH_FMT_COUNTERVALUE counterValue;
+          if (PdhCalculateCounterFromRawValue(hCounter, format, &raw, &previous.raw, &counterValue) == ERROR_SUCCESS)
+          {
+            value = counterValue.doubleValue;
+          }
+        }
+        previous.raw = raw;
+        previous.valid = true;
+        return value;
+      }
+
+      // エンジン ID ごとの使用率を m_gpuEngineUtilization に、
+      //  アダプタ・エンジンインスタンスごとの使用率を snapshot に格納する.
+      void CollectGPUUtilization(Snapshot& snapshot)
+      {
+        auto parser = [this](const wchar_t* name, GPUInstanceInfo& info) {
+          return ParseGPUInstanceName(name, info, true);
+        };
+        auto reset = [&]() {
+          SyncGPURegistry(snapshot);
+          std::fill(std::begin(m_gpuEngineUtilization), std::end(m_gpuEngineUtilization), 0.0);
+          for (uint32_t i = 0; i < snapshot.gpuAdapterCount; ++i)
+          {
+            auto& adapter = snapshot.gpuAdapters[i];
+            std::fill(std::begin(adapter.enginesUtilization), std::end(adapter.enginesUtilization), 0.0);
+          }
+          for (uint32_t i = 0; i < snapshot.gpuEngineInstanceCount; ++i)
+          {
+            snapshot.gpuEngineInstances[i].utilization = 0;
+          }
+          for (uint32_t i = 0; i < snapshot.processCount; ++i)
+          {
+            auto& process = snapshot.processes[i];
+            std::fill(std::begin(process.gpuEnginesUtilization), std::end(process.gpuEnginesUtilization), 0.0);
+          }
+        };
+        auto accumulate = [&](const GPUInstanceInfo& info, double value) {
+          m_gpuEngineUtilization[info.engineId] += value;
+          if (info.adapterIndex != kInvalidGPUAdapterIndex)
+          {
+            snapshot.gpuAdapters[info.adapterIndex].enginesUtilization[info.engineId] += value;
+          }
+          if (info.engineInstanceIndex != kInvalidGPUAdapterIndex)
+          {
+            snapshot.gpuEngineInstances[info.engineInstanceIndex].utilization += value;
+          }
+          snapshot.processes[info.processIndex].gpuEnginesUtilization[info.engineId] += value;
+        };
+        DWORD itemCount = 0;
+        if (m_useRawCounters)
+        {
+          if (auto pdhItems = FetchRawCounterArray(m_hGpuUsage, itemCount))
+          {
+            UpdateInstances(m_gpuEngineInstances, pdhItems, itemCount, parser);
+            reset();
+            for (auto index : m_gpuEngineInstances.GetTargetIndices())
+            {
+              auto& previous = m_gpuEngineInstances.GetPreviousRaw(index);
+              accumulate(m_gpuEngineInstances.GetInfo(index), CalculateFromRaw(m_hGpuUsage, PDH_FMT_DOUBLE, pdhItems[index].RawValue, previous));
+            }
+            return;
+          }
+          reset();
+          return;
+        }
+
+        if (auto pdhItems = FetchFormattedCounterArray(m_hGpuUsage, PDH_FMT_DOUBLE, itemCount))
+        {
+          UpdateInstances(m_gpuEngineInstances, pdhItems, itemCount, parser);
+          reset();
+          for (auto index : m_gpuEngineInstances.GetTargetIndices())
+          {
+            accumulate(m_gpuEngineInstances.GetInfo(index), pdhItems[index].FmtValue.doubleValue);
+          }
+          return;
+        }
+        reset();
+      }
+
+      // 監視対象のプロセスの使用量の合計を返し、アダプタ・プロセスごとの使用量を adapterMemory, processMemory に格納する.
+      uint64_t CollectGPUMemory(PDH_HCOUNTER hCounter, InstanceNameCache<GPUInstanceInfo>& instances,
+        uint64_t (&adapterMemory)[kMaxGPUAdapters], uint64_t (&processMemory)[kMaxProcesses])
+      {
+        uint64_t memAmount = 0;
+        std::fill(std::begin(adapterMemory), std::end(adapterMemory), 0ull);
+        std::fill(std::begin(processMemory), std::end(processMemory), 0ull);
+        auto parser = [this](const wchar_t* name, GPUInstanceInfo& info) {
+          return ParseGPUInstanceName(name, info, false);
+        };
+        auto accumulate = [&](const GPUInstanceInfo& info, uint64_t value) {
+          memAmount += value;
+          if (info.adapterIndex != kInvalidGPUAdapterIndex)
+          {
+            adapterMemory[info.adapterIndex] += value;
+          }
+          processMemory[info.processIndex] += value;
+        };
+        DWORD itemCount = 0;
+        if (m_useRawCounters)
+        {
+          // 使用量は瞬時値のカウンタのため、生データの値がそのまま使用量となる.
+          if (auto pdhItems = FetchRawCounterArray(hCounter, itemCount))
+          {
+            UpdateInstances(instances, pdhItems, itemCount, parser);
+            for (auto index : instances.GetTargetIndices())
+            {
+              accumulate(instances.GetInfo(index), uint64_t(pdhItems[index].RawValue.FirstValue));
+            }
+          }
+          return memAmount;
+        }
+
+        if (auto pdhItems = FetchFormattedCounterArray(hCounter, PDH_FMT_LARGE, itemCount))
+        {
+          UpdateInstances(instances, pdhItems, itemCount, parser);
+          for (auto index : instances.GetTargetIndices())
+          {
+            accumulate(instances.GetInfo(index), uint64_t(pdhItems[index].FmtValue.largeValue));
+          }
+        }
+        return memAmount;
+      }
+
+      // QueryVideoMemoryInfo でアダプタごとの使用量と予算を snapshot に格納する.
+      //  ローカルセグメントを Dedicated、非ローカルセグメントを Shared として扱う.
+      void CollectGPUMemoryDXGI(Snapshot& snapshot)
+      {
+        SyncGPURegistry(snapshot);
+        snapshot.gpuDedicatedMemory = 0;
+        snapshot.gpuSharedMemory = 0;
+        for (uint32_t i = 0; i < snapshot.gpuAdapterCount; ++i)
+        {
+          auto dxgiAdapter = m_dxgiAdapters[i];
+          if (dxgiAdapter == nullptr)
+          {
+            continue;
+          }
+          DXGI_QUERY_VIDEO_MEMORY_INFO local{}, nonLocal{};
+          if (FAILED(dxgiAdapter->QueryVideoMemoryInfo(0, DXGI_MEMORY_SEGMENT_GROUP_LOCAL, &local)) ||
+            FAILED(dxgiAdapter->QueryVideoMemoryInfo(0, DXGI_MEMORY_SEGMENT_GROUP_NON_LOCAL, &nonLocal)))
+          {
+            continue;
+          }
+          auto& adapter = snapshot.gpuAdapters[i];
+          adapter.localMemory = { local.Budget, local.CurrentUsage, local.AvailableForReservation, local.CurrentReservation };
+          adapter.nonLocalMemory = { nonLocal.Budget, nonLocal.CurrentUsage, nonLocal.AvailableForReservation, nonLocal.CurrentReservation };
+          adapter.overBudget = local.CurrentUsage > local.Budget || nonLocal.CurrentUsage > nonLocal.Budget;
+          adapter.dedicatedMemory = local.CurrentUsage;
+          adapter.sharedMemory = nonLocal.CurrentUsage;
+          snapshot.gpuDedicatedMemory += local.CurrentUsage;
+          snapshot.gpuSharedMemory += nonLocal.CurrentUsage;
+        }
+        // DXGI は自プロセスのみを監視する場合に使用される.
+        if (snapshot.processCount > 0)
+        {
+          snapshot.processes[0].gpuDedicatedMemory = snapshot.gpuDedicatedMemory;
+          snapshot.processes[0].gpuSharedMemory = snapshot.gpuSharedMemory;
+        }
+      }
+
+      // GPU 関連カウンタのインスタンス名を解析する. 集計対象のインスタンスであれば true.
+      //  例: "pid_1234_luid_0x00000000_0x0000D1A5_phys_0_eng_0_engtype_3D"
+      bool ParseGPUInstanceName(const wchar_t* name, GPUInstanceInfo& info, bool hasEngine)
+      {
+        uint32_t pid = 0, luidHigh = 0, luidLow = 0, physIndex = 0;
+        int length = 0;
+        if (::swscanf_s(name, L"pid_%u_luid_0x%x_0x%x_phys_%u%n", &pid, &luidHigh, &luidLow, &physIndex, &length) != 4)
+        {
+          return false;
+        }
+        info.pid = pid;
+        info.luid = (uint64_t(luidHigh) << 32) | luidLow;
+        info.physIndex = physIndex;
+        auto process = std::find_if(m_processes.begin(), m_processes.end(), [pid](const ProcessState& state) { return state.pid == pid; });
+        if (process == m_processes.end())
+        {
+          return false;
+        }
+        info.processIndex = uint32_t(process - m_processes.begin());
+        info.adapterIndex = RegisterGPUAdapter(info.luid);
+        if (!hasEngine)
+        {
+          return true;
+        }
+
+        // エンジンタイプ部の抽出. "_engtype_" の後ろを取得
+        uint32_t engineIndex = 0;
+        int engineTypePos = 0;
+        name += length;
+        if (::swscanf_s(name, L"_eng_%u_engtype_%n", &engineIndex, &engineTypePos) != 1 || engineTypePos == 0)
+        {
+          return false;
+        }
+        info.engineIndex = engineIndex;
+        auto engineType = name + engineTypePos;
+        auto engineTypeLength = wcslen(engineType);
+        if (engineTypeLength == 0)
+        {
+          return false;
+        }
+        info.engineId = RegisterGPUEngine(engineType, engineTypeLength);
+        if (info.engineId == kInvalidGPUEngineId)
+        {
+          return false;
+        }
+        if (info.adapterIndex != kInvalidGPUAdapterIndex)
+        {
+          info.engineInstanceIndex = RegisterGPUEngineInstance(info);
+        }
+        return true;
+      }
+
+      // PIDを元に検索するためのパスを作成.
+      std::vector<std::wstring> GetProcessPathList()
+      {
+        std::vector<std::wstring> counterPathList;
+        HANDLE hProcess = OpenProcess(PROCESS_QUERY_INFORMATION | PROCESS_VM_READ, FALSE, m_pid);
+        std::wstring targetProcessName;
+        targetProcessName.resize(MAX_PATH);
+        ::GetModuleBaseNameW(hProcess, NULL, targetProcessName.data(), DWORD(targetProcessName.size()));
+        targetProcessName = targetProcessName.substr(0, targetProcessName.find_last_of(L'.'));
+        {
+          auto queryString = std::format(L"\\Process({}*)\\ID Process", targetProcessName);
+          LONG value = 0;
+          DWORD pathListLength = 0;
+          PdhExpandWildCardPathW(NULL, queryString.c_str(), nullptr, &pathListLength, 0);
+          pathListLength += 1024; // 予備バッファ.
+          std::vector<wchar_t> wszPathListBuffer(pathListLength);
+          PdhExpandWildCardPathW(NULL, queryString.c_str(), wszPathListBuffer.data(), &pathListLength, 0);
+
+          auto buffer = wszPathListBuffer.data();
+          size_t start = 0;
+          while (wszPathListBuffer[start] != L'\0')
+          {
+            size_t end = start;
+            while (wszPathListBuffer[end] != L'\0')
+            {
+              end++;
+            }
+
+            auto namePath = std::wstring(buffer + start, buffer + end);
+            if (auto pos = namePath.find(targetProcessName); pos != std::wstring::npos)
+            {
+              counterPathList.push_back(namePath);
+            }
+            start = end + 1;
+          }
+        }
+        CloseHandle(hProcess);
+        return counterPathList;
+      }
+
+      // パスのリストから設定したPIDと合うものを見つけ、プロセッサ時間を求めるカウンタパスを返す.
+      std::wstring GetPathMatched(const std::vector<std::wstring>& pathList)
+      {
+        std::wstring desiredInstancePath;
+        for (auto& counterPath : pathList)
+        {
+          PDH_HCOUNTER hCounter = 0;
+
+          auto status = PdhAddCounterW(m_pdhProcessCounterPathQuery, counterPath.c_str(), 0, &hCounter);
+          PdhCollectQueryData(m_pdhProcessCounterPathQuery);
+
+          PDH_FMT_COUNTERVALUE counterValue;
+          status = PdhGetFormattedCounterValue(hCounter, PDH_FMT_LONG, nullptr, &counterValue);
+          if (status == ERROR_SUCCESS)
+          {
+            auto PID = counterValue.longValue;
+            if (m_pid == PID)
+            {
+              desiredInstancePath = counterPath;
+            }
+          }
+          PdhRemoveCounter(hCounter);
+          if (!desiredInstancePath.empty())
+          {
+            break;
+          }
+        }
+        auto pos = desiredInstancePath.rfind(L"\\");
+        desiredInstancePath = desiredInstancePath.substr(0, pos) + L"\\% Processor Time";
+        return desiredInstancePath;
+      }
+
+      double CollectCPUUsage()
+      {
+        double cpuUsage = 0;
+        if (m_useRawCounters)
+        {
+          PDH_RAW_COUNTER raw;
+          if (PdhGetRawCounterValue(m_hCpuUsage, nullptr, &raw) == ERROR_SUCCESS)
+          {
+            cpuUsage = CalculateFromRaw(m_hCpuUsage, PDH_FMT_DOUBLE | PDH_FMT_NOCAP100, raw, m_cpuUsagePreviousRaw) / m_logicalProcessorCount;
+          }
+          return cpuUsage;
+        }
+
+        PDH_FMT_COUNTERVALUE counter_value;
+        auto status = PdhGetFormattedCounterValue(m_hCpuUsage, PDH_FMT_DOUBLE | PDH_FMT_NOCAP100, 0, &counter_value);
+        auto result = counter_value.doubleValue;
+        if (status == ERROR_SUCCESS)
+        {
+          cpuUsage = result / m_logicalProcessorCount;
+        }
+        return cpuUsage;
+      }
+
+      // GetProcessTimes の差分から監視対象のプロセスごとの CPU 使用率を snapshot に格納し、合計値を返す.
+      double CollectCPUUsageProcessTimes(Snapshot& snapshot)
+      {
+        LARGE_INTEGER timestamp;
+        QueryPerformanceCounter(&timestamp);
+        auto toUInt64 = [](const FILETIME& ft) { return (uint64_t(ft.dwHighDateTime) << 32) | ft.dwLowDateTime; };
+
+        double cpuUsageTotal = 0;
+        m_cpuProcessCyclesPerSecond = 0;
+        for (size_t i = 0; i < m_processes.size(); ++i)
+        {
+          auto& process = m_processes[i];
+          auto& sample = snapshot.processes[i];
+          sample.cpuUtilization = 0;
+          sample.cpuCyclesPerSecond = 0;
+          FILETIME creationTime, exitTime, kernelTime, userTime;
+          if (process.handle == nullptr || !GetProcessTimes(process.handle, &creationTime, &exitTime, &kernelTime, &userTime))
+          {
+            continue;
+          }
+          ULONG64 cycleTime = 0;
+          QueryProcessCycleTime(process.handle, &cycleTime);
+
+          ProcessTimesSample current;
+          current.cpuTime = toUInt64(kernelTime) + toUInt64(userTime);
+          current.cycleTime = cycleTime;
+          current.timestamp = timestamp.QuadPart;
+          current.valid = true;
+
+          auto& previous = process.previous;
+          if (previous.valid && current.timestamp > previous.timestamp)
+          {
+            auto elapsedSeconds = double(current.timestamp - previous.timestamp) / m_timestampFrequency;
+            auto cpuSeconds = double(current.cpuTime - previous.cpuTime) * 1.0e-7;
+            sample.cpuUtilization = cpuSeconds / (elapsedSeconds * m_logicalProcessorCount) * 100.0;
+            sample.cpuCyclesPerSecond = double(current.cycleTime - previous.cycleTime) / elapsedSeconds;
+          }
+          previous = current;
+          cpuUsageTotal += sample.cpuUtilization;
+          m_cpuProcessCyclesPerSecond += sample.cpuCyclesPerSecond;
+        }
+        return cpuUsageTotal;
+      }
+
+      // 監視対象のプロセス ID を列挙する. 結果は昇順に並ぶ.
+      //  kMaxProcesses を超える場合は、指定されたプロセス、ジョブのプロセス、子孫プロセスの順に優先して残す.
+      void EnumerateTargetProcesses(std::vector<DWORD>& processIds)
+      {
+        processIds.clear();
+        auto add = [&processIds](DWORD pid) {
+          if (processIds.size() < kMaxProcesses && std::find(processIds.begin(), processIds.end(), pid) == processIds.end())
+          {
+            processIds.push_back(pid);
+          }
+        };
+        for (auto pid : m_rootProcessIds)
+        {
+          add(DWORD(pid));
+        }
+        if (m_processJob && processIds.size() < kMaxProcesses)
+        {
+          // ジョブに属するプロセスの一覧. kMaxProcesses を超える分は取得しない.
+          auto list = reinterpret_cast<JOBOBJECT_BASIC_PROCESS_ID_LIST*>(m_jobProcessListWork.data());
+          list->NumberOfProcessIdsInList = 0;
+          if (QueryInformationJobObject(m_processJob, JobObjectBasicProcessIdList, list, DWORD(m_jobProcessListWork.size()), nullptr) || list->NumberOfProcessIdsInList > 0)
+          {
+            for (DWORD i = 0; i < list->NumberOfProcessIdsInList; ++i)
+            {
+              add(DWORD(list->ProcessIdList[i]));
+            }
+          }
+        }
+        if (m_includeDescendantProcesses && processIds.size() < kMaxProcesses)
+        {
+          HANDLE hSnapshot = CreateToolhelp32Snapshot(TH32CS_SNAPPROCESS, 0);
+          if (hSnapshot != INVALID_HANDLE_VALUE)
+          {
+            auto& parents = m_parentsWork; // (親, 子)
+            parents.clear();
+            PROCESSENTRY32W entry{};
+            entry.dwSize = sizeof(entry);
+            for (auto found = Process32FirstW(hSnapshot, &entry); found; found = Process32NextW(hSnapshot, &entry))
+            {
+              if (entry.th32ProcessID != entry.th32ParentProcessID)
+              {
+                parents.emplace_back(entry.th32ParentProcessID, entry.th32ProcessID);
+              }
+            }
+            CloseHandle(hSnapshot);
+
+            // 見つかったプロセスの子を順に追加していく. 上限で打ち切る.
+            for (size_t i = 0; i < processIds.size() && processIds.size() < kMaxProcesses; ++i)
+            {
+              for (auto& [parent, child] : parents)
+              {
+                if (parent == processIds[i])
+                {
+                  add(child);
+                }
+              }
+            }
+          }
+        }
+        std::sort(processIds.begin(), processIds.end());
+      }
+
+      // 監視対象のプロセスを取得し直し、構成が変化した場合は m_processes と snapshot を更新する.
+      //  子孫プロセス・ジョブを監視しない場合は初回のみ行う.
+      void RefreshTargetProcesses(Snapshot& snapshot, int64_t timestamp)
+      {
+        if (!m_processes.empty() && (!m_dynamicProcessSet || timestamp - m_processSetRefreshTimestamp < m_timestampFrequency))
+        {
+          return;
+        }
+        m_processSetRefreshTimestamp = timestamp;
+        auto& processIds = m_processIdsWork;
+        EnumerateTargetProcesses(processIds);
+        if (!m_processes.empty() && std::equal(processIds.begin(), processIds.end(), m_processes.begin(), m_processes.end(),
+          [](DWORD pid, const ProcessState& state) { return pid == state.pid; }))
+        {
+          return;
+        }
+
+        // 引き続き監視するプロセスは前回値を引き継ぐ.
+        auto& processes = m_processesWork;
+        processes.clear();
+        processes.resize(processIds.size());
+        for (size_t i = 0; i < processIds.size(); ++i)
+        {
+          auto& process = processes[i];
+          process.pid = processIds[i];
+          auto it = std::find_if(m_processes.begin(), m_processes.end(), [&](const ProcessState& state) { return state.pid == process.pid; });
+          if (it != m_processes.end())
+          {
+            process = *it;
+            it->handle = nullptr;
+          }
+          else
+          {
+            process.handle = OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, process.pid);
+          }
+        }
+        for (auto& process : m_processes)
+        {
+          if (process.handle)
+          {
+            CloseHandle(process.handle);
+          }
+        }
+        m_processes.swap(processes);
+        processes.clear();
+
+        // インスタンス名の解析結果がプロセスのインデックスを含むため、解析し直す.
+        m_gpuEngineInstances.Invalidate();
+        m_gpuDedicatedMemInstances.Invalidate();
+        m_gpuSharedMemInstances.Invalidate();
+
+        snapshot.processCount = uint32_t(m_processes.size());
+        for (uint32_t i = 0; i < snapshot.processCount; ++i)
+        {
+          auto& sample = snapshot.processes[i];
+          sample.processId = m_processes[i].pid;
+          sample.cpuUtilization = IsEnabled(SubsystemCPUProcess) ? 0.0 : kNotCollected;
+          sample.cpuCyclesPerSecond = sample.cpuUtilization;
+          sample.gpuDedicatedMemory = IsEnabled(SubsystemGPUMemory) ? 0 : kNotCollectedBytes;
+          sample.gpuSharedMemory = sample.gpuDedicatedMemory;
+          std::fill(std::begin(sample.gpuEnginesUtilization), std::end(sample.gpuEnginesUtilization), IsEnabled(SubsystemGPUEngine) ? 0.0 : kNotCollected);
+          sample.workingSet = IsEnabled(SubsystemMemory) ? 0 : kNotCollectedBytes;
+          sample.privateBytes = sample.workingSet;
+          sample.pageFaultsPerSecond = IsEnabled(SubsystemMemory) ? 0.0 : kNotCollected;
+          auto io = IsEnabled(SubsystemProcessIO) ? 0.0 : kNotCollected;
+          sample.io = { io, io, io, io };
+        }
+      }
+
+      // I/O 関連の項目を snapshot に格納する.
+      void CollectIOUsage(Snapshot& snapshot)
+      {
+        if (IsEnabled(SubsystemProcessIO))
+        {
+          CollectProcessIO(snapshot);
+        }
+        if (IsEnabled(SubsystemDisk))
+        {
+          CollectDisks(snapshot);
+        }
+        if (IsEnabled(SubsystemNetwork))
+        {
+          CollectNetworkInterfaces(snapshot);
+        }
+      }
+
+      // GetProcessIoCounters の差分から監視対象のプロセスごとの I/O を snapshot に格納する.
+      void CollectProcessIO(Snapshot& snapshot)
+      {
+        LARGE_INTEGER timestamp;
+        QueryPerformanceCounter(&timestamp);
+        snapshot.processIO = {};
+        for (size_t i = 0; i < m_processes.size(); ++i)
+        {
+          auto& process = m_processes[i];
+          auto& sample = snapshot.processes[i].io;
+          sample = {};
+          IO_COUNTERS current;
+          if (process.handle == nullptr || !GetProcessIoCounters(process.handle, &current))
+          {
+            continue;
+          }
+          if (process.ioTimestamp != 0 && timestamp.QuadPart > process.ioTimestamp)
+          {
+            auto elapsedSeconds = double(timestamp.QuadPart - process.ioTimestamp) / m_timestampFrequency;
+            auto& previous = process.io;
+            sample.readBytesPerSecond = double(current.ReadTransferCount - previous.ReadTransferCount) / elapsedSeconds;
+            sample.writeBytesPerSecond = double(current.WriteTransferCount - previous.WriteTransferCount) / elapsedSeconds;
+            sample.readOperationsPerSecond = double(current.ReadOperationCount - previous.ReadOperationCount) / elapsedSeconds;
+            sample.writeOperationsPerSecond = double(current.WriteOperationCount - previous.WriteOperationCount) / elapsedSeconds;
+          }
+          process.io = current;
+          process.ioTimestamp = timestamp.QuadPart;
+          snapshot.processIO.readBytesPerSecond += sample.readBytesPerSecond;
+          snapshot.processIO.writeBytesPerSecond += sample.writeBytesPerSecond;
+          snapshot.processIO.readOperationsPerSecond += sample.readOperationsPerSecond;
+          snapshot.processIO.writeOperationsPerSecond += sample.writeOperationsPerSecond;
+        }
+      }
+
+      // インスタンス名から Snapshot::disks / networkInterfaces などのスロットを求める. 未登録の場合は登録する.
+      //  登録数の上限を超えたものは集計対象としない.
+      static bool RegisterIOInstance(const wchar_t* name, IOInstanceInfo& info,
+        wchar_t (*names)[kMaxIOInstanceNameLength], uint32_t& count, uint32_t maxCount)
+      {
+        for (uint32_t i = 0; i < count; ++i)
+        {
+          if (wcsncmp(names[i], name, kMaxIOInstanceNameLength - 1) == 0)
+          {
+            info.slot = i;
+            return true;
+          }
+        }
+        if (count == maxCount)
+        {
+          return false;
+        }
+        wcsncpy_s(names[count], kMaxIOInstanceNameLength, name, _TRUNCATE);
+        info.slot = count++;
+        return true;
+      }
+
+      // カウンタ配列の集計対象のインスタンスごとに func(info, value) を呼び出す.
+      //  useRawCounters の場合は生データと前回値から計算する.
+      template<class Info, class Parser, class Func>
+      void ForEachCounterInstance(PDH_HCOUNTER hCounter, InstanceNameCache<Info>& instances, Parser& parser, Func&& func, DWORD format = PDH_FMT_DOUBLE)
+      {
+        if (!hCounter)
+        {
+          return;
+        }
+        DWORD itemCount = 0;
+        if (m_useRawCounters)
+        {
+          if (auto pdhItems = FetchRawCounterArray(hCounter, itemCount))
+          {
+            UpdateInstances(instances, pdhItems, itemCount, parser);
+            for (auto index : instances.GetTargetIndices())
+            {
+              func(instances.GetInfo(index), CalculateFromRaw(hCounter, format, pdhItems[index].RawValue, instances.GetPreviousRaw(index)));
+            }
+          }
+          return;
+        }
+        if (auto pdhItems = FetchFormattedCounterArray(hCounter, format, itemCount))
+        {
+          UpdateInstances(instances, pdhItems, itemCount, parser);
+          for (auto index : instances.GetTargetIndices())
+          {
+            func(instances.GetInfo(index), pdhItems[index].FmtValue.doubleValue);
+          }
+        }
+      }
+
+      // 物理ディスクごとの転送量・キューの長さを snapshot に格納する.
+      void CollectDisks(Snapshot& snapshot)
+      {
+        auto parser = [this](const wchar_t* name, IOInstanceInfo& info) {
+          return wcscmp(name, L"_Total") != 0 && RegisterIOInstance(name, info, m_diskNames, m_diskCount, kMaxDisks);
+        };
+        for (uint32_t i = 0; i < kMaxDisks; ++i)
+        {
+          auto& disk = snapshot.disks[i];
+          disk.readBytesPerSecond = 0;
+          disk.writeBytesPerSecond = 0;
+          disk.readsPerSecond = 0;
+          disk.writesPerSecond = 0;
+          disk.queueLength = 0;
+        }
+        ForEachCounterInstance(m_hDiskReadBytes, m_diskInstances[0], parser, [&](const IOInstanceInfo& info, double value) { snapshot.disks[info.slot].readBytesPerSecond = value; });
+        ForEachCounterInstance(m_hDiskWriteBytes, m_diskInstances[1], parser, [&](const IOInstanceInfo& info, double value) { snapshot.disks[info.slot].writeBytesPerSecond = value; });
+        ForEachCounterInstance(m_hDiskReads, m_diskInstances[2], parser, [&](const IOInstanceInfo& info, double value) { snapshot.disks[info.slot].readsPerSecond = value; });
+        ForEachCounterInstance(m_hDiskWrites, m_diskInstances[3], parser, [&](const IOInstanceInfo& info, double value) { snapshot.disks[info.slot].writesPerSecond = value; });
+        ForEachCounterInstance(m_hDiskQueueLength, m_diskInstances[4], parser, [&](const IOInstanceInfo& info, double value) { snapshot.disks[info.slot].queueLength = value; });
+        for (uint32_t i = snapshot.diskCount; i < m_diskCount; ++i)
+        {
+          wmemcpy(snapshot.disks[i].name, m_diskNames[i], kMaxIOInstanceNameLength);
+        }
+        snapshot.diskCount = m_diskCount;
+      }
+
+      // インスタンス名がパターンに一致するか ('*' は0文字以上、'?' は1文字. 大文字小文字を区別しない).
+      static bool MatchInstanceName(const wchar_t* pattern, const wchar_t* name)
+      {
+        const wchar_t* starPattern = nullptr;
+        const wchar_t* starName = nullptr;
+        while (*name)
+        {
+          if (*pattern == L'*')
+          {
+            starPattern = ++pattern;
+            starName = name;
+          }
+          else if (*pattern == L'?' || std::towlower(*pattern) == std::towlower(*name))
+          {
+            ++pattern;
+            ++name;
+          }
+          else if (starPattern)
+          {
+            // 直前の '*' に1文字多く一致させてやり直す.
+            pattern = starPattern;
+            name = ++starName;
+          }
+          else
+          {
+            return false;
+          }
+        }
+        while (*pattern == L'*')
+        {
+          ++pattern;
+        }
+        return *pattern == L'\0';
+      }
+
+      // AddCounter で登録したカウンタのうち、今回採取したグループのものを snapshot に格納する.
+      void CollectCustomCounters(Snapshot& snapshot, uint32_t collectedGroups)
+      {
+        auto count = m_customCounterCount.load(std::memory_order_acquire);
+        for (uint32_t i = 0; i < count; ++i)
+        {
+          auto& counter = *m_customCounters[i];
+          if ((collectedGroups & (1u << uint32_t(counter.group))) == 0)
+          {
+            continue;
+          }
+          auto parser = [&counter](const wchar_t* name, IOInstanceInfo& info) {
+            auto matched = counter.instanceFilter.empty() ? wcscmp(name, L"_Total") != 0 : MatchInstanceName(counter.instanceFilter.c_str(), name);
+            return matched && RegisterIOInstance(name, info, counter.names, counter.nameCount, kMaxCustomCounterInstances);
+          };
+          auto& sample = snapshot.customCounters[i];
+          std::fill_n(sample.values, kMaxCustomCounterInstances, 0.0);
+          ForEachCounterInstance(counter.hCounter, counter.instances, parser,
+            [&](const IOInstanceInfo& info, double value) { sample.values[info.slot] = value; }, counter.format);
+          sample.instanceCount = counter.nameCount;
+        }
+        snapshot.customCounterCount = count;
+      }
+
+      // ネットワークインターフェースごとの転送量を snapshot に格納する.
+      void CollectNetworkInterfaces(Snapshot& snapshot)
+      {
+        auto parser = [this](const wchar_t* name, IOInstanceInfo& info) {
+          return wcscmp(name, L"_Total") != 0 && RegisterIOInstance(name, info, m_networkInterfaceNames, m_networkInterfaceCount, kMaxNetworkInterfaces);
+        };
+        for (uint32_t i = 0; i < kMaxNetworkInterfaces; ++i)
+        {
+          snapshot.networkInterfaces[i].receivedBytesPerSecond = 0;
+          snapshot.networkInterfaces[i].sentBytesPerSecond = 0;
+        }
+        ForEachCounterInstance(m_hNetworkReceivedBytes, m_networkInstances[0], parser, [&](const IOInstanceInfo& info, double value) { snapshot.networkInterfaces[info.slot].receivedBytesPerSecond = value; });
+        ForEachCounterInstance(m_hNetworkSentBytes, m_networkInstances[1], parser, [&](const IOInstanceInfo& info, double value) { snapshot.networkInterfaces[info.slot].sentBytesPerSecond = value; });
+        for (uint32_t i = snapshot.networkInterfaceCount; i < m_networkInterfaceCount; ++i)
+        {
+          wmemcpy(snapshot.networkInterfaces[i].name, m_networkInterfaceNames[i], kMaxIOInstanceNameLength);
+        }
+        snapshot.networkInterfaceCount = m_networkInterfaceCount;
+      }
+
+      // プロセス・システムのメモリ使用量とページングを snapshot に格納する.
+      void CollectMemoryUsage(Snapshot& snapshot)
+      {
+        LARGE_INTEGER timestamp;
+        QueryPerformanceCounter(&timestamp);
+        auto& memory = snapshot.memory;
+        memory.processWorkingSet = 0;
+        memory.processPrivateBytes = 0;
+        memory.processPageFaultsPerSecond = 0;
+        for (size_t i = 0; i < m_processes.size(); ++i)
+        {
+          auto& process = m_processes[i];
+          auto& sample = snapshot.processes[i];
+          sample.workingSet = 0;
+          sample.privateBytes = 0;
+          sample.pageFaultsPerSecond = 0;
+          PROCESS_MEMORY_COUNTERS_EX counters{};
+          counters.cb = sizeof(counters);
+          if (process.handle == nullptr || !GetProcessMemoryInfo(process.handle, reinterpret_cast<PROCESS_MEMORY_COUNTERS*>(&counters), sizeof(counters)))
+          {
+            continue;
+          }
+          sample.workingSet = counters.WorkingSetSize;
+          sample.privateBytes = counters.PrivateUsage;
+          if (process.pageFaultTimestamp != 0 && timestamp.QuadPart > process.pageFaultTimestamp)
+          {
+            auto elapsedSeconds = double(timestamp.QuadPart - process.pageFaultTimestamp) / m_timestampFrequency;
+            sample.pageFaultsPerSecond = double(counters.PageFaultCount - process.pageFaultCount) / elapsedSeconds;
+          }
+          process.pageFaultCount = counters.PageFaultCount;
+          process.pageFaultTimestamp = timestamp.QuadPart;
+          memory.processWorkingSet += sample.workingSet;
+          memory.processPrivateBytes += sample.privateBytes;
+          memory.processPageFaultsPerSecond += sample.pageFaultsPerSecond;
+        }
+
+        PERFORMANCE_INFORMATION performance{};
+        performance.cb = sizeof(performance);
+        if (GetPerformanceInfo(&performance, sizeof(performance)))
+        {
+          // ページ単位の値.
+          uint64_t pageSize = performance.PageSize;
+          memory.systemCommitCharge = performance.CommitTotal * pageSize;
+          memory.systemCommitLimit = performance.CommitLimit * pageSize;
+          memory.systemPhysicalTotal = performance.PhysicalTotal * pageSize;
+          memory.systemAvailableMemory = performance.PhysicalAvailable * pageSize;
+        }
+
+        auto readCounter = [](PDH_HCOUNTER hCounter) {
+          PDH_FMT_COUNTERVALUE counterValue;
+          if (hCounter && PdhGetFormattedCounterValue(hCounter, PDH_FMT_DOUBLE, nullptr, &counterValue) == ERROR_SUCCESS)
+          {
+            return counterValue.doubleValue;
+          }
+          return 0.0;
+        };
+        double standbyCache = 0;
+        for (auto hCounter : m_hMemoryStandbyCache)
+        {
+          standbyCache += readCounter(hCounter);
+        }
+        memory.systemStandbyCache = uint64_t(standbyCache);
+        memory.systemHardPageFaultsPerSecond = readCounter(m_hMemoryPageReads);
+        memory.systemSoftPageFaultsPerSecond = (std::max)(0.0, readCounter(m_hMemoryPageFaults) - memory.systemHardPageFaultsPerSecond);
+        memory.systemPagesPerSecond = readCounter(m_hMemoryPages);
+      }
+
+      // 自プロセスのスレッドを列挙し、CPU 時間の差分からスレッドごとの使用率を snapshot に格納する.
+      void CollectThreadsUsage(Snapshot& snapshot)
+      {
+        snapshot.processThreadCount = 0;
+        snapshot.threadCount = 0;
+
+        // CreateToolhelp32Snapshot はシステム全体のスレッドを列挙するため、一覧は1秒おきにのみ取得し直す.
+        //  その間は既知のスレッドのみ採取し、新しいスレッドは次の取得し直しで加わる.
+        if (m_threadListRefreshTimestamp == 0 || snapshot.timestamp - m_threadListRefreshTimestamp >= m_timestampFrequency)
+        {
+          if (!RefreshThreadList())
+          {
+            return;
+          }
+          m_threadListRefreshTimestamp = snapshot.timestamp;
+        }
+
+        // スレッド名は登録内容の変化時と、1秒おきにのみ取得し直す.
+        bool refreshNames = false;
+        if (auto version = gThreadNameRegistry.GetVersion(); version != m_threadNameVersion ||
+          snapshot.timestamp - m_threadNameRefreshTimestamp >= m_timestampFrequency)
+        {
+          m_threadNameVersion = version;
+          m_threadNameRefreshTimestamp = snapshot.timestamp;
+          refreshNames = true;
+        }
+
+        auto toUInt64 = [](const FILETIME& ft) { return (uint64_t(ft.dwHighDateTime) << 32) | ft.dwLowDateTime; };
+        for (auto& [threadId, thread] : m_threads)
+        {
+          if (thread.handle == nullptr)
+          {
+            continue;
+          }
+          // ハンドルを開いている間はスレッドが終了しても情報を取得でき、終了時刻が設定される.
+          FILETIME creationTime, exitTime, kernelTime, userTime;
+          if (!GetThreadTimes(thread.handle, &creationTime, &exitTime, &kernelTime, &userTime) || toUInt64(exitTime) != 0)
+          {
+            continue;
+          }
+          thread.lastSeenSequence = snapshot.sequence;
+          if (!thread.previous.valid || refreshNames)
+          {
+            UpdateThreadName(threadId, thread);
+          }
+
+          ULONG64 cycleTime = 0;
+          QueryThreadCycleTime(thread.handle, &cycleTime);
+
+          ProcessTimesSample current;
+          current.cpuTime = toUInt64(kernelTime) + toUInt64(userTime);
+          current.cycleTime = cycleTime;
+          current.timestamp = snapshot.timestamp;
+          current.valid = true;
+
+          ThreadSample sample{};
+          sample.threadId = threadId;
+          wmemcpy(sample.name, thread.name, kMaxThreadNameLength);
+          auto& previous = thread.previous;
+          if (previous.valid && current.timestamp > previous.timestamp)
+          {
+            auto elapsedSeconds = double(current.timestamp - previous.timestamp) / m_timestampFrequency;
+            sample.utilization = double(current.cpuTime - previous.cpuTime) * 1.0e-7 / elapsedSeconds * 100.0;
+            sample.cyclesPerSecond = double(current.cycleTime - previous.cycleTime) / elapsedSeconds;
+          }
+          previous = current;
+
+          // 上限を超える場合は、使用率の低いものと入れ替える.
+          snapshot.processThreadCount++;
+          if (snapshot.threadCount < kMaxThreads)
+          {
+            snapshot.threads[snapshot.threadCount++] = sample;
+          }
+          else
+          {
+            auto lowest = std::min_element(std::begin(snapshot.threads), std::end(snapshot.threads),
+              [](const ThreadSample& a, const ThreadSample& b) { return a.utilization < b.utilization; });
+            if (lowest->utilization < sample.utilization)
+            {
+              *lowest = sample;
+            }
+          }
+        }
+
+        std::sort(snapshot.threads, snapshot.threads + snapshot.threadCount,
+          [](const ThreadSample& a, const ThreadSample& b) { return a.utilization > b.utilization; });
+
+        // 終了したスレッドを削除. スレッド ID は再利用されるため、登録された名前も消しておく.
+        for (auto itr = m_threads.begin(); itr != m_threads.end();)
+        {
+          if (itr->second.lastSeenSequence != snapshot.sequence)
+          {
+            if (itr->second.handle)
+            {
+              CloseHandle(itr->second.handle);
+              gThreadNameRegistry.Unregister(itr->first);
+            }
+            itr = m_threads.erase(itr);
+          }
+          else
+          {
+            ++itr;
+          }
+        }
+      }
+
+      // 自プロセスのスレッドを列挙し、新しいスレッドを m_threads に加える. 終了したスレッドは採取時に取り除く.
+      bool RefreshThreadList()
+      {
+        HANDLE hSnapshot = CreateToolhelp32Snapshot(TH32CS_SNAPTHREAD, 0);
+        if (hSnapshot == INVALID_HANDLE_VALUE)
+        {
+          return false;
+        }
+        THREADENTRY32 entry{};
+        entry.dwSize = sizeof(entry);
+        for (auto found = Thread32First(hSnapshot, &entry); found; found = Thread32Next(hSnapshot, &entry))
+        {
+          if (entry.th32OwnerProcessID != m_pid)
+          {
+            continue;
+          }
+          auto [itr, inserted] = m_threads.try_emplace(entry.th32ThreadID);
+          if (inserted)
+          {
+            itr->second.handle = OpenThread(THREAD_QUERY_LIMITED_INFORMATION, FALSE, entry.th32ThreadID);
+          }
+        }
+        CloseHandle(hSnapshot);
+        return true;
+      }
+
+      // 登録された名前、なければスレッドの説明をスレッド名とする.
+      void UpdateThreadName(DWORD threadId, ThreadState& thread)
+      {
+        if (gThreadNameRegistry.Find(threadId, thread.name))
+        {
+          return;
+        }
+        auto getThreadDescription = GetKernel32Functions().getThreadDescription;
+        PWSTR description = nullptr;
+        if (getThreadDescription && SUCCEEDED(getThreadDescription(thread.handle, &description)) && description != nullptr)
+        {
+          wcsncpy_s(thread.name, description, _TRUNCATE);
+          LocalFree(description);
+        }
+      }
+
+      // コアごとの使用率を cpuCoresUsage に格納し、コア数を返す.
+      //  cpuCoresFrequency が有効な場合は、同じ "Processor Information" の性能・周波数も合わせて格納する.
+      uint32_t CollectCPUUsageGlobal(double (&cpuCoresUsage)[kMaxCPUCores], CPUFrequencySample* cpuCoresFrequency)
+      {
+        // インスタンス名は "グループ,番号" の形式. "0,_Total" や "_Total" の集計値は除外する.
+        auto parser = [this](const wchar_t* name, CPUInstanceInfo& info) {
+          uint32_t group = 0, number = 0;
+          if (::swscanf_s(name, L"%u,%u", &group, &number) != 2)
+          {
+            return false;
+          }
+          info.processorIndex = ToProcessorIndex(group, number);
+          return info.processorIndex < m_cpuTopology.size();
+        };
+        auto coreCount = uint32_t(m_cpuTopology.size());
+        std::fill_n(cpuCoresUsage, coreCount, 0.0);
+        ForEachCounterInstance(m_hCpuUsageGlobal, m_cpuInstances, parser,
+          [&](const CPUInstanceInfo& info, double value) { cpuCoresUsage[info.processorIndex] = value; });
+        if (cpuCoresFrequency == nullptr)
+        {
+          return coreCount;
+        }
+
+        // 性能はターボ時に 100% を超えるため、クリップしない.
+        std::fill_n(cpuCoresFrequency, coreCount, CPUFrequencySample{ 0.0, 0.0, 0.0, 100.0, 0 });
+        ForEachCounterInstance(m_hCpuPerformance, m_cpuFrequencyInstances[0], parser,
+          [&](const CPUInstanceInfo& info, double value) { cpuCoresFrequency[info.processorIndex].performancePercent = value; },
+          PDH_FMT_DOUBLE | PDH_FMT_NOCAP100);
+        ForEachCounterInstance(m_hCpuFrequency, m_cpuFrequencyInstances[1], parser,
+          [&](const CPUInstanceInfo& info, double value) { cpuCoresFrequency[info.processorIndex].nominalFrequencyMHz = value; });
+        ForEachCounterInstance(m_hCpuPerformanceLimit, m_cpuFrequencyInstances[2], parser,
+          [&](const CPUInstanceInfo& info, double value) { cpuCoresFrequency[info.processorIndex].performanceLimitPercent = value; },
+          PDH_FMT_DOUBLE | PDH_FMT_NOCAP100);
+        ForEachCounterInstance(m_hCpuPerformanceLimitFlags, m_cpuFrequencyInstances[3], parser,
+          [&](const CPUInstanceInfo& info, double value) { cpuCoresFrequency[info.processorIndex].performanceLimitFlags = uint32_t(value); });
+        for (uint32_t i = 0; i < coreCount; ++i)
+        {
+          auto& frequency = cpuCoresFrequency[i];
+          frequency.effectiveFrequencyMHz = frequency.nominalFrequencyMHz * frequency.performancePercent * 0.01;
+        }
+        return coreCount;
+      }
+
+      // 温度ゾーンによる制限を採取する. 温度ゾーンはソケットと対応しないため、システム全体の値としてのみ扱う.
+      void CollectThermalThrottle(Snapshot& snapshot)
+      {
+        auto parser = [](const wchar_t* name, IOInstanceInfo&) {
+          return wcscmp(name, L"_Total") != 0;
+        };
+        snapshot.cpuThermalPassiveLimitPercent = 100.0;
+        snapshot.cpuThermalThrottleReasons = 0;
+        ForEachCounterInstance(m_hThermalPassiveLimit, m_thermalZoneInstances[0], parser,
+          [&](const IOInstanceInfo&, double value) {
+            snapshot.cpuThermalPassiveLimitPercent = (std::min)(snapshot.cpuThermalPassiveLimitPercent, value);
+          }, PDH_FMT_DOUBLE | PDH_FMT_NOCAP100);
+        ForEachCounterInstance(m_hThermalThrottleReasons, m_thermalZoneInstances[1], parser,
+          [&](const IOInstanceInfo&, double value) { snapshot.cpuThermalThrottleReasons |= uint32_t(value); });
+      }
+
+      // システム全体・コアごと・プロセス単位の CPU 使用率と、論理プロセッサごとの性能を採取する.
+      //  コアごとの値は m_cpuCoresUsage に格納する. 戻り値は採取した論理プロセッサ数.
+      uint32_t CollectCPUUtilization(Snapshot& snapshot)
+      {
+        // システム全体・コアごと.
+        uint32_t cpuCoreCount = 0;
+        if (IsEnabled(SubsystemCPUGlobal | SubsystemCPUCores | SubsystemCPUFrequency))
+        {
+          cpuCoreCount = CollectCPUUsageGlobal(m_cpuCoresUsage, IsEnabled(SubsystemCPUFrequency) ? snapshot.cpuCoresFrequency : nullptr);
+        }
+        if (IsEnabled(SubsystemCPUGlobal))
+        {
+          double cpuUsageGlobal = 0;
+          for (uint32_t i = 0; i < cpuCoreCount; ++i)
+          {
+            cpuUsageGlobal += m_cpuCoresUsage[i];
+          }
+          cpuUsageGlobal /= (std::max)(1u, cpuCoreCount);
+          snapshot.cpuUtilizationGlobal = (std::min)(cpuUsageGlobal, 100.0);
+        }
+
+        // プロセス単位.
+        if (IsEnabled(SubsystemCPUProcess))
+        {
+          // カウンタパスを再解決した回は採取しないため、前回の値を維持する.
+          double cpuUsage = snapshot.cpuUtilizationProcess;
+          if (m_processCpuBackend == ProcessCPUBackend::ProcessTimes)
+          {
+            cpuUsage = CollectCPUUsageProcessTimes(snapshot);
+          }
+          else
+          {
+            auto& stats = snapshot.collectorStats;
+            auto lookupBegin = QueryTimestamp();
+            auto processCpuUsagePathList = GetProcessPathList();
+            stats.processPathLookupMicroSeconds = ElapsedMicroSeconds(lookupBegin);
+            if (processCpuUsagePathList.size() > 1)
+            {
+              // 同名プロセスが増減の債には、カウンターパスの再計算が必要.
+              auto counterPath = GetPathMatched(processCpuUsagePathList);
+              stats.processPathLookupMicroSeconds = ElapsedMicroSeconds(lookupBegin);
+              if (!counterPath.empty())
+              {
+                stats.processPathResolveCount++;
+                // カウンタを再登録する.
+                PdhRemoveCounter(m_hCpuUsage);
+                PdhAddCounter(m_groups[uint32_t(CounterGroup::CPU)].query, counterPath.c_str(), 0, &m_hCpuUsage);
+                m_cpuUsagePreviousRaw = {};
+              }
+            }
+            else
+            {
+              cpuUsage = CollectCPUUsage();
+            }
+            // PDH の場合は自プロセスのみが監視対象となる.
+            snapshot.processes[0].cpuUtilization = cpuUsage;
+          }
+          // 平滑化は MetricFilterSet で行う.
+          snapshot.cpuUtilizationProcess = cpuUsage;
+          snapshot.cpuProcessCyclesPerSecond = m_cpuProcessCyclesPerSecond;
+        }
+
+        return cpuCoreCount;
+      }
+
+      // GPU メモリの使用量を採取して snapshot に格納する.
+      void UpdateGPUMemoryUsage(Snapshot& snapshot)
+      {
+        if (m_gpuMemoryBackend == GPUMemoryBackend::DXGI)
+        {
+          CollectGPUMemoryDXGI(snapshot);
+          return;
+        }
+        uint64_t dedicatedMemory[kMaxGPUAdapters], sharedMemory[kMaxGPUAdapters];
+        uint64_t processDedicatedMemory[kMaxProcesses], processSharedMemory[kMaxProcesses];
+        snapshot.gpuDedicatedMemory = CollectGPUMemory(m_hGpuDedicateMem, m_gpuDedicatedMemInstances, dedicatedMemory, processDedicatedMemory);
+        snapshot.gpuSharedMemory = CollectGPUMemory(m_hGpuSharedMem, m_gpuSharedMemInstances, sharedMemory, processSharedMemory);
+        SyncGPURegistry(snapshot);
+        for (uint32_t i = 0; i < snapshot.gpuAdapterCount; ++i)
+        {
+          snapshot.gpuAdapters[i].dedicatedMemory = dedicatedMemory[i];
+          snapshot.gpuAdapters[i].sharedMemory = sharedMemory[i];
+        }
+        for (uint32_t i = 0; i < snapshot.processCount; ++i)
+        {
+          snapshot.processes[i].gpuDedicatedMemory = processDedicatedMemory[i];
+          snapshot.processes[i].gpuSharedMemory = processSharedMemory[i];
+        }
+      }
+
+      // ワーカースレッド自身の実行設定を行う.
+      //  いずれも実行時のヒントのため、失敗した場合 (古い OS など) もそのまま採取を続ける.
+      void SetupWorkerThread()
+      {
+        auto thread = GetCurrentThread();
+        auto& kernel32 = GetKernel32Functions();
+        if (!m_workerThreadName.empty())
+        {
+          if (kernel32.setThreadDescription)
+          {
+            kernel32.setThreadDescription(thread, m_workerThreadName.c_str());
+          }
+          gThreadNameRegistry.Register(GetCurrentThreadId(), m_workerThreadName.c_str());
+        }
+        if (m_workerCpuSetIdCount > 0 && kernel32.setThreadSelectedCpuSets)
+        {
+          kernel32.setThreadSelectedCpuSets(thread, m_workerCpuSetIds, m_workerCpuSetIdCount);
+        }
+        if (m_workerAffinityMask != 0)
+        {
+          GROUP_AFFINITY affinity{};
+          affinity.Mask = KAFFINITY(m_workerAffinityMask);
+          affinity.Group = WORD(m_workerProcessorGroup);
+          SetThreadGroupAffinity(thread, &affinity, nullptr);
+        }
+        if (m_workerThreadPriority != THREAD_PRIORITY_NORMAL)
+        {
+          SetThreadPriority(thread, m_workerThreadPriority);
+        }
+        if (m_workerEcoQoS)
+        {
+          THREAD_POWER_THROTTLING_STATE state{};
+          state.Version = THREAD_POWER_THROTTLING_CURRENT_VERSION;
+          state.ControlMask = THREAD_POWER_THROTTLING_EXECUTION_SPEED;
+          state.StateMask = THREAD_POWER_THROTTLING_EXECUTION_SPEED;
+          SetThreadInformation(thread, ThreadPowerThrottling, &state, sizeof(state));
+        }
+      }
+
+      // 採取周期のタイマーを作成する. 高分解能タイマーが使用できない環境 (Windows 10 1803 より前) では通常のタイマーとする.
+      bool CreateSampleTimer()
+      {
+        m_sampleTimer = CreateWaitableTimerExW(nullptr, nullptr, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+        if (m_sampleTimer == nullptr)
+        {
+          m_sampleTimer = CreateWaitableTimerExW(nullptr, nullptr, 0, TIMER_ALL_ACCESS);
+        }
+        return m_sampleTimer != nullptr;
+      }
+
+      // タイマーを非シグナル状態に戻す. 自動リセットのタイマーのため、待機が満了した時点で戻っている.
+      bool ResetSampleEvent()
+      {
+        return m_sampleTimer != nullptr;
+      }
+
+      // タイマーを設定する. immediate = true の場合はすぐにシグナル状態にし、そこから周期を数える.
+      bool ArmSampleTimer(bool immediate)
+      {
+        LARGE_INTEGER dueTime;
+        // 負の値は相対時間 (100ns 単位).
+        dueTime.QuadPart = immediate ? -1 : -int64_t(m_sampleTimerPeriod.count()) * 10000;
+        m_sampleTimerRearmed = immediate;
+        return SetWaitableTimer(m_sampleTimer, &dueTime, LONG(m_sampleTimerPeriod.count()), nullptr, nullptr, FALSE) != FALSE;
+      }
+#elif defined(__linux__)
+      // /proc・/sys のファイルを開いておく.
+      bool SetupPlatform(const InitParams&)
+      {
+        m_nanoSecondsPerClockTick = 1.0e9 / double((std::max)(1l, sysconf(_SC_CLK_TCK)));
+        m_pageSize = uint64_t((std::max)(1l, sysconf(_SC_PAGESIZE)));
+        m_workBuffer.resize(16384);
+        m_directoryBuffer.resize(32768);
+
+        // CPU の項目は /proc/stat が読めない環境では採取できない.
+        if (!m_procStat.Open("/proc/stat") && IsEnabled(SubsystemCPUGlobal | SubsystemCPUCores))
+        {
+          return false;
+        }
+        SetupCPUTopology();
+        if (IsEnabled(SubsystemCPUFrequency))
+        {
+          SetupCPUFrequency();
+        }
+        if (IsEnabled(SubsystemGPUEngine | SubsystemGPUMemory))
+        {
+          SetupNvmlAdapters();
+        }
+        if (IsEnabled(SubsystemMemory))
+        {
+          m_procMemInfo.Open("/proc/meminfo");
+          m_procVmStat.Open("/proc/vmstat");
+        }
+        if (IsEnabled(SubsystemDisk))
+        {
+          m_procDiskStats.Open("/proc/diskstats");
+        }
+        if (IsEnabled(SubsystemNetwork))
+        {
+          m_procNetDev.Open("/proc/net/dev");
+        }
+        if (IsEnabled(SubsystemCPUThreads))
+        {
+          m_taskDirectory = open("/proc/self/task", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        }
+        m_procDirectory = open("/proc", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+
+        // 採取中にメモリ確保を行わないよう、プロセス・スレッド・DRM のクライアントの領域を確保しておく.
+        //  子孫プロセスの列挙の作業領域は、システムのプロセス数が確保済みの数を超えた場合のみ拡張する.
+        m_processes.reserve(kMaxProcesses);
+        m_processesWork.reserve(kMaxProcesses);
+        m_processIdsWork.reserve(kMaxProcesses);
+        if (m_includeDescendantProcesses)
+        {
+          m_parentsWork.reserve(4096);
+        }
+        m_threads.reserve(kMaxThreads);
+        m_drmClients.reserve(kMaxDrmClients);
+        return true;
+      }
+
+      // ワーカースレッドの終了後に、タイマー・共有メモリ・ディレクトリを解放する.
+      void ReleasePlatformResources()
+      {
+        if (m_sampleTimer >= 0)
+        {
+          close(m_sampleTimer);
+          m_sampleTimer = -1;
+        }
+        if (m_sharedHeader)
+        {
+          munmap(m_sharedHeader, sizeof(SharedSnapshotHeader));
+          m_sharedHeader = nullptr;
+          m_published = &m_localPublished;
+        }
+        for (auto directory : { m_taskDirectory, m_procDirectory })
+        {
+          if (directory >= 0)
+          {
+            close(directory);
+          }
+        }
+        m_taskDirectory = -1;
+        m_procDirectory = -1;
+      }
+
+      // file の内容を m_workBuffer に読み込む. 収まらなかった場合のみ拡張して読み直す. 失敗した場合は nullptr.
+      const char* ReadProcFile(const ProcFile& file)
+      {
+        for (;;)
+        {
+          auto length = file.Read(m_workBuffer.data(), m_workBuffer.size());
+          if (length < 0)
+          {
+            return nullptr;
+          }
+          if (size_t(length) + 1 < m_workBuffer.size())
+          {
+            return m_workBuffer.data();
+          }
+          m_workBuffer.resize(m_workBuffer.size() * 2);
+          m_workSnapshot.collectorStats.workBufferResizeCount++;
+        }
+      }
+
+      // ディレクトリのエントリ名ごとに func(name) を呼び出す. '.' で始まる名前は除く.
+      //  readdir はストリームごとにバッファを確保するため、getdents64 で m_directoryBuffer に読み込む.
+      template<class Func>
+      void ForEachDirectoryEntry(int directory, Func&& func)
+      {
+        struct Entry
+        {
+          uint64_t inode;
+          int64_t offset;
+          uint16_t length;
+          uint8_t type;
+          char name[1];
+        };
+        if (directory < 0 || lseek(directory, 0, SEEK_SET) < 0)
+        {
+          return;
+        }
+        for (;;)
+        {
+          auto size = syscall(SYS_getdents64, directory, m_directoryBuffer.data(), m_directoryBuffer.size());
+          if (size <= 0)
+          {
+            return;
+          }
+          for (long offset = 0; offset < size;)
+          {
+            auto entry = reinterpret_cast<const Entry*>(m_directoryBuffer.data() + offset);
+            if (entry->name[0] != '.')
+            {
+              func(static_cast<const char*>(entry->name));
+            }
+            offset += entry->length;
+          }
+        }
+      }
+
+      // 初期化時に sysfs の値を読み取る.
+      static bool ReadFileValue(const char* path, uint64_t& value)
+      {
+        ProcFile file;
+        return file.Open(path) && file.ReadValue(value);
+      }
+      static bool ReadFileText(const char* path, char* buffer, size_t size)
+      {
+        ProcFile file;
+        return file.Open(path) && file.Read(buffer, size) > 0;
+      }
+
+      // "0-3,8,10-11" の形式の論理プロセッサの一覧について、func(番号) を呼び出す.
+      template<class Func>
+      static void ForEachCPUInList(const char* text, Func&& func)
+      {
+        while (*text >= '0' && *text <= '9')
+        {
+          auto first = ParseUInt(text);
+          auto last = first;
+          if (*text == '-')
+          {
+            text++;
+            last = ParseUInt(text);
+          }
+          for (auto cpu = first; cpu <= last && cpu < kMaxCPUCores; ++cpu)
+          {
+            func(uint32_t(cpu));
+          }
+          if (*text != ',')
+          {
+            break;
+          }
+          text++;
+        }
+      }
+
+      // 論理プロセッサと、コア・NUMA ノード・ソケットの対応を sysfs から調べる.
+      //  通し番号は /proc/stat の "cpuN" の N と一致する. オフラインのプロセッサも番号を詰めずに含める.
+      void SetupCPUTopology()
+      {
+        // プロセスの CPU 使用率は、オンラインの論理プロセッサ数を 100% とする.
+        auto processorCount = uint32_t((std::max)(1l, sysconf(_SC_NPROCESSORS_CONF)));
+        m_logicalProcessorCount = uint32_t((std::max)(1l, sysconf(_SC_NPROCESSORS_ONLN)));
+        m_cpuTopology.resize((std::min)(processorCount, kMaxCPUCores));
+        m_cpuCoresPrevious.assign(m_cpuTopology.size(), {});
+
+        // パッケージ ID・コア ID は連番とは限らず、コア ID はパッケージごとの番号のため、出現順に振り直す.
+        std::vector<uint64_t> packageIds, coreIds, capacities;
+        std::vector<uint64_t> processorCapacities(m_cpuTopology.size(), 0);
+        char path[128];
+        for (uint32_t i = 0; i < m_cpuTopology.size(); ++i)
+        {
+          uint64_t packageId = 0, coreId = i, capacity = 0;
+          snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%u/topology/physical_package_id", i);
+          ReadFileValue(path, packageId);
+          snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%u/topology/core_id", i);
+          ReadFileValue(path, coreId);
+          snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%u/cpu_capacity", i);
+          if (ReadFileValue(path, capacity) && std::find(capacities.begin(), capacities.end(), capacity) == capacities.end())
+          {
+            capacities.push_back(capacity);
+          }
+          processorCapacities[i] = capacity;
+
+          auto package = uint32_t(std::find(packageIds.begin(), packageIds.end(), packageId) - packageIds.begin());
+          if (package == packageIds.size())
+          {
+            packageIds.push_back(packageId);
+          }
+          auto coreKey = (packageId << 32) | coreId;
+          auto core = uint32_t(std::find(coreIds.begin(), coreIds.end(), coreKey) - coreIds.begin());
+          if (core == coreIds.size())
+          {
+            coreIds.push_back(coreKey);
+          }
+          m_cpuTopology[i] = { uint16_t(i / 64), uint8_t(i % 64), 0, core, 0, (std::min)(package, kMaxCPUPackages - 1) };
+        }
+        m_cpuPackageCount = (std::clamp)(uint32_t(packageIds.size()), 1u, kMaxCPUPackages);
+
+        // 性能の異なるコアの区別. cpu_capacity (ARM など) があればその順位、
+        //  なければハイブリッド構成の Intel CPU の P コア (/sys/devices/cpu_core/cpus) を 1 とする.
+        if (capacities.size() > 1)
+        {
+          std::sort(capacities.begin(), capacities.end());
+          for (uint32_t i = 0; i < m_cpuTopology.size(); ++i)
+          {
+            auto rank = std::find(capacities.begin(), capacities.end(), processorCapacities[i]) - capacities.begin();
+            m_cpuTopology[i].efficiencyClass = uint8_t(rank);
+          }
+        }
+        else
+        {
+          char cpuList[1024];
+          if (ReadFileText("/sys/devices/cpu_core/cpus", cpuList, sizeof(cpuList)))
+          {
+            ForEachCPUInList(cpuList, [&](uint32_t cpu) {
+              if (cpu < m_cpuTopology.size())
+              {
+                m_cpuTopology[cpu].efficiencyClass = 1;
+              }
+            });
+          }
+        }
+
+        // NUMA ノードは番号が飛ぶことがあるため、上限まで全て調べる.
+        uint32_t numaNodeCount = 0;
+        for (uint32_t node = 0; node < kMaxCPUNumaNodes; ++node)
+        {
+          char cpuList[1024];
+          snprintf(path, sizeof(path), "/sys/devices/system/node/node%u/cpulist", node);
+          if (!ReadFileText(path, cpuList, sizeof(cpuList)))
+          {
+            continue;
+          }
+          ForEachCPUInList(cpuList, [&](uint32_t cpu) {
+            if (cpu < m_cpuTopology.size())
+            {
+              m_cpuTopology[cpu].numaNode = node;
+            }
+          });
+          numaNodeCount = node + 1;
+        }
+        m_cpuNumaNodeCount = (std::max)(1u, numaNodeCount);
+      }
+
+      // 論理プロセッサごとの cpufreq のファイルを開き、定格・最大周波数を読み取る.
+      //  定格は base_frequency (intel_pstate)、なければ cpuinfo_max_freq とする.
+      void SetupCPUFrequency()
+      {
+        m_cpuFrequencySources.resize(m_cpuTopology.size());
+        char path[128];
+        for (uint32_t i = 0; i < m_cpuTopology.size(); ++i)
+        {
+          auto& source = m_cpuFrequencySources[i];
+          snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%u/cpufreq/scaling_cur_freq", i);
+          source.current.Open(path);
+          snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%u/cpufreq/scaling_max_freq", i);
+          source.limit.Open(path);
+          uint64_t value = 0;
+          snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%u/cpufreq/cpuinfo_max_freq", i);
+          if (ReadFileValue(path, value))
+          {
+            source.maximumMHz = double(value) * 1.0e-3;
+          }
+          snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%u/cpufreq/base_frequency", i);
+          source.nominalMHz = ReadFileValue(path, value) ? double(value) * 1.0e-3 : source.maximumMHz;
+
+          // 温度によるスロットリングの回数は、ソケットの論理プロセッサのいずれかで読めれば良い.
+          auto& throttle = m_packageThrottles[m_cpuTopology[i].package];
+          if (!throttle.count.IsOpen())
+          {
+            snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%u/thermal_throttle/package_throttle_count", i);
+            throttle.count.Open(path);
+          }
+        }
+      }
+
+      // 共有メモリを作成 (同名の領域が既にある場合は開いて) マップする. created にはこの呼び出しで作成したかを返す.
+      //  Windows と同様に再接続できるよう、終了時も領域 (shm_unlink) は削除しない.
+      SharedSnapshotHeader* MapSharedMemory(const wchar_t* name, bool& created)
+      {
+        char sharedMemoryName[256];
+        ToSharedMemoryName(name, sharedMemoryName);
+        int fd = shm_open(sharedMemoryName, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+        created = fd >= 0;
+        if (!created && errno == EEXIST)
+        {
+          fd = shm_open(sharedMemoryName, O_RDWR | O_CLOEXEC, 0);
+        }
+        if (fd < 0)
+        {
+          return nullptr;
+        }
+        // 作成したプロセスが大きさを設定する前の領域は、マップしても読み書きできないため失敗とする.
+        struct stat status{};
+        if (created ? ftruncate(fd, off_t(sizeof(SharedSnapshotHeader))) != 0 :
+          fstat(fd, &status) != 0 || uint64_t(status.st_size) < sizeof(SharedSnapshotHeader))
+        {
+          close(fd);
+          return nullptr;
+        }
+        // マップした後はファイルディスクリプタを保持する必要がない.
+        auto view = mmap(nullptr, sizeof(SharedSnapshotHeader), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        return view != MAP_FAILED ? static_cast<SharedSnapshotHeader*>(view) : nullptr;
+      }
+
+      // PCI のバス ID ("0000:01:00.0") からアダプタの識別子を求める. DRM fdinfo と NVML で共通の値となる.
+      static bool ToPciLuid(const char* busId, uint64_t& luid)
+      {
+        unsigned int domain = 0, bus = 0, device = 0, function = 0;
+        if (sscanf(busId, "%x:%x:%x.%x", &domain, &bus, &device, &function) != 4)
+        {
+          return false;
+        }
+        luid = (uint64_t(domain) << 32) | (uint64_t(bus) << 16) | (uint64_t(device) << 8) | function;
+        return true;
+      }
+
+      // NVML で NVIDIA のアダプタを列挙し、名前とエンジンを登録しておく.
+      //  NVML が読み込めない環境や、対象のアダプタがない場合は DRM fdinfo のみで採取する.
+      void SetupNvmlAdapters()
+      {
+        unsigned int deviceCount = 0;
+        if (!m_nvml.Load() || m_nvml.deviceGetCount(&deviceCount) != 0)
+        {
+          m_nvml.Unload();
+          return;
+        }
+        for (unsigned int i = 0; i < deviceCount && m_nvmlDeviceCount < kMaxGPUAdapters; ++i)
+        {
+          NvmlLibrary::Device handle = nullptr;
+          NvmlLibrary::PciInfo pciInfo{};
+          uint64_t luid = 0;
+          if (m_nvml.deviceGetHandleByIndex(i, &handle) != 0 || !m_nvml.deviceGetPciInfo ||
+            m_nvml.deviceGetPciInfo(handle, &pciInfo) != 0 || !ToPciLuid(pciInfo.busId, luid))
+          {
+            continue;
+          }
+          auto adapterIndex = RegisterGPUAdapter(luid);
+          if (adapterIndex == kInvalidGPUAdapterIndex)
+          {
+            continue;
+          }
+          char name[96] = {};
+          if (m_nvml.deviceGetName && m_nvml.deviceGetName(handle, name, sizeof(name)) == 0)
+          {
+            FromUtf8(name, sizeof(name), m_gpuAdapters[adapterIndex].name, kMaxGPUAdapterNameLength);
+          }
+          auto& device = m_nvmlDevices[m_nvmlDeviceCount++];
+          device.handle = handle;
+          device.adapterIndex = adapterIndex;
+          m_nvmlAdapters[adapterIndex] = true;
+        }
+        if (m_nvmlDeviceCount == 0)
+        {
+          m_nvml.Unload();
+          return;
+        }
+
+        // エンジン名は DRM fdinfo のエンジンと同じ分類とする (SM は 3D として扱う).
+        if (IsEnabled(SubsystemGPUEngine))
+        {
+          const wchar_t* engineNames[kNvmlEngineCount] = { L"3D", L"VideoEncode", L"VideoDecode" };
+          for (uint32_t k = 0; k < kNvmlEngineCount; ++k)
+          {
+            m_nvmlEngineIds[k] = RegisterGPUEngine(engineNames[k], wcslen(engineNames[k]));
+            for (uint32_t i = 0; i < m_nvmlDeviceCount; ++i)
+            {
+              auto& device = m_nvmlDevices[i];
+              device.engineInstanceIndices[k] = m_nvmlEngineIds[k] != kInvalidGPUEngineId ?
+                RegisterGPUEngineInstance(device.adapterIndex, m_nvmlEngineIds[k]) : kInvalidGPUAdapterIndex;
+            }
+          }
+        }
+        // 採取中にメモリ確保を行わないよう、プロセスの一覧の領域を確保しておく.
+        m_nvmlSamples.resize(256);
+        m_nvmlProcesses.resize(256);
+      }
+
+      // エンジンのインスタンスに対応するインデックスを取得. 未登録の場合は登録する.
+      //  Linux ではエンジンの種類ごとに1つのインスタンスとし、physIndex は 0、engineIndex はエンジン ID とする.
+      uint32_t RegisterGPUEngineInstance(uint32_t adapterIndex, uint32_t engineId)
+      {
+        for (uint32_t i = 0; i < m_gpuEngineInstanceCount; ++i)
+        {
+          auto& entry = m_gpuEngineInstanceEntries[i];
+          if (entry.adapterIndex == adapterIndex && entry.engineId == engineId)
+          {
+            return i;
+          }
+        }
+        if (m_gpuEngineInstanceCount == kMaxGPUEngineInstances)
+        {
+          return kInvalidGPUAdapterIndex;
+        }
+        auto& entry = m_gpuEngineInstanceEntries[m_gpuEngineInstanceCount];
+        entry.adapterIndex = adapterIndex;
+        entry.physIndex = 0;
+        entry.engineIndex = engineId;
+        entry.engineId = engineId;
+        entry.utilization = 0;
+        return m_gpuEngineInstanceCount++;
+      }
+
+      // /proc/stat の "cpu" 行の値から、使用中の時間と合計時間 (clock tick) を求める.
+      //  項目は user nice system idle iowait irq softirq steal の順. iowait はアイドルとして扱う.
+      static CPUStatSample ParseCPUStatLine(const char* text)
+      {
+        uint64_t values[8];
+        for (auto& value : values)
+        {
+          value = ParseUInt(text);
+        }
+        CPUStatSample sample;
+        sample.busy = values[0] + values[1] + values[2] + values[5] + values[6] + values[7];
+        sample.total = sample.busy + values[3] + values[4];
+        return sample;
+      }
+
+      // 前回値との差分から使用率を求め、前回値を更新する. 初回は 0.
+      static double ToCPUUtilization(const CPUStatSample& current, CPUStatSample& previous)
+      {
+        double utilization = 0;
+        if (previous.total != 0 && current.total > previous.total)
+        {
+          // オフラインになったプロセッサなどで値が戻ることがあるため、符号付きで扱う.
+          auto busy = double(int64_t(current.busy - previous.busy));
+          utilization = (std::clamp)(busy / double(current.total - previous.total) * 100.0, 0.0, 100.0);
+        }
+        previous = current;
+        return utilization;
+      }
+
+      // /proc/stat を1回読み取り、コアごとの使用率を cpuCoresUsage に格納して、システム全体の使用率を返す.
+      double CollectCPUStat(double (&cpuCoresUsage)[kMaxCPUCores])
+      {
+        auto coreCount = uint32_t(m_cpuTopology.size());
+        std::fill_n(cpuCoresUsage, coreCount, 0.0);
+        auto text = ReadProcFile(m_procStat);
+        if (text == nullptr)
+        {
+          return 0;
+        }
+        // "cpu" はシステム全体、"cpuN" は論理プロセッサ N の値. 先頭から連続して並ぶ.
+        double cpuUsageGlobal = 0;
+        while (std::strncmp(text, "cpu", 3) == 0)
+        {
+          auto fields = text + 3;
+          if (*fields == ' ')
+          {
+            cpuUsageGlobal = ToCPUUtilization(ParseCPUStatLine(fields), m_cpuGlobalPrevious);
+          }
+          else if (auto index = ParseUInt(fields); index < coreCount)
+          {
+            cpuCoresUsage[index] = ToCPUUtilization(ParseCPUStatLine(fields), m_cpuCoresPrevious[index]);
+          }
+          auto lineEnd = std::strchr(fields, '\n');
+          if (lineEnd == nullptr)
+          {
+            break;
+          }
+          text = lineEnd + 1;
+        }
+        return cpuUsageGlobal;
+      }
+
+      // 論理プロセッサごとの現在の周波数と、ポリシーによる上限を cpuCoresFrequency に格納する.
+      //  性能は定格周波数に対する割合のため、ターボ時は 100% を超える.
+      void CollectCPUFrequency(CPUFrequencySample* cpuCoresFrequency, uint32_t coreCount)
+      {
+        std::fill_n(cpuCoresFrequency, coreCount, CPUFrequencySample{ 0.0, 0.0, 0.0, 100.0, 0 });
+        for (uint32_t i = 0; i < coreCount && i < m_cpuFrequencySources.size(); ++i)
+        {
+          auto& source = m_cpuFrequencySources[i];
+          auto& frequency = cpuCoresFrequency[i];
+          frequency.nominalFrequencyMHz = source.nominalMHz;
+          uint64_t value = 0;
+          if (source.current.ReadValue(value))
+          {
+            frequency.effectiveFrequencyMHz = double(value) * 1.0e-3;
+            if (source.nominalMHz > 0)
+            {
+              frequency.performancePercent = frequency.effectiveFrequencyMHz / source.nominalMHz * 100.0;
+            }
+          }
+          if (source.maximumMHz > 0 && source.limit.ReadValue(value))
+          {
+            frequency.performanceLimitPercent = (std::min)(100.0, double(value) * 1.0e-3 / source.maximumMHz * 100.0);
+          }
+        }
+      }
+
+      // /proc/<pid>/stat の CPU 時間の差分から監視対象のプロセスごとの CPU 使用率を snapshot に格納し、合計値を返す.
+      //  サイクル数は取得できないため、採取対象外とする.
+      double CollectCPUUsageProcesses(Snapshot& snapshot)
+      {
+        auto timestamp = QueryTimestamp();
+        double cpuUsageTotal = 0;
+        for (size_t i = 0; i < m_processes.size(); ++i)
+        {
+          auto& process = m_processes[i];
+          auto& sample = snapshot.processes[i];
+          sample.cpuUtilization = 0;
+          sample.cpuCyclesPerSecond = kNotCollected;
+          char buffer[1024];
+          ProcStat stat;
+          if (process.stat.Read(buffer, sizeof(buffer)) <= 0 || !ParseProcStat(buffer, stat))
+          {
+            continue;
+          }
+          CPUTimeSample current;
+          current.cpuTime = uint64_t(double(stat.cpuTicks) * m_nanoSecondsPerClockTick);
+          current.timestamp = timestamp;
+          current.valid = true;
+
+          auto& previous = process.previous;
+          if (previous.valid && current.timestamp > previous.timestamp && current.cpuTime >= previous.cpuTime)
+          {
+            auto elapsedSeconds = double(current.timestamp - previous.timestamp) / m_timestampFrequency;
+            auto cpuSeconds = double(current.cpuTime - previous.cpuTime) * 1.0e-9;
+            sample.cpuUtilization = cpuSeconds / (elapsedSeconds * m_logicalProcessorCount) * 100.0;
+          }
+          previous = current;
+          cpuUsageTotal += sample.cpuUtilization;
+        }
+        return cpuUsageTotal;
+      }
+
+      // 監視対象のプロセス ID を列挙する. 結果は昇順に並ぶ.
+      //  子孫プロセスを含む場合は、全プロセスの /proc/<pid>/stat を開いて親プロセス ID を読むため、
+      //  コストはシステムのプロセス数に比例する (RefreshTargetProcesses から1秒おきに呼ばれる).
+      //  kMaxProcesses を超える場合は、指定されたプロセス、子孫プロセスの順に優先して残す.
+      void EnumerateTargetProcesses(std::vector<uint32_t>& processIds)
+      {
+        processIds.clear();
+        auto add = [&processIds](uint32_t pid) {
+          if (processIds.size() < kMaxProcesses && std::find(processIds.begin(), processIds.end(), pid) == processIds.end())
+          {
+            processIds.push_back(pid);
+          }
+        };
+        for (auto pid : m_rootProcessIds)
+        {
+          add(pid);
+        }
+        if (m_includeDescendantProcesses && processIds.size() < kMaxProcesses)
+        {
+          // /proc の数字のエントリがプロセス. 親プロセス ID は stat から読み取る.
+          auto& parents = m_parentsWork; // (親, 子)
+          parents.clear();
+          ForEachDirectoryEntry(m_procDirectory, [&](const char* name) {
+            const char* text = name;
+            auto pid = uint32_t(ParseUInt(text));
+            if (*text != '\0' || text == name)
+            {
+              return;
+            }
+            char path[64];
+            snprintf(path, sizeof(path), "%s/stat", name);
+            ProcFile file;
+            char buffer[1024];
+            ProcStat stat;
+            if (file.Open(path, m_procDirectory) && file.Read(buffer, sizeof(buffer)) > 0 && ParseProcStat(buffer, stat) &&
+              stat.parentProcessId != pid)
+            {
+              parents.emplace_back(stat.parentProcessId, pid);
+            }
+          });
+
+          // 見つかったプロセスの子を順に追加していく.
+          //  上限で打ち切り、processIds の領域を超えないようにする.
+          for (size_t i = 0; i < processIds.size() && processIds.size() < kMaxProcesses; ++i)
+          {
+            for (auto& [parent, child] : parents)
+            {
+              if (parent == processIds[i])
+              {
+                add(child);
+              }
+            }
+          }
+        }
+        std::sort(processIds.begin(), processIds.end());
+      }
+
+      // 監視対象のプロセスを取得し直し、構成が変化した場合は m_processes と snapshot を更新する.
+      //  子孫プロセスを監視しない場合は初回のみ行う.
+      void RefreshTargetProcesses(Snapshot& snapshot, int64_t timestamp)
+      {
+        if (!m_processes.empty() && (!m_dynamicProcessSet || timestamp - m_processSetRefreshTimestamp < m_timestampFrequency))
+        {
+          return;
+        }
+        m_processSetRefreshTimestamp = timestamp;
+        auto& processIds = m_processIdsWork;
+        EnumerateTargetProcesses(processIds);
+        if (!m_processes.empty() && std::equal(processIds.begin(), processIds.end(), m_processes.begin(), m_processes.end(),
+          [](uint32_t pid, const ProcessState& state) { return pid == state.pid; }))
+        {
+          return;
+        }
+
+        // 引き続き監視するプロセスは、開いたファイルと前回値を引き継ぐ.
+        auto& processes = m_processesWork;
+        processes.clear();
+        processes.resize(processIds.size());
+        for (size_t i = 0; i < processIds.size(); ++i)
+        {
+          auto& process = processes[i];
+          process.pid = processIds[i];
+          auto it = std::find_if(m_processes.begin(), m_processes.end(), [&](const ProcessState& state) { return state.pid == process.pid; });
+          if (it != m_processes.end())
+          {
+            process = std::move(*it);
+          }
+          else
+          {
+            char path[64];
+            snprintf(path, sizeof(path), "/proc/%u/stat", process.pid);
+            process.stat.Open(path);
+            snprintf(path, sizeof(path), "/proc/%u/statm", process.pid);
+            process.statm.Open(path);
+            snprintf(path, sizeof(path), "/proc/%u/io", process.pid);
+            process.io.Open(path);
+          }
+        }
+        // 入れ替えた後の作業領域には監視をやめたプロセスが残るため、ファイルを閉じておく.
+        m_processes.swap(processes);
+        processes.clear();
+
+        // DRM のクライアントと NVML の使用率はプロセスのインデックスを含むため、取得し直す.
+        m_drmClientsInvalidated = true;
+        for (uint32_t i = 0; i < m_nvmlDeviceCount; ++i)
+        {
+          std::fill(std::begin(m_nvmlDevices[i].utilizationTimestamp), std::end(m_nvmlDevices[i].utilizationTimestamp), 0);
+        }
+
+        snapshot.processCount = uint32_t(m_processes.size());
+        for (uint32_t i = 0; i < snapshot.processCount; ++i)
+        {
+          auto& sample = snapshot.processes[i];
+          sample.processId = m_processes[i].pid;
+          sample.cpuUtilization = IsEnabled(SubsystemCPUProcess) ? 0.0 : kNotCollected;
+          sample.cpuCyclesPerSecond = kNotCollected;
+          sample.gpuDedicatedMemory = IsEnabled(SubsystemGPUMemory) ? 0 : kNotCollectedBytes;
+          sample.gpuSharedMemory = sample.gpuDedicatedMemory;
+          std::fill(std::begin(sample.gpuEnginesUtilization), std::end(sample.gpuEnginesUtilization), IsEnabled(SubsystemGPUEngine) ? 0.0 : kNotCollected);
+          sample.workingSet = IsEnabled(SubsystemMemory) ? 0 : kNotCollectedBytes;
+          sample.privateBytes = sample.workingSet;
+          sample.pageFaultsPerSecond = IsEnabled(SubsystemMemory) ? 0.0 : kNotCollected;
+          auto io = IsEnabled(SubsystemProcessIO) ? 0.0 : kNotCollected;
+          sample.io = { io, io, io, io };
+        }
+      }
+
+      // I/O 関連の項目を snapshot に格納する.
+      void CollectIOUsage(Snapshot& snapshot)
+      {
+        if (IsEnabled(SubsystemProcessIO))
+        {
+          CollectProcessIO(snapshot);
+        }
+        if (IsEnabled(SubsystemDisk))
+        {
+          CollectDisks(snapshot);
+        }
+        if (IsEnabled(SubsystemNetwork))
+        {
+          CollectNetworkInterfaces(snapshot);
+        }
+      }
+
+      // /proc/<pid>/io の差分から監視対象のプロセスごとの I/O を snapshot に格納する.
+      //  Windows の IO_COUNTERS と同様に、ファイル以外 (パイプ・ソケットなど) も含む rchar / wchar / syscr / syscw を使用する.
+      void CollectProcessIO(Snapshot& snapshot)
+      {
+        static constexpr const char* kKeys[] = { "rchar", "wchar", "syscr", "syscw" };
+        auto timestamp = QueryTimestamp();
+        snapshot.processIO = {};
+        for (size_t i = 0; i < m_processes.size(); ++i)
+        {
+          auto& process = m_processes[i];
+          auto& sample = snapshot.processes[i].io;
+          sample = {};
+          char buffer[512];
+          if (process.io.Read(buffer, sizeof(buffer)) <= 0)
+          {
+            continue;
+          }
+          uint64_t current[4] = {};
+          ParseKeyValues(buffer, kKeys, current);
+          if (process.ioTimestamp != 0 && timestamp > process.ioTimestamp)
+          {
+            auto elapsedSeconds = double(timestamp - process.ioTimestamp) / m_timestampFrequency;
+            auto& previous = process.ioCounters;
+            sample.readBytesPerSecond = double(current[0] - previous[0]) / elapsedSeconds;
+            sample.writeBytesPerSecond = double(current[1] - previous[1]) / elapsedSeconds;
+            sample.readOperationsPerSecond = double(current[2] - previous[2]) / elapsedSeconds;
+            sample.writeOperationsPerSecond = double(current[3] - previous[3]) / elapsedSeconds;
+          }
+          std::copy_n(current, 4, process.ioCounters);
+          process.ioTimestamp = timestamp;
+          snapshot.processIO.readBytesPerSecond += sample.readBytesPerSecond;
+          snapshot.processIO.writeBytesPerSecond += sample.writeBytesPerSecond;
+          snapshot.processIO.readOperationsPerSecond += sample.readOperationsPerSecond;
+          snapshot.processIO.writeOperationsPerSecond += sample.writeOperationsPerSecond;
+        }
+      }
+
+      // /proc/diskstats の差分から物理ディスクごとの転送量・キューの長さを snapshot に格納する.
+      //  パーティションや仮想デバイス (loop, dm など) を除くため、/sys/block/<name>/device があるものを対象とする.
+      void CollectDisks(Snapshot& snapshot)
+      {
+        for (uint32_t i = 0; i < kMaxDisks; ++i)
+        {
+          auto& disk = snapshot.disks[i];
+          disk.readBytesPerSecond = 0;
+          disk.writeBytesPerSecond = 0;
+          disk.readsPerSecond = 0;
+          disk.writesPerSecond = 0;
+          disk.queueLength = 0;
+        }
+        auto timestamp = QueryTimestamp();
+        auto elapsedSeconds = m_diskTimestamp != 0 && timestamp > m_diskTimestamp ? double(timestamp - m_diskTimestamp) / m_timestampFrequency : 0.0;
+        m_diskTimestamp = timestamp;
+        auto accept = [](const char* name) {
+          char path[192];
+          snprintf(path, sizeof(path), "/sys/block/%s/device", name);
+          return access(path, F_OK) == 0;
+        };
+        // 項目は major minor 名前 reads merged sectors ms writes merged sectors ms in_flight ... の順. セクタは 512 バイト.
+        auto text = ReadProcFile(m_procDiskStats);
+        while (text && *text)
+        {
+          ParseUInt(text);
+          ParseUInt(text);
+          while (*text == ' ')
+          {
+            text++;
+          }
+          auto name = text;
+          while (*text && *text != ' ' && *text != '\n')
+          {
+            text++;
+          }
+          auto slot = m_disks.Register(name, size_t(text - name), accept);
+          uint64_t values[9];
+          for (auto& value : values)
+          {
+            value = ParseUInt(text);
+          }
+          if (slot != m_disks.kInvalidSlot)
+          {
+            auto& disk = snapshot.disks[slot];
+            auto& previous = m_diskPrevious[slot];
+            DiskCounters current = { values[2], values[6], values[0], values[4], true };
+            if (previous.valid && elapsedSeconds > 0)
+            {
+              disk.readBytesPerSecond = double(current.sectorsRead - previous.sectorsRead) * 512.0 / elapsedSeconds;
+              disk.writeBytesPerSecond = double(current.sectorsWritten - previous.sectorsWritten) * 512.0 / elapsedSeconds;
+              disk.readsPerSecond = double(current.reads - previous.reads) / elapsedSeconds;
+              disk.writesPerSecond = double(current.writes - previous.writes) / elapsedSeconds;
+            }
+            disk.queueLength = double(values[8]);
+            previous = current;
+          }
+          text = std::strchr(text, '\n');
+          if (text)
+          {
+            text++;
+          }
+        }
+        for (uint32_t i = snapshot.diskCount; i < m_disks.GetCount(); ++i)
+        {
+          wmemcpy(snapshot.disks[i].name, m_disks.GetName(i), kMaxIOInstanceNameLength);
+        }
+        snapshot.diskCount = m_disks.GetCount();
+      }
+
+      // /proc/net/dev の差分からネットワークインターフェースごとの転送量を snapshot に格納する. ループバックは除く.
+      void CollectNetworkInterfaces(Snapshot& snapshot)
+      {
+        for (uint32_t i = 0; i < kMaxNetworkInterfaces; ++i)
+        {
+          snapshot.networkInterfaces[i].receivedBytesPerSecond = 0;
+          snapshot.networkInterfaces[i].sentBytesPerSecond = 0;
+        }
+        auto timestamp = QueryTimestamp();
+        auto elapsedSeconds = m_networkTimestamp != 0 && timestamp > m_networkTimestamp ? double(timestamp - m_networkTimestamp) / m_timestampFrequency : 0.0;
+        m_networkTimestamp = timestamp;
+        auto accept = [](const char* name) {
+          return std::strcmp(name, "lo") != 0;
+        };
+        // 先頭の2行は見出し. 各行は "名前: 受信 (bytes packets errs drop fifo frame compressed multicast) 送信 (bytes ...)".
+        auto text = ReadProcFile(m_procNetDev);
+        while (text && *text)
+        {
+          auto lineEnd = std::strchr(text, '\n');
+          auto colon = std::strchr(text, ':');
+          if (colon && (lineEnd == nullptr || colon < lineEnd))
+          {
+            auto name = text;
+            while (*name == ' ')
+            {
+              name++;
+            }
+            auto slot = m_networkInterfaces.Register(name, size_t(colon - name), accept);
+            const char* fields = colon + 1;
+            uint64_t values[9];
+            for (auto& value : values)
+            {
+              value = ParseUInt(fields);
+            }
+            if (slot != m_networkInterfaces.kInvalidSlot)
+            {
+              auto& sample = snapshot.networkInterfaces[slot];
+              auto& previous = m_networkPrevious[slot];
+              NetworkCounters current = { values[0], values[8], true };
+              if (previous.valid && elapsedSeconds > 0)
+              {
+                sample.receivedBytesPerSecond = double(current.receivedBytes - previous.receivedBytes) / elapsedSeconds;
+                sample.sentBytesPerSecond = double(current.sentBytes - previous.sentBytes) / elapsedSeconds;
+              }
+              previous = current;
+            }
+          }
+          text = lineEnd ? lineEnd + 1 : nullptr;
+        }
+        for (uint32_t i = snapshot.networkInterfaceCount; i < m_networkInterfaces.GetCount(); ++i)
+        {
+          wmemcpy(snapshot.networkInterfaces[i].name, m_networkInterfaces.GetName(i), kMaxIOInstanceNameLength);
+        }
+        snapshot.networkInterfaceCount = m_networkInterfaces.GetCount();
+      }
+
+      // プロセス・システムのメモリ使用量とページングを snapshot に格納する.
+      //  プロセスの Private Bytes は、常駐しているページのうち共有されていないもの (statm の resident - shared) とする.
+      void CollectMemoryUsage(Snapshot& snapshot)
+      {
+        auto timestamp = QueryTimestamp();
+        auto& memory = snapshot.memory;
+        memory.processWorkingSet = 0;
+        memory.processPrivateBytes = 0;
+        memory.processPageFaultsPerSecond = 0;
+        for (size_t i = 0; i < m_processes.size(); ++i)
+        {
+          auto& process = m_processes[i];
+          auto& sample = snapshot.processes[i];
+          sample.workingSet = 0;
+          sample.privateBytes = 0;
+          sample.pageFaultsPerSecond = 0;
+          char buffer[1024];
+          if (process.statm.Read(buffer, sizeof(buffer)) <= 0)
+          {
+            continue;
+          }
+          // ページ単位の size resident shared ... の順.
+          const char* fields = buffer;
+          ParseUInt(fields);
+          auto resident = ParseUInt(fields);
+          auto shared = ParseUInt(fields);
+          sample.workingSet = resident * m_pageSize;
+          sample.privateBytes = (resident - (std::min)(resident, shared)) * m_pageSize;
+          ProcStat stat;
+          if (process.stat.Read(buffer, sizeof(buffer)) > 0 && ParseProcStat(buffer, stat))
+          {
+            if (process.pageFaultTimestamp != 0 && timestamp > process.pageFaultTimestamp)
+            {
+              auto elapsedSeconds = double(timestamp - process.pageFaultTimestamp) / m_timestampFrequency;
+              sample.pageFaultsPerSecond = double(stat.pageFaultCount - process.pageFaultCount) / elapsedSeconds;
+            }
+            process.pageFaultCount = stat.pageFaultCount;
+            process.pageFaultTimestamp = timestamp;
+          }
+          memory.processWorkingSet += sample.workingSet;
+          memory.processPrivateBytes += sample.privateBytes;
+          memory.processPageFaultsPerSecond += sample.pageFaultsPerSecond;
+        }
+
+        // kB 単位の値. Standby Cache に相当するものとしてページキャッシュ (Cached) を使用する.
+        static constexpr const char* kMemInfoKeys[] = { "MemTotal", "MemAvailable", "Cached", "Committed_AS", "CommitLimit" };
+        if (auto text = ReadProcFile(m_procMemInfo))
+        {
+          uint64_t values[5] = {};
+          ParseKeyValues(text, kMemInfoKeys, values);
+          memory.systemPhysicalTotal = values[0] * 1024;
+          memory.systemAvailableMemory = values[1] * 1024;
+          memory.systemStandbyCache = values[2] * 1024;
+          memory.systemCommitCharge = values[3] * 1024;
+          memory.systemCommitLimit = values[4] * 1024;
+        }
+
+        // 起動時からの累積の回数. pgfault はメジャーフォールト (ストレージからの読み込み) を含む.
+        //  Pages/sec に相当するものとしてスワップの入出力のページ数を使用する.
+        static constexpr const char* kVmStatKeys[] = { "pgfault", "pgmajfault", "pswpin", "pswpout" };
+        memory.systemHardPageFaultsPerSecond = 0;
+        memory.systemSoftPageFaultsPerSecond = 0;
+        memory.systemPagesPerSecond = 0;
+        if (auto text = ReadProcFile(m_procVmStat))
+        {
+          uint64_t values[4] = {};
+          ParseKeyValues(text, kVmStatKeys, values);
+          if (m_vmStatTimestamp != 0 && timestamp > m_vmStatTimestamp)
+          {
+            auto elapsedSeconds = double(timestamp - m_vmStatTimestamp) / m_timestampFrequency;
+            auto rate = [&](uint32_t k) { return double(values[k] - (std::min)(values[k], m_vmStatPrevious[k])) / elapsedSeconds; };
+            memory.systemHardPageFaultsPerSecond = rate(1);
+            memory.systemSoftPageFaultsPerSecond = (std::max)(0.0, rate(0) - memory.systemHardPageFaultsPerSecond);
+            memory.systemPagesPerSecond = rate(2) + rate(3);
+          }
+          std::copy_n(values, 4, m_vmStatPrevious);
+          m_vmStatTimestamp = timestamp;
+        }
+      }
+
+      // 自プロセスのスレッドを /proc/self/task から列挙し、CPU 時間の差分からスレッドごとの使用率を snapshot に格納する.
+      //  サイクル数は取得できないため、採取対象外とする.
+      void CollectThreadsUsage(Snapshot& snapshot)
+      {
+        snapshot.processThreadCount = 0;
+        snapshot.threadCount = 0;
+        if (m_taskDirectory < 0)
+        {
+          return;
+        }
+
+        // スレッド名は登録内容の変化時と、1秒おきにのみ取得し直す.
+        bool refreshNames = false;
+        if (auto version = gThreadNameRegistry.GetVersion(); version != m_threadNameVersion ||
+          snapshot.timestamp - m_threadNameRefreshTimestamp >= m_timestampFrequency)
+        {
+          m_threadNameVersion = version;
+          m_threadNameRefreshTimestamp = snapshot.timestamp;
+          refreshNames = true;
+        }
+
+        ForEachDirectoryEntry(m_taskDirectory, [&](const char* name) {
+          const char* text = name;
+          auto threadId = uint32_t(ParseUInt(text));
+          auto [itr, inserted] = m_threads.try_emplace(threadId);
+          auto& thread = itr->second;
+          if (inserted)
+          {
+            char path[64];
+            snprintf(path, sizeof(path), "%u/stat", threadId);
+            thread.stat.Open(path, m_taskDirectory);
+          }
+          if (!thread.stat.IsOpen())
+          {
+            return;
+          }
+          thread.lastSeenSequence = snapshot.sequence;
+          if (inserted || refreshNames)
+          {
+            UpdateThreadName(threadId, thread);
+          }
+
+          char buffer[1024];
+          ProcStat stat;
+          if (thread.stat.Read(buffer, sizeof(buffer)) <= 0 || !ParseProcStat(buffer, stat))
+          {
+            return;
+          }
+          CPUTimeSample current;
+          current.cpuTime = uint64_t(double(stat.cpuTicks) * m_nanoSecondsPerClockTick);
+          current.timestamp = snapshot.timestamp;
+          current.valid = true;
+
+          ThreadSample sample{};
+          sample.threadId = threadId;
+          wmemcpy(sample.name, thread.name, kMaxThreadNameLength);
+          sample.cyclesPerSecond = kNotCollected;
+          auto& previous = thread.previous;
+          if (previous.valid && current.timestamp > previous.timestamp && current.cpuTime >= previous.cpuTime)
+          {
+            auto elapsedSeconds = double(current.timestamp - previous.timestamp) / m_timestampFrequency;
+            sample.utilization = double(current.cpuTime - previous.cpuTime) * 1.0e-9 / elapsedSeconds * 100.0;
+          }
+          previous = current;
+
+          // 上限を超える場合は、使用率の低いものと入れ替える.
+          snapshot.processThreadCount++;
+          if (snapshot.threadCount < kMaxThreads)
+          {
+            snapshot.threads[snapshot.threadCount++] = sample;
+          }
+          else
+          {
+            auto lowest = std::min_element(std::begin(snapshot.threads), std::end(snapshot.threads),
+              [](const ThreadSample& a, const ThreadSample& b) { return a.utilization < b.utilization; });
+            if (lowest->utilization < sample.utilization)
+            {
+              *lowest = sample;
+            }
+          }
+        });
+
+        std::sort(snapshot.threads, snapshot.threads + snapshot.threadCount,
+          [](const ThreadSample& a, const ThreadSample& b) { return a.utilization > b.utilization; });
+
+        // 終了したスレッドを削除. スレッド ID は再利用されるため、登録された名前も消しておく.
+        for (auto itr = m_threads.begin(); itr != m_threads.end();)
+        {
+          if (itr->second.lastSeenSequence != snapshot.sequence)
+          {
+            if (itr->second.stat.IsOpen())
+            {
+              gThreadNameRegistry.Unregister(itr->first);
+            }
+            itr = m_threads.erase(itr);
+          }
+          else
+          {
+            ++itr;
+          }
+        }
+      }
+
+      // 登録された名前、なければカーネルのスレッド名 (/proc/self/task/<tid>/comm) をスレッド名とする.
+      void UpdateThreadName(uint32_t threadId, ThreadState& thread)
+      {
+        if (gThreadNameRegistry.Find(threadId, thread.name))
+        {
+          return;
+        }
+        if (!thread.comm.IsOpen())
+        {
+          char path[64];
+          snprintf(path, sizeof(path), "%u/comm", threadId);
+          thread.comm.Open(path, m_taskDirectory);
+        }
+        char name[64];
+        auto length = thread.comm.Read(name, sizeof(name));
+        if (length <= 0)
+        {
+          return;
+        }
+        if (name[length - 1] == '\n')
+        {
+          length--;
+        }
+        FromUtf8(name, size_t(length), thread.name, kMaxThreadNameLength);
+      }
+
+      // DRM fdinfo の内容を info に読み取る. DRM のファイルでない場合 (drm-driver がない場合) は false.
+      //  例: "drm-driver: i915", "drm-pdev: 0000:00:02.0", "drm-client-id: 12", "drm-engine-render: 1234 ns",
+      //      "drm-cycles-rcs: 5678", "drm-total-cycles-rcs: 9012", "drm-resident-vram0: 1024 KiB"
+      static bool ParseDrmFdInfo(const char* text, DrmFdInfo& info)
+      {
+        info.engineCount = 0;
+        std::memset(info.memory, 0, sizeof(info.memory));
+        std::fill(std::begin(info.hasMemory), std::end(info.hasMemory), false);
+        info.clientId = 0;
+        info.hasClientId = false;
+        info.pdev[0] = '\0';
+        info.driver[0] = '\0';
+        while (*text)
+        {
+          auto lineEnd = std::strchr(text, '\n');
+          auto end = lineEnd ? lineEnd : text + std::strlen(text);
+          auto colon = static_cast<const char*>(std::memchr(text, ':', size_t(end - text)));
+          if (colon && std::strncmp(text, "drm-", 4) == 0)
+          {
+            auto key = text + 4;
+            auto keyLength = size_t(colon - key);
+            const char* value = colon + 1;
+            while (*value == ' ' || *value == '\t')
+            {
+              value++;
+            }
+            auto valueLength = size_t(end - value);
+            const char* name = nullptr;
+            uint32_t nameLength = 0;
+            auto hasPrefix = [&](const char* prefix) {
+              auto length = std::strlen(prefix);
+              if (keyLength <= length || std::strncmp(key, prefix, length) != 0)
+              {
+                return false;
+              }
+              name = key + length;
+              nameLength = uint32_t(keyLength - length);
+              return true;
+            };
+            auto isKey = [&](const char* expected) {
+              return std::strlen(expected) == keyLength && std::strncmp(key, expected, keyLength) == 0;
+            };
+            auto copyValue = [&](char (&dst)[32]) {
+              auto length = (std::min)(valueLength, sizeof(dst) - 1);
+              std::memcpy(dst, value, length);
+              dst[length] = '\0';
+            };
+            auto findEngine = [&]() -> DrmFdInfo::Engine* {
+              for (uint32_t i = 0; i < info.engineCount; ++i)
+              {
+                auto& engine = info.engines[i];
+                if (engine.nameLength == nameLength && std::strncmp(engine.name, name, nameLength) == 0)
+                {
+                  return &engine;
+                }
+              }
+              if (info.engineCount == kMaxDrmEngines)
+              {
+                return nullptr;
+              }
+              auto& engine = info.engines[info.engineCount++];
+              engine = { name, nameLength, 0, 0, 0 };
+              return &engine;
+            };
+
+            if (isKey("driver"))
+            {
+              copyValue(info.driver);
+            }
+            else if (isKey("pdev"))
+            {
+              copyValue(info.pdev);
+            }
+            else if (isKey("client-id"))
+            {
+              info.clientId = ParseUInt(value);
+              info.hasClientId = true;
+            }
+            else if (hasPrefix("engine-capacity-"))
+            {
+              // 使用時間は同じ種類のエンジンの合計で、タスクマネージャーと同様に容量で割らずに扱う.
+            }
+            else if (hasPrefix("engine-"))
+            {
+              if (auto engine = findEngine())
+              {
+                engine->busy = ParseUInt(value);
+              }
+            }
+            else if (hasPrefix("cycles-"))
+            {
+              if (auto engine = findEngine())
+              {
+                engine->cycles = ParseUInt(value);
+              }
+            }
+            else if (hasPrefix("total-cycles-"))
+            {
+              if (auto engine = findEngine())
+              {
+                engine->totalCycles = ParseUInt(value);
+              }
+            }
+            else if (int kind = hasPrefix("resident-") ? 0 : hasPrefix("memory-") ? 1 : hasPrefix("total-") ? 2 : -1; kind >= 0)
+            {
+              // 領域名が vram / local で始まるものをローカル (VRAM) とし、それ以外 (system, gtt, stolen など) を合計する.
+              auto amount = ParseUInt(value);
+              while (*value == ' ')
+              {
+                value++;
+              }
+              amount <<= *value == 'K' ? 10 : *value == 'M' ? 20 : *value == 'G' ? 30 : 0;
+              bool local = std::strncmp(name, "vram", 4) == 0 || std::strncmp(name, "local", 5) == 0;
+              info.memory[kind][local ? 0 : 1] += amount;
+              info.hasMemory[kind] = true;
+            }
+          }
+          if (lineEnd == nullptr)
+          {
+            break;
+          }
+          text = lineEnd + 1;
+        }
+        return info.driver[0] != '\0';
+      }
+
+      // アダプタの識別子. PCI デバイスはバス ID から求め (NVML と共通)、
+      //  それ以外 (SoC の GPU など) は drm-pdev、なければドライバ名のハッシュ (FNV-1a) とする.
+      static uint64_t ToDrmAdapterLuid(const DrmFdInfo& info)
+      {
+        uint64_t luid = 0;
+        if (ToPciLuid(info.pdev, luid))
+        {
+          return luid;
+        }
+        uint64_t hash = 14695981039346656037ull;
+        for (auto p = info.pdev[0] ? info.pdev : info.driver; *p; ++p)
+        {
+          hash = (hash ^ uint8_t(*p)) * 1099511628211ull;
+        }
+        return hash;
+      }
+
+      // DRM のエンジン名を、Windows の GPU エンジンの種類 (engtype) に合わせた名前にする.
+      //  対応するものがない場合は nullptr を返し、DRM のエンジン名をそのまま使用する.
+      static const char* ToGPUEngineName(const char* drmName)
+      {
+        struct Entry
+        {
+          const char* drmName;
+          const char* engineName;
+        };
+        static constexpr Entry kEntries[] = {
+          { "render", "3D" }, { "gfx", "3D" }, { "rcs", "3D" },
+          { "compute", "Compute" }, { "ccs", "Compute" },
+          { "copy", "Copy" }, { "dma", "Copy" }, { "bcs", "Copy" },
+          { "video", "VideoDecode" }, { "dec", "VideoDecode" }, { "vcs", "VideoDecode" },
+          { "enc", "VideoEncode" }, { "enc_1", "VideoEncode" },
+          { "video-enhance", "VideoProcessing" }, { "vecs", "VideoProcessing" },
+        };
+        for (auto& entry : kEntries)
+        {
+          if (std::strcmp(entry.drmName, drmName) == 0)
+          {
+            return entry.engineName;
+          }
+        }
+        return nullptr;
+      }
+
+      // クライアントのエンジンの前回値を取得する. 初めて見つけたエンジンは、エンジン ID とインスタンスを登録する.
+      DrmClient::EngineState* FindDrmEngine(DrmClient& client, const DrmFdInfo::Engine& engine)
+      {
+        if (engine.nameLength >= sizeof(DrmClient::EngineState::name))
+        {
+          return nullptr;
+        }
+        for (uint32_t i = 0; i < client.engineCount; ++i)
+        {
+          auto& state = client.engines[i];
+          if (std::strncmp(state.name, engine.name, engine.nameLength) == 0 && state.name[engine.nameLength] == '\0')
+          {
+            return &state;
+          }
+        }
+        if (client.engineCount == kMaxDrmEngines)
+        {
+          return nullptr;
+        }
+        auto& state = client.engines[client.engineCount++];
+        std::memcpy(state.name, engine.name, engine.nameLength);
+        state.name[engine.nameLength] = '\0';
+        auto engineName = ToGPUEngineName(state.name);
+        engineName = engineName ? engineName : state.name;
+        wchar_t name[kMaxGPUEngineNameLength];
+        FromUtf8(engineName, std::strlen(engineName), name, kMaxGPUEngineNameLength);
+        state.engineId = RegisterGPUEngine(name, wcslen(name));
+        state.engineInstanceIndex = state.engineId != kInvalidGPUEngineId && client.adapterIndex != kInvalidGPUAdapterIndex ?
+          RegisterGPUEngineInstance(client.adapterIndex, state.engineId) : kInvalidGPUAdapterIndex;
+        state.valid = false;
+        return &state;
+      }
+
+      // DRM のファイルの fdinfo を開いて登録する.
+      //  同じクライアントを指すファイル (dup や fork で引き継いだもの) が登録済みの場合は、重複して数えないよう登録しない.
+      void AddDrmClient(uint32_t pid, int fd, uint32_t processIndex, uint64_t sequence)
+      {
+        DrmClient client;
+        char path[64];
+        snprintf(path, sizeof(path), "/proc/%u/fdinfo/%d", pid, fd);
+        if (!client.fdinfo.Open(path))
+        {
+          return;
+        }
+        auto& info = m_drmFdInfo;
+        auto text = ReadProcFile(client.fdinfo);
+        if (text == nullptr || !ParseDrmFdInfo(text, info))
+        {
+          return;
+        }
+        client.luid = ToDrmAdapterLuid(info);
+        client.clientId = info.hasClientId ? info.clientId : 0;
+        if (client.clientId != 0 && std::any_of(m_drmClients.begin(), m_drmClients.end(),
+          [&](const DrmClient& other) { return other.luid == client.luid && other.clientId == client.clientId; }))
+        {
+          return;
+        }
+        client.pid = pid;
+        client.fd = fd;
+        client.processIndex = processIndex;
+        client.lastSeenSequence = sequence;
+        client.adapterIndex = RegisterGPUAdapter(client.luid);
+        if (client.adapterIndex != kInvalidGPUAdapterIndex && m_gpuAdapters[client.adapterIndex].name[0] == L'\0')
+        {
+          char name[80];
+          snprintf(name, sizeof(name), info.pdev[0] ? "%s (%s)" : "%s", info.driver, info.pdev);
+          FromUtf8(name, std::strlen(name), m_gpuAdapters[client.adapterIndex].name, kMaxGPUAdapterNameLength);
+        }
+        m_drmClients.push_back(std::move(client));
+      }
+
+      // 監視対象のプロセスが開いている DRM のファイル (/dev/dri/*) を列挙し、m_drmClients を更新する.
+      //  /proc/<pid>/fd の列挙と readlink を伴うため、1秒おきとプロセスの構成の変化時のみ行う.
+      void RefreshDrmClients(int64_t timestamp)
+      {
+        if (!m_drmClientsInvalidated && timestamp - m_drmRefreshTimestamp < m_timestampFrequency)
+        {
+          return;
+        }
+        m_drmClientsInvalidated = false;
+        m_drmRefreshTimestamp = timestamp;
+        auto sequence = ++m_drmRefreshSequence;
+        for (uint32_t processIndex = 0; processIndex < m_processes.size(); ++processIndex)
+        {
+          auto pid = m_processes[processIndex].pid;
+          char path[64];
+          snprintf(path, sizeof(path), "/proc/%u/fd", pid);
+          int directory = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+          if (directory < 0)
+          {
+            continue;
+          }
+          ForEachDirectoryEntry(directory, [&](const char* name) {
+            char target[64];
+            auto length = readlinkat(directory, name, target, sizeof(target) - 1);
+            if (length <= 0)
+            {
+              return;
+            }
+            target[length] = '\0';
+            if (std::strncmp(target, "/dev/dri/", 9) != 0)
+            {
+              return;
+            }
+            const char* text = name;
+            auto fd = int(ParseUInt(text));
+            auto it = std::find_if(m_drmClients.begin(), m_drmClients.end(),
+              [&](const DrmClient& client) { return client.pid == pid && client.fd == fd; });
+            if (it != m_drmClients.end())
+            {
+              it->processIndex = processIndex;
+              it->lastSeenSequence = sequence;
+              return;
+            }
+            AddDrmClient(pid, fd, processIndex, sequence);
+          });
+          close(directory);
+        }
+        // 閉じられたファイルと、監視対象外となったプロセスのものを削除.
+        std::erase_if(m_drmClients, [&](const DrmClient& client) { return client.lastSeenSequence != sequence; });
+      }
+
+      // DRM のクライアントごとのエンジンの使用時間 (またはサイクル数) の差分から使用率を求め、
+      //  accumulate(エンジン ID, アダプタ, エンジンインスタンス, プロセス, 使用率) で集計する.
+      //  NVML で採取するアダプタのものは除く.
+      template<class Accumulate>
+      void CollectDrmEngineUtilization(int64_t timestamp, Accumulate&& accumulate)
+      {
+        auto& info = m_drmFdInfo;
+        for (auto& client : m_drmClients)
+        {
+          if (client.adapterIndex != kInvalidGPUAdapterIndex && m_nvmlAdapters[client.adapterIndex])
+          {
+            continue;
+          }
+          auto text = ReadProcFile(client.fdinfo);
+          if (text == nullptr || !ParseDrmFdInfo(text, info))
+          {
+            continue;
+          }
+          // ファイルディスクリプタの番号が再利用され、別のクライアントとなった場合は前回値を破棄する.
+          auto clientId = info.hasClientId ? info.clientId : 0;
+          if (clientId != client.clientId)
+          {
+            client.clientId = clientId;
+            for (uint32_t i = 0; i < client.engineCount; ++i)
+            {
+              client.engines[i].valid = false;
+            }
+          }
+          auto elapsedNanoSeconds = double(timestamp - client.timestamp) * 1.0e9 / double(m_timestampFrequency);
+          for (uint32_t i = 0; i < info.engineCount; ++i)
+          {
+            auto& engine = info.engines[i];
+            auto state = FindDrmEngine(client, engine);
+            if (state == nullptr)
+            {
+              continue;
+            }
+            if (state->valid && state->engineId != kInvalidGPUEngineId && timestamp > client.timestamp)
+            {
+              double value = 0;
+              if (engine.totalCycles > state->totalCycles && engine.cycles >= state->cycles)
+              {
+                value = double(engine.cycles - state->cycles) / double(engine.totalCycles - state->totalCycles) * 100.0;
+              }
+              else if (engine.totalCycles == 0 && engine.busy >= state->busy)
+              {
+                value = double(engine.busy - state->busy) / elapsedNanoSeconds * 100.0;
+              }
+              accumulate(state->engineId, client.adapterIndex, state->engineInstanceIndex, client.processIndex, value);
+            }
+            state->busy = engine.busy;
+            state->cycles = engine.cycles;
+            state->totalCycles = engine.totalCycles;
+            state->valid = true;
+          }
+          client.timestamp = timestamp;
+        }
+      }
+
+      // 監視対象のプロセスのインデックス. 見つからない場合は kMaxProcesses.
+      uint32_t FindProcessIndex(uint32_t pid) const
+      {
+        for (uint32_t i = 0; i < m_processes.size(); ++i)
+        {
+          if (m_processes[i].pid == pid)
+          {
+            return i;
+          }
+        }
+        return kMaxProcesses;
+      }
+
+      // NVML のプロセスごとの使用率を accumulate で集計する.
+      //  NVML は前回の取得以降のサンプルのみを返すため、プロセスごとに最新の値を保持し、1秒以内のものを使用する.
+      template<class Accumulate>
+      void CollectNvmlEngineUtilization(int64_t timestamp, Accumulate&& accumulate)
+      {
+        if (!m_nvml.deviceGetProcessUtilization)
+        {
+          return;
+        }
+        for (uint32_t d = 0; d < m_nvmlDeviceCount; ++d)
+        {
+          auto& device = m_nvmlDevices[d];
+          auto count = unsigned(m_nvmlSamples.size());
+          if (m_nvml.deviceGetProcessUtilization(device.handle, m_nvmlSamples.data(), &count, device.lastSeenTimeStamp) == 0)
+          {
+            for (unsigned i = 0; i < count && i < m_nvmlSamples.size(); ++i)
+            {
+              auto& sample = m_nvmlSamples[i];
+              device.lastSeenTimeStamp = (std::max)(device.lastSeenTimeStamp, sample.timeStamp);
+              auto processIndex = FindProcessIndex(sample.pid);
+              if (processIndex == kMaxProcesses)
+              {
+                continue;
+              }
+              device.utilization[processIndex][0] = sample.smUtil;
+              device.utilization[processIndex][1] = sample.encUtil;
+              device.utilization[processIndex][2] = sample.decUtil;
+              device.utilizationTimestamp[processIndex] = timestamp;
+            }
+          }
+          // GPU を使用していないプロセスはサンプルが返らないため、古い値は 0 とみなす.
+          for (uint32_t p = 0; p < m_processes.size(); ++p)
+          {
+            if (device.utilizationTimestamp[p] == 0 || timestamp - device.utilizationTimestamp[p] > m_timestampFrequency)
+            {
+              continue;
+            }
+            for (uint32_t k = 0; k < kNvmlEngineCount; ++k)
+            {
+              accumulate(m_nvmlEngineIds[k], device.adapterIndex, device.engineInstanceIndices[k], p, device.utilization[p][k]);
+            }
+          }
+        }
+      }
+
+      // 温度によるスロットリングは、パッケージごとの発生回数の増加で判定する (Throttle Reasons の 0x1 に相当).
+      //  温度ゾーンによる制限の割合は取得できないため、100% とする.
+      void CollectThermalThrottle(Snapshot& snapshot)
+      {
+        snapshot.cpuThermalPassiveLimitPercent = 100.0;
+        snapshot.cpuThermalThrottleReasons = 0;
+        for (uint32_t i = 0; i < m_cpuPackageCount; ++i)
+        {
+          auto& state = m_packageThrottles[i];
+          uint64_t count = 0;
+          if (!state.count.ReadValue(count))
+          {
+            continue;
+          }
+          if (state.valid && count > state.previous)
+          {
+            snapshot.cpuThermalThrottleReasons |= 0x1;
+            snapshot.cpuPackagesThrottle[i].throttled = true;
+          }
+          state.previous = count;
+          state.valid = true;
+        }
+      }
+
+      // システム全体・コアごと・プロセス単位の CPU 使用率と、論理プロセッサごとの周波数を採取する.
+      //  コアごとの値は m_cpuCoresUsage に格納する. 戻り値は採取した論理プロセッサ数.
+      uint32_t CollectCPUUtilization(Snapshot& snapshot)
+      {
+        // システム全体・コアごと. /proc/stat の1回の読み取りで両方を得る.
+        //  システム全体の値はコアの平均ではなく、"cpu" 行の値を使用する.
+        uint32_t cpuCoreCount = 0;
+        if (IsEnabled(SubsystemCPUGlobal | SubsystemCPUCores | SubsystemCPUFrequency))
+        {
+          cpuCoreCount = uint32_t(m_cpuTopology.size());
+        }
+        if (IsEnabled(SubsystemCPUGlobal | SubsystemCPUCores))
+        {
+          auto cpuUsageGlobal = CollectCPUStat(m_cpuCoresUsage);
+          if (IsEnabled(SubsystemCPUGlobal))
+          {
+            snapshot.cpuUtilizationGlobal = cpuUsageGlobal;
+          }
+        }
+        if (IsEnabled(SubsystemCPUFrequency))
+        {
+          CollectCPUFrequency(snapshot.cpuCoresFrequency, cpuCoreCount);
+        }
+
+        // プロセス単位. 平滑化は MetricFilterSet で行う.
+        if (IsEnabled(SubsystemCPUProcess))
+        {
+          snapshot.cpuUtilizationProcess = CollectCPUUsageProcesses(snapshot);
+          snapshot.cpuProcessCyclesPerSecond = kNotCollected;
+        }
+
+        return cpuCoreCount;
+      }
+
+      // GPU エンジンの使用率を DRM fdinfo・NVML から採取する.
+      //  エンジン ID ごとの使用率を m_gpuEngineUtilization に、アダプタ・エンジンインスタンス・プロセスごとの使用率を snapshot に集計する.
+      void CollectGPUUtilization(Snapshot& snapshot)
+      {
+        auto timestamp = QueryTimestamp();
+        RefreshDrmClients(timestamp);
+        SyncGPURegistry(snapshot);
+        std::fill(std::begin(m_gpuEngineUtilization), std::end(m_gpuEngineUtilization), 0.0);
+        for (uint32_t i = 0; i < snapshot.gpuAdapterCount; ++i)
+        {
+          auto& adapter = snapshot.gpuAdapters[i];
+          std::fill(std::begin(adapter.enginesUtilization), std::end(adapter.enginesUtilization), 0.0);
+        }
+        for (uint32_t i = 0; i < snapshot.gpuEngineInstanceCount; ++i)
+        {
+          snapshot.gpuEngineInstances[i].utilization = 0;
+        }
+        for (uint32_t i = 0; i < snapshot.processCount; ++i)
+        {
+          auto& process = snapshot.processes[i];
+          std::fill(std::begin(process.gpuEnginesUtilization), std::end(process.gpuEnginesUtilization), 0.0);
+        }
+        // 採取中に登録されたアダプタ・インスタンスは、次回の採取から集計する.
+        auto accumulate = [&](uint32_t engineId, uint32_t adapterIndex, uint32_t engineInstanceIndex, uint32_t processIndex, double value) {
+          if (engineId >= kMaxGPUEngines)
+          {
+            return;
+          }
+          m_gpuEngineUtilization[engineId] += value;
+          if (adapterIndex < snapshot.gpuAdapterCount)
+          {
+            snapshot.gpuAdapters[adapterIndex].enginesUtilization[engineId] += value;
+          }
+          if (engineInstanceIndex < snapshot.gpuEngineInstanceCount)
+          {
+            snapshot.gpuEngineInstances[engineInstanceIndex].utilization += value;
+          }
+          if (processIndex < snapshot.processCount)
+          {
+            snapshot.processes[processIndex].gpuEnginesUtilization[engineId] += value;
+          }
+        };
+        CollectDrmEngineUtilization(timestamp, accumulate);
+        CollectNvmlEngineUtilization(timestamp, accumulate);
+        SyncGPURegistry(snapshot);
+      }
+
+      // GPU メモリの使用量を採取して snapshot に格納する.
+      //  DRM fdinfo はローカル (VRAM) の領域を Dedicated、それ以外を Shared とする.
+      //  NVML のアダプタはプロセスごとの使用量を Dedicated とし、アダプタ全体の容量・空き容量をローカルメモリの予算とする.
+      void UpdateGPUMemoryUsage(Snapshot& snapshot)
+      {
+        RefreshDrmClients(QueryTimestamp());
+        SyncGPURegistry(snapshot);
+        uint64_t dedicatedMemory[kMaxGPUAdapters] = {}, sharedMemory[kMaxGPUAdapters] = {};
+        uint64_t processDedicatedMemory[kMaxProcesses] = {}, processSharedMemory[kMaxProcesses] = {};
+        auto& info = m_drmFdInfo;
+        for (auto& client : m_drmClients)
+        {
+          if (client.adapterIndex == kInvalidGPUAdapterIndex || m_nvmlAdapters[client.adapterIndex] || client.processIndex >= kMaxProcesses)
+          {
+            continue;
+          }
+          auto text = ReadProcFile(client.fdinfo);
+          if (text == nullptr || !ParseDrmFdInfo(text, info))
+          {
+            continue;
+          }
+          for (uint32_t kind = 0; kind < 3; ++kind)
+          {
+            if (info.hasMemory[kind])
+            {
+              dedicatedMemory[client.adapterIndex] += info.memory[kind][0];
+              sharedMemory[client.adapterIndex] += info.memory[kind][1];
+              processDedicatedMemory[client.processIndex] += info.memory[kind][0];
+              processSharedMemory[client.processIndex] += info.memory[kind][1];
+              break;
+            }
+          }
+        }
+
+        // グラフィックスとコンピュートの両方に現れるプロセスは、大きい方の値とする.
+        for (uint32_t d = 0; d < m_nvmlDeviceCount; ++d)
+        {
+          auto& device = m_nvmlDevices[d];
+          uint64_t used[kMaxProcesses] = {};
+          for (auto getter : { m_nvml.deviceGetGraphicsRunningProcesses, m_nvml.deviceGetComputeRunningProcesses })
+          {
+            auto count = unsigned(m_nvmlProcesses.size());
+            if (getter == nullptr || getter(device.handle, &count, m_nvmlProcesses.data()) != 0)
+            {
+              continue;
+            }
+            for (unsigned i = 0; i < count && i < m_nvmlProcesses.size(); ++i)
+            {
+              auto& process = m_nvmlProcesses[i];
+              auto processIndex = FindProcessIndex(process.pid);
+              if (processIndex != kMaxProcesses && process.usedGpuMemory != NvmlLibrary::kValueNotAvailable)
+              {
+                used[processIndex] = (std::max)(used[processIndex], uint64_t(process.usedGpuMemory));
+              }
+            }
+          }
+          for (uint32_t p = 0; p < m_processes.size(); ++p)
+          {
+            dedicatedMemory[device.adapterIndex] += used[p];
+            processDedicatedMemory[p] += used[p];
+          }
+          NvmlLibrary::Memory memory{};
+          if (device.adapterIndex < snapshot.gpuAdapterCount && m_nvml.deviceGetMemoryInfo &&
+            m_nvml.deviceGetMemoryInfo(device.handle, &memory) == 0)
+          {
+            auto& adapter = snapshot.gpuAdapters[device.adapterIndex];
+            adapter.localMemory = { memory.total, dedicatedMemory[device.adapterIndex], memory.free, 0 };
+            adapter.overBudget = memory.used > memory.total;
+          }
+        }
+
+        snapshot.gpuDedicatedMemory = 0;
+        snapshot.gpuSharedMemory = 0;
+        for (uint32_t i = 0; i < snapshot.gpuAdapterCount; ++i)
+        {
+          snapshot.gpuAdapters[i].dedicatedMemory = dedicatedMemory[i];
+          snapshot.gpuAdapters[i].sharedMemory = sharedMemory[i];
+          snapshot.gpuDedicatedMemory += dedicatedMemory[i];
+          snapshot.gpuSharedMemory += sharedMemory[i];
+        }
+        for (uint32_t i = 0; i < snapshot.processCount; ++i)
+        {
+          snapshot.processes[i].gpuDedicatedMemory = processDedicatedMemory[i];
+          snapshot.processes[i].gpuSharedMemory = processSharedMemory[i];
+        }
+      }
+
+      // ワーカースレッド自身の実行設定を行う.
+      //  いずれも実行時のヒントのため、失敗した場合 (権限がない場合など) もそのまま採取を続ける.
+      void SetupWorkerThread()
+      {
+        if (!m_workerThreadName.empty())
+        {
+          // スレッド名は終端を含めて 16 バイトまで.
+          char threadName[16];
+          ToUtf8(m_workerThreadName.c_str(), threadName, sizeof(threadName));
+          pthread_setname_np(pthread_self(), threadName);
+          gThreadNameRegistry.Register(GetThreadId(), m_workerThreadName.c_str());
+        }
+        if (m_workerAffinityMask != 0)
+        {
+          // プロセッサグループは 64 個ずつの論理プロセッサの区切りとして扱う.
+          cpu_set_t cpuSet;
+          CPU_ZERO(&cpuSet);
+          for (uint32_t bit = 0; bit < 64; ++bit)
+          {
+            auto cpu = m_workerProcessorGroup * 64 + bit;
+            if ((m_workerAffinityMask & (1ull << bit)) && cpu < CPU_SETSIZE)
+            {
+              CPU_SET(cpu, &cpuSet);
+            }
+          }
+          pthread_setaffinity_np(pthread_self(), sizeof(cpuSet), &cpuSet);
+        }
+        if (m_workerThreadPriority != 0)
+        {
+          // SetThreadPriority の値 (-15 ～ 15、高いほど優先) を nice 値 (-20 ～ 19、低いほど優先) に換算する.
+          //  Linux ではスレッドごとに nice 値を持つ. 優先度を上げるには権限 (CAP_SYS_NICE) が必要となる.
+          auto nice = (std::clamp)(-m_workerThreadPriority * 5, -20, 19);
+          auto result = setpriority(PRIO_PROCESS, id_t(GetThreadId()), nice);
+          static_cast<void>(result);
+        }
+      }
+
+      // 採取周期のタイマー (timerfd) を作成する.
+      bool CreateSampleTimer()
+      {
+        m_sampleTimer = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        return m_sampleTimer >= 0;
+      }
+
+      // 満了回数を読み取ってタイマーを非シグナル状態に戻す. 満了していない場合 (EAGAIN) もそのまま採取する.
+      bool ResetSampleEvent()
+      {
+        if (m_sampleTimer < 0)
+        {
+          return false;
+        }
+        uint64_t expirations = 0;
+        return read(m_sampleTimer, &expirations, sizeof(expirations)) >= 0 || errno == EAGAIN;
+      }
+
+      // タイマーを設定する. immediate = true の場合はすぐに満了させ、そこから周期を数える.
+      bool ArmSampleTimer(bool immediate)
+      {
+        auto toTimespec = [](std::chrono::nanoseconds duration) {
+          timespec value{};
+          value.tv_sec = time_t(duration.count() / 1000000000);
+          value.tv_nsec = long(duration.count() % 1000000000);
+          return value;
+        };
+        itimerspec spec{};
+        spec.it_interval = toTimespec(m_sampleTimerPeriod);
+        // it_value が 0 の場合はタイマーの停止となるため、即時の場合は 1ns とする.
+        spec.it_value = immediate ? toTimespec(std::chrono::nanoseconds(1)) : spec.it_interval;
+        m_sampleTimerRearmed = immediate;
+        return timerfd_settime(m_sampleTimer, 0, &spec, nullptr) == 0;
+      }
+#endif
+    };
+
+    Collector gDefaultCollector;
+  }
+
+  // ************************
+  // Collector
+  // ************************
+  Collector::Collector() = default;
+  Collector::~Collector() = default;
+  Collector::Collector(Collector&&) noexcept = default;
+  Collector& Collector::operator=(Collector&&) noexcept = default;
+
+  bool Collector::Initialize(const InitParams& initParams)
+  {
+    if (m_impl)
+    {
+      return true; // 既に初期化されている.
+    }
+    m_impl = std::make_unique<impl::SimplePerfCounter>();
+    if (!m_impl->Initialize(initParams))
+    {
+      m_impl.reset();
+      return false;
+    }
+    return true;
+  }
+
+  void Collector::Shutdown()
+  {
+    m_impl.reset();
+  }
+
+  bool Collector::IsInitialized() const
+  {
+    return m_impl != nullptr;
+  }
+
+  uint64_t Collector::GetUsedGPUDedicatedMemory()
+  {
+    if (m_impl)
+    {
+      return m_impl->GetUsedGPUDedicatedMemory();
+    }
+    return 0;
+  }
+
+  uint64_t Collector::GetUsedGPUSharedMemory()
+  {
+    if (m_impl)
+    {
+      return m_impl->GetUsedGPUSharedMemory();
+    }
+    return 0;
+  }
+
+  double Collector::GetGPUEngineUtilization()
+  {
+    if (m_impl)
+    {
+      return m_impl->GetGPUEngineUtilization(L"3D");
+    }
+    return 0;
+  }
+
+  double Collector::GetGPUEngineUtilization(const wchar_t* engineName)
+  {
+    if (engineName == nullptr)
+    {
+      return 0;
+    }
+    if (m_impl)
+    {
+      return m_impl->GetGPUEngineUtilization(engineName);
+    }
+    return 0;
+  }
+
+  std::vector<std::wstring> Collector::GetGPUEngineNames()
+  {
+    std::vector<std::wstring> nameList;
+    if (m_impl)
+    {
+      m_impl->GetGPUEngineUtilization(nameList);
+    }
+    return nameList;
+  }
+
+  uint32_t Collector::GetGPUEngineNames(std::span<const wchar_t*> names)
+  {
+    if (m_impl)
+    {
+      return m_impl->GetGPUEngineNames(names);
+    }
+    return 0;
+  }
+
+  uint32_t Collector::FindGPUEngineId(const wchar_t* engineName)
+  {
+    if (engineName == nullptr)
+    {
+      return kInvalidGPUEngineId;
+    }
+    if (m_impl)
+    {
+      return m_impl->FindGPUEngineId(engineName);
+    }
+    return kInvalidGPUEngineId;
+  }
+
+  double Collector::GetGPUEngineUtilizationById(uint32_t engineId)
+  {
+    if (m_impl)
+    {
+      return m_impl->GetGPUEngineUtilizationById(engineId);
+    }
+    return 0;
+  }
+
+  uint32_t Collector::GetGPUEnginesUtilization(std::span<double> utilization)
+  {
+    if (m_impl)
+    {
+      return m_impl->GetGPUEnginesUtilization(utilization);
+    }
+    return 0;
+  }
+
+  uint32_t Collector::GetGPUAdapters(std::span<GPUAdapterSample> adapters)
+  {
+    if (m_impl)
+    {
+      return m_impl->GetGPUAdapters(adapters);
+    }
+    return 0;
+  }
+
+  uint32_t Collector::GetGPUEngineInstances(std::span<GPUEngineInstanceSample> instances)
+  {
+    if (m_impl)
+    {
+      return m_impl->GetGPUEngineInstances(instances);
+    }
+    return 0;
+  }
+
+  double Collector::GetCPUUtilization()
+  {
+    if (m_impl)
+    {
+      return m_impl->GetCPUUtilization();
+    }
+    return 0;
+  }
+
+  std::vector<double> Collector::GetCPUCoresUtilization()
+  {
+    if (m_impl)
+    {
+      return m_impl->GetCPUCoresUtilization();
+    }
+    return std::vector<double>();
+  }
+
+  uint32_t Collector::GetCPUCoresUtilization(std::span<double> coresUtilization)
+  {
+    if (m_impl)
+    {
+      return m_impl->GetCPUCoresUtilization(coresUtilization);
+    }
+    return 0;
+  }
+
+  uint32_t Collector::GetCPUNumaNodesUtilization(std::span<double> nodesUtilization)
+  {
+    if (m_impl)
+    {
+      return m_impl->GetCPUNumaNodesUtilization(nodesUtilization);
+    }
+    return 0;
+  }
+
+  uint32_t Collector::GetCPUPackagesUtilization(std::span<double> packagesUtilization)
+  {
+    if (m_impl)
+    {
+      return m_impl->GetCPUPackagesUtilization(packagesUtilization);
+    }
+    return 0;
+  }
+
+  uint32_t Collector::GetCPUCoresFrequency(std::span<CPUFrequencySample> coresFrequency)
+  {
+    if (m_impl)
+    {
+      return m_impl->GetCPUCoresFrequency(coresFrequency);
+    }
+    return 0;
+  }
+
+  CPUThrottleSample Collector::GetCPUThrottle()
+  {
+    if (m_impl)
+    {
+      return m_impl->GetCPUThrottle();
+    }
+    return CPUThrottleSample{ kNotCollected, kNotCollected, kNotCollected, 0, false };
+  }
+
+  uint32_t Collector::GetFilteredMetrics(std::span<FilteredMetricSample> metrics)
+  {
+    if (m_impl)
+    {
+      return m_impl->GetFilteredMetrics(metrics);
+    }
+    return 0;
+  }
+
+  uint32_t Collector::GetCPUTopology(std::span<LogicalProcessorInfo> processors)
+  {
+    if (m_impl)
+    {
+      return m_impl->GetCPUTopology(processors);
+    }
+    return 0;
+  }
+
+  uint32_t Collector::GetProcesses(std::span<ProcessSample> processes)
+  {
+    if (m_impl)
+    {
+      return m_impl->GetProcesses(processes);
+    }
+    return 0;
+  }
+
+  uint32_t Collector::GetThreadsUtilization(std::span<ThreadSample> threads)
+  {
+    if (m_impl)
+    {
+      return m_impl->GetThreadsUtilization(threads);
+    }
+    return 0;
+  }
+
+  uint32_t Collector::GetDisks(std::span<DiskSample> disks)
+  {
+    if (m_impl)
+    {
+      return m_impl->GetDisks(disks);
+    }
+    return 0;
+  }
+
+  uint32_t Collector::GetNetworkInterfaces(std::span<NetworkInterfaceSample> interfaces)
+  {
+    if (m_impl)
+    {
+      return m_impl->GetNetworkInterfaces(interfaces);
+    }
+    return 0;
+  }
+
+  MemorySample Collector::GetMemoryUsage()
+  {
+    if (m_impl)
+    {
+      return m_impl->GetMemoryUsage();
+    }
+    return impl::NotCollectedMemorySample();
+  }
+
+  void Collector::ResetPeakCPU()
+  {
+    if (m_impl)
+    {
+      m_impl->ResetPeakCPU();
+    }
+  }
+
+  double Collector::GetPeakCPUUtilization()
+  {
+    if (m_impl)
+    {
+      return m_impl->GetPeakCPUUtilization();
+    }
+    return 0;
+  }
+
+  double Collector::GetMetricValue(MetricId metric)
+  {
+    if (m_impl)
+    {
+      return m_impl->GetMetricValue(metric);
+    }
+    return 0;
+  }
+
+  bool Collector::GetMetricStatistics(MetricId metric, uint32_t windowMilliSeconds, MetricStatistics& statistics)
+  {
+    if (m_impl)
+    {
+      return m_impl->GetMetricStatistics(metric, windowMilliSeconds, statistics);
+    }
+    return false;
+  }
+
+  uint32_t Collector::GetMetricHistory(MetricId metric, std::span<MetricSample> samples)
+  {
+    if (m_impl)
+    {
+      return m_impl->GetMetricHistory(metric, samples);
+    }
+    return 0;
+  }
+
+  uint32_t Collector::AddTrigger(const TriggerDesc& desc)
+  {
+    if (m_impl)
+    {
+      return m_impl->AddTrigger(desc);
+    }
+    return kInvalidTriggerId;
+  }
+
+  bool Collector::RemoveTrigger(uint32_t triggerId)
+  {
+    if (m_impl)
+    {
+      return m_impl->RemoveTrigger(triggerId);
+    }
+    return false;
+  }
+
+  CounterHandle Collector::AddCounter(const wchar_t* counterPath, uint32_t format, const wchar_t* instanceFilter, CounterGroup group)
+  {
+    if (m_impl)
+    {
+      return m_impl->AddCustomCounter(counterPath, format, instanceFilter, group);
+    }
+    return {};
+  }
+
+  double Collector::GetCounterValue(CounterHandle handle, uint32_t instance)
+  {
+    if (m_impl)
+    {
+      return m_impl->GetCounterValue(handle, instance);
+    }
+    return kNotCollected;
+  }
+
+  uint32_t Collector::GetCounterValues(CounterHandle handle, std::span<double> values)
+  {
+    if (m_impl)
+    {
+      return m_impl->GetCounterValues(handle, values);
+    }
+    return 0;
+  }
+
+  const wchar_t* Collector::GetCounterInstanceName(CounterHandle handle, uint32_t instance)
+  {
+    if (m_impl)
+    {
+      return m_impl->GetCounterInstanceName(handle, instance);
+    }
+    return nullptr;
+  }
+
+  bool Collector::SampleNow(uint32_t timeoutMilliSeconds)
+  {
+    if (m_impl)
+    {
+      return m_impl->SampleNow(timeoutMilliSeconds);
+    }
+    return false;
+  }
+
+  bool Collector::WaitForNextSample(uint32_t timeoutMilliSeconds)
+  {
+    if (m_impl)
+    {
+      return m_impl->WaitForNextSample(timeoutMilliSeconds);
+    }
+    return false;
+  }
+
+  void* Collector::GetSampleEvent()
+  {
+    if (m_impl)
+    {
+      return m_impl->GetSampleEvent();
+    }
+    return nullptr;
+  }
+
+  bool Collector::ProcessSampleEvent()
+  {
+    if (m_impl)
+    {
+      return m_impl->ProcessSampleEvent();
+    }
+    return false;
+  }
+
+  bool Collector::AddSampleWaiter(SampleWaiter* waiter)
+  {
+    if (waiter == nullptr)
+    {
+      return false;
+    }
+    if (m_impl)
+    {
+      return m_impl->AddSampleWaiter(waiter);
+    }
+    return false;
+  }
+
+  bool Collector::IsCollected(uint32_t subsystems)
+  {
+    if (m_impl)
+    {
+      return m_impl->IsCollected(subsystems);
+    }
+    return false;
+  }
+
+  bool Collector::GetSnapshot(Snapshot& snapshot)
+  {
+    if (m_impl)
+    {
+      m_impl->GetSnapshot(snapshot);
+      return true;
+    }
+    return false;
+  }
+
+  bool Collector::WriteChromeTrace(const wchar_t* path, uint32_t windowMilliSeconds)
+  {
+    if (path == nullptr)
+    {
+      return false;
+    }
+    if (m_impl)
+    {
+      return m_impl->WriteChromeTrace(path, windowMilliSeconds);
+    }
+    return false;
+  }
+
+  // ************************
+  // ScopedZone
+  // ************************
+  ScopedZone::ScopedZone(const char* name) : m_name(name)
+  {
+    m_begin = impl::GetTimestamp();
+  }
+
+  ScopedZone::~ScopedZone()
+  {
+    impl::gZoneRegistry.GetCurrentThreadBuffer().Push(m_name, m_begin, impl::GetTimestamp());
+  }
+
+  // ************************
+  // SharedSnapshotReader
+  // ************************
+  SharedSnapshotReader::~SharedSnapshotReader()
+  {
+    Close();
+  }
+
+  bool SharedSnapshotReader::Open(const wchar_t* name)
+  {
+    Close();
+    if (name == nullptr)
+    {
+      return false;
+    }
+#if defined(_WIN32)
+    m_mapping = OpenFileMappingW(FILE_MAP_READ, FALSE, name);
+    if (m_mapping == nullptr)
+    {
+      return false;
+    }
+    m_view = MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, sizeof(impl::SharedSnapshotHeader));
+#else
+    // マップした後はファイルディスクリプタを保持する必要がない.
+    char sharedMemoryName[256];
+    impl::ToSharedMemoryName(name, sharedMemoryName);
+    int fd = shm_open(sharedMemoryName, O_RDONLY, 0);
+    if (fd < 0)
+    {
+      return false;
+    }
+    struct stat status{};
+    if (fstat(fd, &status) == 0 && uint64_t(status.st_size) >= sizeof(impl::SharedSnapshotHeader))
+    {
+      auto view = mmap(nullptr, sizeof(impl::SharedSnapshotHeader), PROT_READ, MAP_SHARED, fd, 0);
+      m_view = view != MAP_FAILED ? view : nullptr;
+    }
+    close(fd);
+#endif
+    if (m_view == nullptr || !static_cast<const impl::SharedSnapshotHeader*>(m_view)->IsValid())
+    {
+      Close();
+      return false;
+    }
+    return true;
+  }
+
+  void SharedSnapshotReader::Close()
+  {
+#if defined(_WIN32)
+    if (m_view)
+    {
+      UnmapViewOfFile(m_view);
+      m_view = nullptr;
+    }
+    if (m_mapping)
+    {
+      CloseHandle(m_mapping);
+      m_mapping = nullptr;
+    }
+#else
+    if (m_view)
+    {
+      munmap(const_cast<void*>(m_view), sizeof(impl::SharedSnapshotHeader));
+      m_view = nullptr;
+    }
+#endif
+  }
+
+  bool SharedSnapshotReader::IsOpen() const
+  {
+    return m_view != nullptr;
+  }
+
+  bool SharedSnapshotReader::GetSnapshot(Snapshot& snapshot) const
+  {
+    if (m_view)
+    {
+      static_cast<const impl::SharedSnapshotHeader*>(m_view)->buffer.Read(snapshot);
+      return true;
+    }
+    return false;
+  }
+
+  double SharedSnapshotReader::GetMetricValue(MetricId metric) const
+  {
+    if (m_view)
+    {
+      return static_cast<const impl::SharedSnapshotHeader*>(m_view)->buffer.Read([&](const Snapshot& snapshot) {
+        return impl::ReadMetric(snapshot, metric);
+      });
+    }
+    return kNotCollected;
+  }
+
+  uint64_t SharedSnapshotReader::GetSequence() const
+  {
+    if (m_view)
+    {
+      return static_cast<const impl::SharedSnapshotHeader*>(m_view)->buffer.Read([](const Snapshot& snapshot) {
+        return snapshot.sequence;
+      });
+    }
+    return 0;
+  }
+
+  uint32_t SharedSnapshotReader::GetPublisherProcessId() const
+  {
+    if (m_view)
+    {
+      return static_cast<const impl::SharedSnapshotHeader*>(m_view)->publisherProcessId.load(std::memory_order_acquire);
+    }
+    return 0;
+  }
+
+  // ************************
+  // RecordingReader
+  // ************************
+  RecordingReader::~RecordingReader()
+  {
+    Close();
+  }
+
+  bool RecordingReader::Open(const wchar_t* path)
+  {
+    Close();
+    if (path == nullptr)
+    {
+      return false;
+    }
+#if defined(_WIN32)
+    m_file = CreateFileW(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (m_file == INVALID_HANDLE_VALUE)
+    {
+      m_file = nullptr;
+      return false;
+    }
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(m_file, &fileSize) || uint64_t(fileSize.QuadPart) < sizeof(impl::RecordingHeader))
+    {
+      Close();
+      return false;
+    }
+    m_mapping = CreateFileMappingW(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (m_mapping)
+    {
+      m_view = static_cast<const uint8_t*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+    }
+    m_viewSize = uint64_t(fileSize.QuadPart);
+#else
+    // マップした後はファイルディスクリプタを保持する必要がない.
+    char filePath[4096];
+    impl::ToUtf8(path, filePath, sizeof(filePath));
+    int fd = open(filePath, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+      return false;
+    }
+    struct stat status{};
+    if (fstat(fd, &status) != 0 || uint64_t(status.st_size) < sizeof(impl::RecordingHeader))
+    {
+      close(fd);
+      return false;
+    }
+    auto view = mmap(nullptr, size_t(status.st_size), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (view != MAP_FAILED)
+    {
+      m_view = static_cast<const uint8_t*>(view);
+      m_viewSize = uint64_t(status.st_size);
+    }
+#endif
+    auto header = static_cast<const impl::RecordingHeader*>(GetHeader());
+    if (header == nullptr || header->magic != impl::RecordingHeader::kMagic || header->version != impl::RecordingHeader::kVersion ||
+      header->keyframeInterval == 0 || header->deltaTimeFrequency <= 0 || header->dataOffset > m_viewSize)
+    {
+      Close();
+      return false;
+    }
+    return true;
+  }
+
+  void RecordingReader::Close()
+  {
+#if defined(_WIN32)
+    if (m_view)
+    {
+      UnmapViewOfFile(m_view);
+      m_view = nullptr;
+    }
+    m_viewSize = 0;
+    if (m_mapping)
+    {
+      CloseHandle(m_mapping);
+      m_mapping = nullptr;
+    }
+    if (m_file)
+    {
+      CloseHandle(m_file);
+      m_file = nullptr;
+    }
+#else
+    if (m_view)
+    {
+      munmap(const_cast<uint8_t*>(m_view), size_t(m_viewSize));
+      m_view = nullptr;
+    }
+    m_viewSize = 0;
+#endif
+  }
+
+  bool RecordingReader::IsOpen() const
+  {
+    return m_view != nullptr;
+  }
 
-      std::vector<double> CollectCPUUsageGlobal()
-      {
-        std::vector<double> cpuCoresUsage;
-        DWORD bufferSize = 0;
-        DWORD itemCount = 0;
-        PdhGetFormattedCounterArrayW(m_hCpuUsageGlobal, PDH_FMT_DOUBLE, &bufferSize, &itemCount, nullptr);
-        if (m_workBuffer.size() < bufferSize)
-        {
-          m_workBuffer.resize(bufferSize);
-        }
-        auto pdhItems = reinterpret_cast<PDH_FMT_COUNTERVALUE_ITEM*>(m_workBuffer.data());
-        auto pdhStatus = PdhGetFormattedCounterArrayW(m_hCpuUsageGlobal, PDH_FMT_DOUBLE, &bufferSize, &itemCount, pdhItems);
-        if (pdhStatus == ERROR_SUCCESS)
-        {
-          cpuCoresUsage.resize(itemCount);
-          for (DWORD i = 0; i < itemCount; ++i)
-          {
-            uint32_t cpuIndex = 0, coreIndex = 0;
-            auto name = std::wstring(pdhItems[i].szName);
-            ::swscanf_s(name.c_str(), L"%u,%u", &cpuIndex, &coreIndex);
-            auto value = pdhItems[i].FmtValue.doubleValue;
-            if (coreIndex < cpuCoresUsage.size())
-            {
-              cpuCoresUsage[coreIndex] = value;
-            }
-          }
-        }
-        return cpuCoresUsage;
-      }
+  const void* RecordingReader::GetHeader() const
+  {
+    return m_view;
+  }
 
-      void WorkerThread()
+  uint32_t RecordingReader::GetChannelCount() const
+  {
+    auto header = static_cast<const impl::RecordingHeader*>(GetHeader());
+    return header ? header->channelCount : 0;
+  }
+
+  MetricId RecordingReader::GetChannel(uint32_t channel) const
+  {
+    if (channel >= GetChannelCount())
+    {
+      return { Metric::Count, 0 };
+    }
+    impl::RecordingChannel entry;
+    std::memcpy(&entry, m_view + sizeof(impl::RecordingHeader) + sizeof(entry) * channel, sizeof(entry));
+    return { Metric(entry.metric), entry.index };
+  }
+
+  uint32_t RecordingReader::FindChannel(MetricId metric) const
+  {
+    auto count = GetChannelCount();
+    for (uint32_t i = 0; i < count; ++i)
+    {
+      auto channel = GetChannel(i);
+      if (channel.metric == metric.metric && channel.index == metric.index)
       {
-        while (!m_exit)
-        {
-          PDH_STATUS pdhStatus;
-          pdhStatus = PdhCollectQueryData(m_pdhQuery);
-          if (pdhStatus != ERROR_SUCCESS)
-          {
-            continue;
-          }
+        return i;
+      }
+    }
+    return kInvalidChannel;
+  }
 
-          // GPU Engine Utilization
-          auto gpuEngineUtilization = CollectGPUUtilization();
+  uint64_t RecordingReader::GetRecordCount() const
+  {
+    auto header = static_cast<const impl::RecordingHeader*>(GetHeader());
+    if (header == nullptr)
+    {
+      return 0;
+    }
+    // 記録中のファイルの場合、マップした範囲に収まる分のみ.
+    auto count = header->recordCount;
+    while (count > 0 && header->GetRecordOffset(count) > m_viewSize)
+    {
+      count--;
+    }
+    return count;
+  }
 
-          // GPU Memory
-          auto gpuDedicatedMem = CollectGPUMemoryDedicated();
-          auto gpuSharedMem = CollectGPUMemoryShared();
+  int64_t RecordingReader::GetTimestampFrequency() const
+  {
+    auto header = static_cast<const impl::RecordingHeader*>(GetHeader());
+    return header ? header->timestampFrequency : 0;
+  }
 
-          // CPU
-          double cpuUsage = m_cpuUsage;
-          double cpuUsageGlobal = m_cpuUsageGlobal;
-          auto cpuCoresUsage = CollectCPUUsageGlobal();
-          
-          cpuUsageGlobal = 0;
-          for (auto& usage : cpuCoresUsage)
-          {
-            cpuUsageGlobal += usage;
-          }
-          cpuUsageGlobal /= (std::max)(1ull, cpuCoresUsage.size());
-          cpuUsageGlobal = (std::min)(cpuUsageGlobal, 100.0);
+  bool RecordingReader::ReadRecord(uint64_t index, int64_t& timestamp, std::span<double> values) const
+  {
+    if (index >= GetRecordCount())
+    {
+      return false;
+    }
+    auto header = static_cast<const impl::RecordingHeader*>(GetHeader());
+    auto channelCount = (std::min)(size_t(header->channelCount), values.size());
+    auto keyframe = m_view + header->GetRecordOffset(index - index % header->keyframeInterval);
+    std::memcpy(&timestamp, keyframe, sizeof(timestamp));
+    std::memcpy(values.data(), keyframe + sizeof(timestamp), sizeof(double) * channelCount);
+    if (index % header->keyframeInterval == 0)
+    {
+      return true;
+    }
 
-          if(!m_useCpuUtilizationGlobal)
-          {
-            auto processCpuUsagePathList = GetProcessPathList();
-            if (processCpuUsagePathList.size() > 1)
-            {
-              // 同名プロセスが増減の債には、カウンターパスの再計算が必要.
-              auto counterPath = GetPathMatched(processCpuUsagePathList);
-              if (!counterPath.empty())
-              {
-                // カウンタを再登録する.
-                PdhRemoveCounter(m_hCpuUsage);
-                PdhAddCounter(m_pdhQuery, counterPath.c_str(), 0, &m_hCpuUsage);
-              }
-            }
-            else
-            {
-              cpuUsage = CollectCPUUsage();
-            }
-          }
+    // 経過時刻は直前のレコードからの差のため、キーフレームの次から積み上げる.
+    int64_t elapsed = 0;
+    for (auto slot = index - index % header->keyframeInterval + 1; slot <= index; ++slot)
+    {
+      uint32_t step = 0;
+      std::memcpy(&step, m_view + header->GetRecordOffset(slot), sizeof(step));
+      if (step == 0)
+      {
+        return false;
+      }
+      elapsed += step;
+    }
+    timestamp += impl::ConvertTimestamp(elapsed, header->deltaTimeFrequency, header->timestampFrequency);
+    auto record = m_view + header->GetRecordOffset(index);
+    for (size_t i = 0; i < channelCount; ++i)
+    {
+      float delta;
+      std::memcpy(&delta, record + sizeof(uint32_t) + sizeof(float) * i, sizeof(float));
+      values[i] += delta;
+    }
+    return true;
+  }
 
-          // データを反映するためロックを取得.
-          {
-            std::unique_lock lock(m_mutex);
-            m_cpuUsage = (m_cpuUsage + cpuUsage) * 0.5;
-            m_cpuUsageGlobal = cpuUsageGlobal;
-            m_gpuEngineUtilization = gpuEngineUtilization;
-            m_gpuMemory.dedicated = gpuDedicatedMem;
-            m_gpuMemory.shared = gpuSharedMem;
-            if (m_useCpuUtilizationGlobal)
-            {
-              m_cpuUsagePeak = (std::max)(m_cpuUsageGlobal, m_cpuUsagePeak);
-            }
-            else
-            {
-              m_cpuUsagePeak = (std::max)(m_cpuUsage, m_cpuUsagePeak);
-            }
+  uint64_t RecordingReader::FindRecord(int64_t timestamp) const
+  {
+    auto count = GetRecordCount();
+    if (count == 0)
+    {
+      return 0;
+    }
+    auto header = static_cast<const impl::RecordingHeader*>(GetHeader());
+    auto keyframeTimestamp = [&](uint64_t block) {
+      int64_t value;
+      std::memcpy(&value, m_view + header->GetRecordOffset(block * header->keyframeInterval), sizeof(value));
+      return value;
+    };
 
-            m_cpuCoresUsage.resize(cpuCoresUsage.size());
-            for (uint32_t i = 0; i < cpuCoresUsage.size(); ++i)
-            {
-              m_cpuCoresUsage[i] = (std::min)(cpuCoresUsage[i], 100.0);
-            }
-          }
+    // キーフレームの時刻で二分探索し、timestamp を含むブロックを求める.
+    uint64_t blockCount = (count + header->keyframeInterval - 1) / header->keyframeInterval;
+    uint64_t low = 0, high = blockCount;
+    while (low < high)
+    {
+      auto mid = (low + high) / 2;
+      if (keyframeTimestamp(mid) <= timestamp)
+      {
+        low = mid + 1;
+      }
+      else
+      {
+        high = mid;
+      }
+    }
+    if (low == 0)
+    {
+      return 0;
+    }
 
-          std::this_thread::sleep_for(m_intervalPeriod);
+    // ブロック内を先頭から探す.
+    auto block = low - 1;
+    auto baseTimestamp = keyframeTimestamp(block);
+    auto end = (std::min)(count, (block + 1) * header->keyframeInterval);
+    int64_t elapsed = 0;
+    for (auto index = block * header->keyframeInterval; index < end; ++index)
+    {
+      int64_t recordTimestamp = baseTimestamp;
+      if (index % header->keyframeInterval != 0)
+      {
+        uint32_t step = 0;
+        std::memcpy(&step, m_view + header->GetRecordOffset(index), sizeof(step));
+        if (step == 0)
+        {
+          // 欠番以降はブロックの終わりまで欠番.
+          break;
         }
+        elapsed += step;
+        recordTimestamp += impl::ConvertTimestamp(elapsed, header->deltaTimeFrequency, header->timestampFrequency);
       }
-    };
-
-    std::unique_ptr<SimplePerfCounter> gPerformanceCounter;
+      if (recordTimestamp >= timestamp)
+      {
+        return index;
+      }
+    }
+    return end;
   }
 
   // ************************
@@ -591,101 +9049,260 @@ namespace tiny_perf_counter
   // ************************
   bool Initialize(const InitParams& initParams)
   {
-    if (impl::gPerformanceCounter)
-    {
-      return true; // 既に初期化されている.
-    }
-    impl::gPerformanceCounter = std::make_unique<impl::SimplePerfCounter>();
-    return impl::gPerformanceCounter->Initialize(initParams);
+    return impl::gDefaultCollector.Initialize(initParams);
   }
 
   void Shutdown()
   {
-    if (impl::gPerformanceCounter)
-    {
-      impl::gPerformanceCounter.reset();
-    }
+    impl::gDefaultCollector.Shutdown();
   }
 
   uint64_t GetUsedGPUDedicatedMemory()
   {
-    if (impl::gPerformanceCounter)
-    {
-      return impl::gPerformanceCounter->GetUsedGPUDedicatedMemory();
-    }
-    return 0;
+    return impl::gDefaultCollector.GetUsedGPUDedicatedMemory();
   }
 
   uint64_t GetUsedGPUSharedMemory()
   {
-    if (impl::gPerformanceCounter)
-    {
-      return impl::gPerformanceCounter->GetUsedGPUSharedMemory();
-    }
-    return 0;
+    return impl::gDefaultCollector.GetUsedGPUSharedMemory();
   }
 
   double GetGPUEngineUtilization()
   {
-    if (impl::gPerformanceCounter)
-    {
-      return impl::gPerformanceCounter->GetGPUEngineUtilization(L"3D");
-    }
-    return 0;
+    return impl::gDefaultCollector.GetGPUEngineUtilization();
   }
+
   double GetGPUEngineUtilization(const wchar_t* engineName)
   {
-    if (engineName == nullptr)
-    {
-      return 0;
-    }
-    if (impl::gPerformanceCounter)
-    {
-      return impl::gPerformanceCounter->GetGPUEngineUtilization(engineName);
-    }
-    return 0;
+    return impl::gDefaultCollector.GetGPUEngineUtilization(engineName);
   }
+
   std::vector<std::wstring> GetGPUEngineNames()
   {
-    std::vector<std::wstring> nameList;
-    if (impl::gPerformanceCounter)
-    {
-      impl::gPerformanceCounter->GetGPUEngineUtilization(nameList);
-    }
-    return nameList;
+    return impl::gDefaultCollector.GetGPUEngineNames();
+  }
+
+  uint32_t GetGPUEngineNames(std::span<const wchar_t*> names)
+  {
+    return impl::gDefaultCollector.GetGPUEngineNames(names);
+  }
+
+  uint32_t FindGPUEngineId(const wchar_t* engineName)
+  {
+    return impl::gDefaultCollector.FindGPUEngineId(engineName);
+  }
+
+  double GetGPUEngineUtilizationById(uint32_t engineId)
+  {
+    return impl::gDefaultCollector.GetGPUEngineUtilizationById(engineId);
+  }
+
+  uint32_t GetGPUEnginesUtilization(std::span<double> utilization)
+  {
+    return impl::gDefaultCollector.GetGPUEnginesUtilization(utilization);
+  }
+
+  uint32_t GetGPUAdapters(std::span<GPUAdapterSample> adapters)
+  {
+    return impl::gDefaultCollector.GetGPUAdapters(adapters);
+  }
+
+  uint32_t GetGPUEngineInstances(std::span<GPUEngineInstanceSample> instances)
+  {
+    return impl::gDefaultCollector.GetGPUEngineInstances(instances);
   }
 
   double GetCPUUtilization()
   {
-    if (impl::gPerformanceCounter)
+    return impl::gDefaultCollector.GetCPUUtilization();
+  }
+
+  std::vector<double> GetCPUCoresUtilization()
+  {
+    return impl::gDefaultCollector.GetCPUCoresUtilization();
+  }
+
+  uint32_t GetCPUCoresUtilization(std::span<double> coresUtilization)
+  {
+    return impl::gDefaultCollector.GetCPUCoresUtilization(coresUtilization);
+  }
+
+  uint32_t GetCPUNumaNodesUtilization(std::span<double> nodesUtilization)
+  {
+    return impl::gDefaultCollector.GetCPUNumaNodesUtilization(nodesUtilization);
+  }
+
+  uint32_t GetCPUPackagesUtilization(std::span<double> packagesUtilization)
+  {
+    return impl::gDefaultCollector.GetCPUPackagesUtilization(packagesUtilization);
+  }
+
+  uint32_t GetCPUCoresFrequency(std::span<CPUFrequencySample> coresFrequency)
+  {
+    return impl::gDefaultCollector.GetCPUCoresFrequency(coresFrequency);
+  }
+
+  CPUThrottleSample GetCPUThrottle()
+  {
+    return impl::gDefaultCollector.GetCPUThrottle();
+  }
+
+  uint32_t GetFilteredMetrics(std::span<FilteredMetricSample> metrics)
+  {
+    return impl::gDefaultCollector.GetFilteredMetrics(metrics);
+  }
+
+  uint32_t GetCPUTopology(std::span<LogicalProcessorInfo> processors)
+  {
+    return impl::gDefaultCollector.GetCPUTopology(processors);
+  }
+
+  uint32_t GetProcesses(std::span<ProcessSample> processes)
+  {
+    return impl::gDefaultCollector.GetProcesses(processes);
+  }
+
+  uint32_t GetThreadsUtilization(std::span<ThreadSample> threads)
+  {
+    return impl::gDefaultCollector.GetThreadsUtilization(threads);
+  }
+
+  MemorySample GetMemoryUsage()
+  {
+    return impl::gDefaultCollector.GetMemoryUsage();
+  }
+
+  uint32_t GetDisks(std::span<DiskSample> disks)
+  {
+    return impl::gDefaultCollector.GetDisks(disks);
+  }
+
+  uint32_t GetNetworkInterfaces(std::span<NetworkInterfaceSample> interfaces)
+  {
+    return impl::gDefaultCollector.GetNetworkInterfaces(interfaces);
+  }
+
+  void SetCurrentThreadName(const wchar_t* name)
+  {
+    if (name == nullptr)
     {
-      return impl::gPerformanceCounter->GetCPUUtilization();
+      return;
     }
-    return 0;
+#if defined(_WIN32)
+    if (auto setThreadDescription = impl::GetKernel32Functions().setThreadDescription)
+    {
+      setThreadDescription(GetCurrentThread(), name);
+    }
+#else
+    // スレッド名は終端を含めて 16 バイトまで.
+    char threadName[16];
+    impl::ToUtf8(name, threadName, sizeof(threadName));
+    pthread_setname_np(pthread_self(), threadName);
+#endif
+    impl::gThreadNameRegistry.Register(impl::GetThreadId(), name);
   }
-  std::vector<double> GetCPUCoresUtilization()
+  void RegisterThreadName(uint32_t threadId, const wchar_t* name)
   {
-    if (impl::gPerformanceCounter)
+    if (name == nullptr)
     {
-      return impl::gPerformanceCounter->GetCPUCoresUtilization();
+      return;
     }
-    return std::vector<double>();
+    impl::gThreadNameRegistry.Register(threadId, name);
   }
 
   void ResetPeakCPU()
   {
-    if (impl::gPerformanceCounter)
-    {
-      impl::gPerformanceCounter->ResetPeakCPU();
-    }
+    impl::gDefaultCollector.ResetPeakCPU();
   }
+
   double GetPeakCPUUtilization()
   {
-    if (impl::gPerformanceCounter)
-    {
-      return impl::gPerformanceCounter->GetPeakCPUUtilization();
-    }
-    return 0;
+    return impl::gDefaultCollector.GetPeakCPUUtilization();
+  }
+
+  double GetMetricValue(MetricId metric)
+  {
+    return impl::gDefaultCollector.GetMetricValue(metric);
+  }
+
+  bool GetMetricStatistics(MetricId metric, uint32_t windowMilliSeconds, MetricStatistics& statistics)
+  {
+    return impl::gDefaultCollector.GetMetricStatistics(metric, windowMilliSeconds, statistics);
+  }
+
+  uint32_t GetMetricHistory(MetricId metric, std::span<MetricSample> samples)
+  {
+    return impl::gDefaultCollector.GetMetricHistory(metric, samples);
+  }
+
+  uint32_t AddTrigger(const TriggerDesc& desc)
+  {
+    return impl::gDefaultCollector.AddTrigger(desc);
+  }
+
+  bool RemoveTrigger(uint32_t triggerId)
+  {
+    return impl::gDefaultCollector.RemoveTrigger(triggerId);
+  }
+
+  CounterHandle AddCounter(const wchar_t* counterPath, uint32_t format, const wchar_t* instanceFilter, CounterGroup group)
+  {
+    return impl::gDefaultCollector.AddCounter(counterPath, format, instanceFilter, group);
+  }
+
+  double GetCounterValue(CounterHandle handle, uint32_t instance)
+  {
+    return impl::gDefaultCollector.GetCounterValue(handle, instance);
+  }
+
+  uint32_t GetCounterValues(CounterHandle handle, std::span<double> values)
+  {
+    return impl::gDefaultCollector.GetCounterValues(handle, values);
+  }
+
+  const wchar_t* GetCounterInstanceName(CounterHandle handle, uint32_t instance)
+  {
+    return impl::gDefaultCollector.GetCounterInstanceName(handle, instance);
+  }
+
+  bool SampleNow(uint32_t timeoutMilliSeconds)
+  {
+    return impl::gDefaultCollector.SampleNow(timeoutMilliSeconds);
+  }
+
+  bool WaitForNextSample(uint32_t timeoutMilliSeconds)
+  {
+    return impl::gDefaultCollector.WaitForNextSample(timeoutMilliSeconds);
+  }
+
+  void* GetSampleEvent()
+  {
+    return impl::gDefaultCollector.GetSampleEvent();
+  }
+
+  bool ProcessSampleEvent()
+  {
+    return impl::gDefaultCollector.ProcessSampleEvent();
+  }
+
+  bool AddSampleWaiter(SampleWaiter* waiter)
+  {
+    return impl::gDefaultCollector.AddSampleWaiter(waiter);
+  }
+
+  bool IsCollected(uint32_t subsystems)
+  {
+    return impl::gDefaultCollector.IsCollected(subsystems);
+  }
+
+  bool GetSnapshot(Snapshot& snapshot)
+  {
+    return impl::gDefaultCollector.GetSnapshot(snapshot);
+  }
+
+  bool WriteChromeTrace(const wchar_t* path, uint32_t windowMilliSeconds)
+  {
+    return impl::gDefaultCollector.WriteChromeTrace(path, windowMilliSeconds);
   }
 } // tiny_perf_counter
 #endif // TINY_PERFORMANCE_COUNTER_IMPLEMENTATION